@@ -17,6 +17,7 @@ boolean MotorController::stepperEnabled() const
 
 void MotorController::setStepperEnabled(boolean enabled)
 {
+    m_stepperEnabled = enabled;
     digitalWrite(stepperEnablePin, enabled ? LOW : HIGH);
 }
 
@@ -35,6 +36,49 @@ RobotStepper *MotorController::stepper3() const
     return m_stepper3;
 }
 
+StepperController *MotorController::stepperController() const
+{
+    return m_stepperController;
+}
+
+void MotorController::snapshot(StatusSnapshot *status) const
+{
+    // Steps are generated from the loop, so the state can not change while we are here. The
+    // interrupt lock keeps the snapshot consistent even if stepping moves into a timer interrupt.
+    noInterrupts();
+    status->timestamp = micros();
+    status->positions[0] = m_stepper1->currentPosition();
+    status->positions[1] = m_stepper2->currentPosition();
+    status->positions[2] = m_stepper3->currentPosition();
+    status->queueDepth = m_stepperController->queueDepth();
+    status->flags = 0;
+    if (m_stepperEnabled)
+        status->flags |= StatusFlagSteppersEnabled;
+    if (m_stepperController->isRunning())
+        status->flags |= StatusFlagMoving;
+    if (m_stepperController->queueFull())
+        status->flags |= StatusFlagQueueFull;
+    if (m_stepperController->feedHoldActive())
+        status->flags |= StatusFlagFeedHold;
+    interrupts();
+}
+
+void MotorController::feedHold()
+{
+    m_stepperController->feedHold();
+}
+
+void MotorController::resume()
+{
+    m_stepperController->resume();
+}
+
+void MotorController::emergencyStop()
+{
+    m_stepperController->stop();
+    setStepperEnabled(false);
+}
+
 void MotorController::init()
 {        
     // Enable stepper
@@ -54,24 +98,14 @@ void MotorController::init()
 	// m_stepper2->moveTo(400);
 
     m_stepper3 = new RobotStepper(stepPinZ, dirPinZ);
+
+    m_stepperController = new StepperController();
+    m_stepperController->addStepper(*m_stepper1);
+    m_stepperController->addStepper(*m_stepper2);
+    m_stepperController->addStepper(*m_stepper3);
 }
 
 void MotorController::process()
 {
-    // Change direction once the motor reaches target position
-	if (m_stepper1->distanceToGo() == 0) 
-		m_stepper1->moveTo(-m_stepper1->currentPosition());
-    
-    // Change direction once the motor reaches target position
-	if (m_stepper2->distanceToGo() == 0) 
-		m_stepper2->moveTo(-m_stepper2->currentPosition());
-    
-    // Change direction once the motor reaches target position
-	if (m_stepper3->distanceToGo() == 0) 
-		m_stepper3->moveTo(-m_stepper3->currentPosition());
-    
-
-    m_stepper1->run();
-    m_stepper2->run();
-    m_stepper3->run();
+    m_stepperController->run();
 }
\ No newline at end of file
@@ -2,6 +2,7 @@
 #define MOTORCONTROLLER_H
 
 #include "RobotStepper.h"
+#include "StepperController.h"
 
 // CNC shield
 const uint8_t stepperEnablePin = 8;
@@ -15,10 +16,25 @@ const int dirPinY = 6;
 const int stepPinZ = 4;
 const int dirPinZ = 7;
 
+// Consistent state of all axes, taken at one instant
+struct StatusSnapshot
+{
+    long positions[STEPPERCONTROLLER_MAX_STEPPERS];
+    uint8_t queueDepth;
+    uint8_t flags;
+    unsigned long timestamp; // us
+};
 
 class MotorController 
 {
 public:
+    enum StatusFlag {
+        StatusFlagSteppersEnabled = 0x01,
+        StatusFlagMoving = 0x02,
+        StatusFlagQueueFull = 0x04,
+        StatusFlagFeedHold = 0x08
+    };
+
     MotorController();
     ~MotorController();
 
@@ -29,6 +45,16 @@ public:
     RobotStepper *stepper2() const; // y
     RobotStepper *stepper3() const; // z
 
+    StepperController *stepperController() const;
+
+    void snapshot(StatusSnapshot *status) const;
+
+    void feedHold();
+    void resume();
+
+    // Drops all motion without a ramp and disables the drivers
+    void emergencyStop();
+
     void init();
     void process();
 
@@ -38,6 +64,8 @@ private:
     RobotStepper *m_stepper2 = nullptr;
     RobotStepper *m_stepper3 = nullptr;
 
+    StepperController *m_stepperController = nullptr;
+
 
 };
 
@@ -0,0 +1,27 @@
+#include "RampTable.h"
+
+#define RAMP_TABLE_DATA(acceleration, maxSpeed) \
+    static constexpr RampTableData<acceleration, maxSpeed> rampTable_##acceleration##_##maxSpeed PROGMEM = RampTableData<acceleration, maxSpeed>();
+
+#define RAMP_TABLE_PROFILE(acceleration, maxSpeed) \
+    { acceleration, maxSpeed, RampTableData<acceleration, maxSpeed>::length, rampTable_##acceleration##_##maxSpeed.steps },
+
+RAMP_TABLE_PROFILES(RAMP_TABLE_DATA)
+
+static const RampProfile rampProfiles[] PROGMEM = {
+    RAMP_TABLE_PROFILES(RAMP_TABLE_PROFILE)
+};
+
+boolean RampTable::find(float acceleration, float maxSpeed, RampProfile *profile)
+{
+    for (uint8_t i = 0; i < sizeof(rampProfiles) / sizeof(RampProfile); i++) {
+        RampProfile candidate;
+        memcpy_P(&candidate, &rampProfiles[i], sizeof(RampProfile));
+        if (candidate.acceleration == acceleration && candidate.maxSpeed == maxSpeed) {
+            *profile = candidate;
+            return true;
+        }
+    }
+
+    return false;
+}
@@ -0,0 +1,100 @@
+#ifndef RAMPTABLE_H
+#define RAMPTABLE_H
+
+#include <Arduino.h>
+
+// Acceleration profiles with a precomputed ramp: PROFILE(acceleration [steps/s^2], max speed [steps/s]).
+// The step intervals of each profile are generated at compile time and stored in flash,
+// steppers using any other combination fall back to the computed ramp.
+#define RAMP_TABLE_PROFILES(PROFILE) \
+    PROFILE(1000, 400) \
+    PROFILE(2000, 800) \
+    PROFILE(4000, 1000) \
+    PROFILE(8000, 1600)
+
+const uint16_t rampTableMaxLength = 256;
+
+struct RampStep
+{
+    uint16_t interval; // us
+    uint16_t speed; // steps/s
+};
+
+struct RampProfile
+{
+    uint16_t acceleration = 0;
+    uint16_t maxSpeed = 0;
+    uint16_t length = 0;
+    const RampStep *steps = nullptr; // PROGMEM
+};
+
+class RampTable
+{
+public:
+    // Copies the profile descriptor from flash, returns false if there is no table for the given values
+    static boolean find(float acceleration, float maxSpeed, RampProfile *profile);
+
+    static inline uint16_t interval(const RampProfile &profile, uint16_t index) {
+        return pgm_read_word(&profile.steps[index].interval);
+    }
+
+    static inline uint16_t speed(const RampProfile &profile, uint16_t index) {
+        return pgm_read_word(&profile.steps[index].speed);
+    }
+
+    // Same math as AccelStepper::computeNewSpeed(), evaluated by the compiler
+    static constexpr float initialInterval(float acceleration) {
+        return 0.676f * squareRoot(2.0f / acceleration) * 1000000.0f; // Equation 15
+    }
+
+    static constexpr float nextInterval(float interval, uint16_t n) {
+        return interval - ((2.0f * interval) / ((4.0f * n) + 1)); // Equation 13
+    }
+
+    static constexpr uint16_t rampLength(float acceleration, float maxSpeed) {
+        float minInterval = 1000000.0f / maxSpeed;
+        float interval = initialInterval(acceleration);
+        uint16_t length = 1;
+        while (interval > minInterval && length <= rampTableMaxLength) {
+            interval = nextInterval(interval, length);
+            length++;
+        }
+        return length;
+    }
+
+private:
+    static constexpr float squareRoot(float value) {
+        float result = value > 1.0f ? value : 1.0f;
+        for (uint8_t i = 0; i < 32; i++) {
+            result = 0.5f * (result + value / result);
+        }
+        return result;
+    }
+};
+
+template<uint16_t Acceleration, uint16_t MaxSpeed>
+struct RampTableData
+{
+    static constexpr uint16_t length = RampTable::rampLength(Acceleration, MaxSpeed);
+    static_assert(length <= rampTableMaxLength, "Ramp table too long, use a higher acceleration or a lower max speed");
+    static_assert(RampTable::initialInterval(Acceleration) < 65535.0f, "Acceleration too low for a 16 bit ramp table");
+
+    RampStep steps[length];
+
+    constexpr RampTableData() : steps() {
+        float minInterval = 1000000.0f / MaxSpeed;
+        float interval = RampTable::initialInterval(Acceleration);
+        for (uint16_t n = 0; n < length; n++) {
+            if (n > 0)
+                interval = RampTable::nextInterval(interval, n);
+
+            if (interval < minInterval)
+                interval = minInterval;
+
+            steps[n].interval = static_cast<uint16_t>(interval);
+            steps[n].speed = static_cast<uint16_t>(1000000.0f / interval + 0.5f);
+        }
+    }
+};
+
+#endif // RAMPTABLE_H
@@ -10,3 +10,13 @@ RobotStepper::~RobotStepper()
 {
 
 }
+
+void RobotStepper::singleStep(boolean forward)
+{
+    long position = currentPosition() + (forward ? 1 : -1);
+
+    // Keeps target and position together, so run() will not move on its own afterwards
+    setCurrentPosition(position);
+    _direction = forward ? DIRECTION_CW : DIRECTION_CCW;
+    step(position);
+}
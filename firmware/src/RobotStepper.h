@@ -10,8 +10,11 @@ public:
     RobotStepper(int dirPin, int stepPin);
     ~RobotStepper();
 
+    // Step once without ramping, used by the StepperController for coordinated moves
+    void singleStep(boolean forward);
+
 private:
 
 };
 
-#endif // ROBOTSTEPPER
\ No newline at end of file
+#endif // ROBOTSTEPPER
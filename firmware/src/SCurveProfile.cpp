@@ -0,0 +1,193 @@
+#include "SCurveProfile.h"
+
+#include <math.h>
+
+void SCurveProfile::plan(uint32_t steps, float maxSpeed, float acceleration, float jerk)
+{
+    // Time to reach full acceleration and the duration of one complete speed ramp
+    float speed = maxSpeed;
+    float jerkTime = acceleration / jerk;
+    float rampTime;
+    if (speed * jerk < acceleration * acceleration) {
+        // The max speed is reached before the acceleration limit
+        jerkTime = sqrt(speed / jerk);
+        rampTime = 2 * jerkTime;
+    } else {
+        rampTime = speed / acceleration + jerkTime;
+    }
+
+    // Both ramps together cover speed * rampTime steps, lower the peak speed if the segment is too short
+    if (speed * rampTime > steps) {
+        speed = 0.5 * acceleration * (-acceleration / jerk + sqrt(acceleration * acceleration / (jerk * jerk) + 4.0 * steps / acceleration));
+        if (speed * jerk >= acceleration * acceleration) {
+            jerkTime = acceleration / jerk;
+            rampTime = speed / acceleration + jerkTime;
+        } else {
+            jerkTime = cbrt(steps / (2.0 * jerk));
+            rampTime = 2 * jerkTime;
+        }
+    }
+
+    m_jerkTicks = static_cast<uint32_t>(jerkTime * sCurveTicksPerSecond + 0.5);
+    if (m_jerkTicks == 0)
+        m_jerkTicks = 1;
+
+    float accelerationTime = rampTime - 2 * jerkTime;
+    m_accelerationTicks = accelerationTime > 0 ? static_cast<uint32_t>(accelerationTime * sCurveTicksPerSecond + 0.5) : 0;
+
+    // Peak acceleration per tick is reached after the jerk ticks, derive the jerk from it so
+    // the acceleration returns exactly to zero at the end of each ramp
+    float peakAcceleration = jerk * jerkTime;
+    if (peakAcceleration > acceleration)
+        peakAcceleration = acceleration;
+
+    uint32_t peak = static_cast<uint32_t>(peakAcceleration * 65536.0 / sCurveTicksPerSecond + 0.5);
+    if (peak == 0)
+        peak = 1;
+
+    m_jerk = peak / m_jerkTicks;
+    m_jerkRemainder = peak % m_jerkTicks;
+
+    // Steps covered while ramping down from the integrated peak speed
+    float peakSpeed = static_cast<float>(peak) * (m_jerkTicks + m_accelerationTicks) / 65536.0;
+    m_decelerationSteps = static_cast<uint32_t>(peakSpeed * (2 * m_jerkTicks + m_accelerationTicks) / (2.0 * sCurveTicksPerSecond) + 0.5);
+
+    m_minimumSpeed = static_cast<uint16_t>(sqrt(acceleration / 2.0) / 0.676); // Equation 15
+    if (m_minimumSpeed == 0)
+        m_minimumSpeed = 1;
+
+    m_acceleration = 0;
+    m_speed = 0;
+    m_plannedSteps = 0;
+    m_phase = PhaseJerkUp;
+    m_phaseTick = 0;
+    m_jerkError = 0;
+}
+
+uint32_t SCurveProfile::update(uint32_t remainingSteps)
+{
+    // Skip over finished and empty phases, the cruise phase ends by position
+    while (m_phase != PhaseDone && m_phase != PhaseCruise && m_phaseTick >= phaseLength(m_phase)) {
+        nextPhase();
+    }
+
+    if (m_phase == PhaseCruise && remainingSteps <= m_decelerationSteps)
+        nextPhase();
+
+    if (m_phase < PhaseDecelerateJerkDown) {
+        tick();
+    } else {
+        // Tick ahead while the deceleration plans more steps than remain, wait while it plans fewer
+        uint32_t remaining = remainingSteps < 0x1000000UL ? remainingSteps << 8 : 0xFFFFFFFFUL;
+        while (m_phase != PhaseDone && m_plannedSteps > remaining) {
+            tick();
+        }
+    }
+
+    uint32_t stepsPerSecond = m_speed >> 16;
+    if (stepsPerSecond < m_minimumSpeed)
+        stepsPerSecond = m_minimumSpeed;
+
+    return 1000000UL / stepsPerSecond;
+}
+
+uint32_t SCurveProfile::speed() const
+{
+    return m_speed;
+}
+
+int32_t SCurveProfile::acceleration() const
+{
+    return m_acceleration;
+}
+
+SCurveProfile::Phase SCurveProfile::phase() const
+{
+    return m_phase;
+}
+
+uint32_t SCurveProfile::jerkTicks() const
+{
+    return m_jerkTicks;
+}
+
+uint32_t SCurveProfile::accelerationTicks() const
+{
+    return m_accelerationTicks;
+}
+
+uint32_t SCurveProfile::decelerationSteps() const
+{
+    return m_decelerationSteps;
+}
+
+void SCurveProfile::tick()
+{
+    while (m_phase != PhaseDone && m_phase != PhaseCruise && m_phaseTick >= phaseLength(m_phase)) {
+        nextPhase();
+    }
+
+    switch (m_phase) {
+    case PhaseJerkUp:
+    case PhaseDecelerateJerkUp:
+        m_acceleration += nextJerk();
+        break;
+    case PhaseJerkDown:
+    case PhaseDecelerateJerkDown:
+        m_acceleration -= nextJerk();
+        break;
+    case PhaseDone:
+        m_acceleration = 0;
+        return;
+    default:
+        break;
+    }
+
+    uint32_t previousSpeed = m_speed;
+    int32_t speed = static_cast<int32_t>(m_speed) + m_acceleration;
+    m_speed = speed > 0 ? speed : 0;
+    m_phaseTick++;
+
+    // Steps of this tick at the average speed, in 24.8
+    if (m_phase >= PhaseDecelerateJerkDown) {
+        uint32_t steps = ((previousSpeed >> 9) + (m_speed >> 9)) / sCurveTicksPerSecond;
+        m_plannedSteps = m_plannedSteps > steps ? m_plannedSteps - steps : 0;
+    }
+}
+
+int32_t SCurveProfile::nextJerk()
+{
+    m_jerkError += m_jerkRemainder;
+    if (m_jerkError >= m_jerkTicks) {
+        m_jerkError -= m_jerkTicks;
+        return m_jerk + 1;
+    }
+
+    return m_jerk;
+}
+
+void SCurveProfile::nextPhase()
+{
+    m_phase = static_cast<Phase>(m_phase + 1);
+    m_phaseTick = 0;
+    m_jerkError = 0;
+
+    if (m_phase == PhaseDecelerateJerkDown)
+        m_plannedSteps = m_decelerationSteps < 0x1000000UL ? m_decelerationSteps << 8 : 0xFFFFFFFFUL;
+}
+
+uint32_t SCurveProfile::phaseLength(Phase phase) const
+{
+    switch (phase) {
+    case PhaseJerkUp:
+    case PhaseJerkDown:
+    case PhaseDecelerateJerkDown:
+    case PhaseDecelerateJerkUp:
+        return m_jerkTicks;
+    case PhaseAccelerate:
+    case PhaseDecelerate:
+        return m_accelerationTicks;
+    default:
+        return 0;
+    }
+}
@@ -0,0 +1,81 @@
+#ifndef SCURVEPROFILE_H
+#define SCURVEPROFILE_H
+
+#include <stdint.h>
+
+// Rate of the speed updates while running a jerk limited profile
+const uint16_t sCurveTicksPerSecond = 1000;
+
+// Jerk limited (7 segment) rest to rest speed profile.
+//
+// The phase durations are planned once per segment, afterwards the profile is
+// integrated in 16.16 fixed point with two additions per tick:
+//  1 jerk+  2 constant acceleration  3 jerk-  4 cruise  5 jerk-  6 constant deceleration  7 jerk+
+// The jerk carries the remainder of its division by the jerk ticks like a Bresenham line, so
+// every jerk phase changes the acceleration by exactly the planned peak.
+//
+// The cruise phase ends by position, once the remaining steps are just enough to stop. The
+// deceleration follows the position as well: the profile ticks ahead or waits until the distance
+// it still plans to cover matches the remaining steps, so the speed is down when the steps are.
+//
+// Does not depend on Arduino, so the host side motion simulator can run the exact same code.
+class SCurveProfile
+{
+public:
+    enum Phase {
+        PhaseJerkUp = 0,
+        PhaseAccelerate,
+        PhaseJerkDown,
+        PhaseCruise,
+        PhaseDecelerateJerkDown,
+        PhaseDecelerate,
+        PhaseDecelerateJerkUp,
+        PhaseDone
+    };
+
+    // Speed and acceleration in steps/s and steps/s^2, jerk in steps/s^3
+    void plan(uint32_t steps, float maxSpeed, float acceleration, float jerk);
+
+    // Advance one tick, returns the step interval in us for the new speed
+    uint32_t update(uint32_t remainingSteps);
+
+    // Fixed point 16.16 steps/s
+    uint32_t speed() const;
+    int32_t acceleration() const;
+    Phase phase() const;
+
+    uint32_t jerkTicks() const;
+    uint32_t accelerationTicks() const;
+    uint32_t decelerationSteps() const;
+
+private:
+    // Fixed point 16.16
+    int32_t m_jerk = 0; // per tick^2
+    int32_t m_acceleration = 0; // per tick
+    uint32_t m_speed = 0;
+
+    // Remainder of the jerk per jerk tick and its running sum within the phase
+    uint32_t m_jerkRemainder = 0;
+    uint32_t m_jerkError = 0;
+
+    // Distance the deceleration still plans to cover, fixed point 24.8 steps
+    uint32_t m_plannedSteps = 0;
+
+    // Start and creep speed, same as the first step of the AccelStepper ramp
+    uint16_t m_minimumSpeed = 1;
+
+    uint32_t m_jerkTicks = 0;
+    uint32_t m_accelerationTicks = 0;
+    uint32_t m_decelerationSteps = 0;
+
+    Phase m_phase = PhaseDone;
+    uint32_t m_phaseTick = 0;
+
+    void tick();
+    int32_t nextJerk();
+    void nextPhase();
+    uint32_t phaseLength(Phase phase) const;
+
+};
+
+#endif // SCURVEPROFILE_H
@@ -1,5 +1,4 @@
 #include "SerialApiServer.h"
-#include "MotorController.h"
 
 SerialApiServer::SerialApiServer(HardwareSerial &serial, MotorController *motorController) :
     m_motorController(motorController),
@@ -22,10 +21,27 @@ void SerialApiServer::init()
 
 void SerialApiServer::process()
 {
+    // Drain the RX ring completely on every pass, so real-time commands never wait behind frame
+    // bytes and the ring can not overflow. Frames starting while both halves are busy get dropped
+    // and answered with busy, see processReceivedByte().
     while (m_hardwareSerial->available()) {
         uint8_t receivedByte = m_hardwareSerial->read();
+        if (receivedByte >= RealtimeCommandStatus && receivedByte <= RealtimeCommandEmergencyStop) {
+            processRealtimeCommand(static_cast<RealtimeCommand>(receivedByte));
+            continue;
+        }
+
         processReceivedByte(receivedByte);
     }
+
+    // Process at most one frame per loop, so the motors get served in between
+    if (m_rxFrameLength[m_rxProcessBuffer] > 0) {
+        processData(m_rxBuffers[m_rxProcessBuffer], m_rxFrameLength[m_rxProcessBuffer]);
+        m_rxFrameLength[m_rxProcessBuffer] = 0;
+        m_rxProcessBuffer ^= 1;
+    }
+
+    processStatusStream();
 }
 
 void SerialApiServer::sendData(const char *data, size_t len)
@@ -36,75 +52,153 @@ void SerialApiServer::sendData(const char *data, size_t len)
         streamByte(data[i]);
     }
     streamByte(SlipProtocolEnd, true);
-    m_hardwareSerial->flush();
 }
 
 void SerialApiServer::debug(const char *message)
 {
-    size_t payloadLength = strlen(message);
-    uint8_t payload[payloadLength];
-    for (uint8_t i = 0; i < payloadLength; i++) {
-        payload[i] = static_cast<uint8_t>(message[i]);
-    }
-    sendNotification(NotificationDebugMessage, payload, payloadLength);
+    sendNotification(NotificationDebugMessage, reinterpret_cast<const uint8_t *>(message), strlen(message));
 }
 
-uint16_t SerialApiServer::calculateCrc(uint8_t data[], size_t length)
+int SerialApiServer::txBufferAvailable() const
 {
-    // CRC-16/CCITT-FALSE
-    uint16_t polynom = 0x1021;
-    uint16_t crc = 0xffff;
+    return m_hardwareSerial->availableForWrite();
+}
 
-    for (size_t i = 0; i < length; i++) {
-        crc ^= static_cast<uint16_t>(data[i] << 8);
-        for (uint8_t j = 0; j < 8; j++) {
-            if (crc & 0x8000) {
-                crc = (crc << 1) ^ polynom;
-            } else {
-                crc <<= 1;
-            }
+uint16_t SerialApiServer::droppedNotifications() const
+{
+    return m_droppedNotifications;
+}
+
+uint16_t SerialApiServer::updateCrc(uint16_t crc, uint8_t dataByte)
+{
+    // CRC-16/CCITT-FALSE, one byte at a time so it can be computed while streaming
+    crc ^= static_cast<uint16_t>(dataByte << 8);
+    for (uint8_t j = 0; j < 8; j++) {
+        if (crc & 0x8000) {
+            crc = (crc << 1) ^ 0x1021;
+        } else {
+            crc <<= 1;
         }
     }
 
     return crc;
 }
 
+void SerialApiServer::resetReceiveBuffer()
+{
+    m_rxIndex = 0;
+    m_rxOverflow = false;
+    m_rxBusy = false;
+    m_protocolEscaping = false;
+}
+
+void SerialApiServer::processRealtimeCommand(RealtimeCommand command)
+{
+    // Never part of a frame, so a frame in progress just continues afterwards
+    switch (command) {
+    case RealtimeCommandStatus: {
+        StatusSnapshot status;
+        m_motorController->snapshot(&status);
+        sendStatusNotification(status, true);
+        break;
+    }
+    case RealtimeCommandFeedHold:
+        m_motorController->feedHold();
+        break;
+    case RealtimeCommandResume:
+        m_motorController->resume();
+        break;
+    case RealtimeCommandEmergencyStop:
+        m_motorController->emergencyStop();
+        break;
+    }
+}
+
 void SerialApiServer::processReceivedByte(uint8_t receivedByte)
 {
+    uint8_t *buffer = m_rxBuffers[m_rxReceiveBuffer];
+
+    if (receivedByte == SlipProtocolEnd) {
+        // We are done with this frame, drop it if it did not fit
+        if (m_rxBusy) {
+            // No half was free for it, the host has to send it again
+            if (!m_rxOverflow && m_rxIndex >= 4) {
+                sendResponse(m_rxBusyHeader[0], m_rxBusyHeader[1], StatusBusy);
+            }
+        } else if (!m_rxOverflow && m_rxIndex > 0) {
+            processFrame(buffer, m_rxIndex);
+        }
+        resetReceiveBuffer();
+        return;
+    }
+
     if (m_protocolEscaping) {
+        m_protocolEscaping = false;
         switch (receivedByte) {
             case SlipProtocolTransposedEnd:
-                m_buffer[m_bufferIndex++] = SlipProtocolEnd;
-                m_protocolEscaping = false;
+                receivedByte = SlipProtocolEnd;
                 break;
             case SlipProtocolTransposedEsc:
-                m_buffer[m_bufferIndex++] = SlipProtocolEsc;
-                m_protocolEscaping = false;
+                receivedByte = SlipProtocolEsc;
+                break;
+            case RealtimeCommandStatus ^ SlipProtocolTransposedRealtimeMask:
+            case RealtimeCommandFeedHold ^ SlipProtocolTransposedRealtimeMask:
+            case RealtimeCommandResume ^ SlipProtocolTransposedRealtimeMask:
+            case RealtimeCommandEmergencyStop ^ SlipProtocolTransposedRealtimeMask:
+                receivedByte ^= SlipProtocolTransposedRealtimeMask;
                 break;
             default:
                 // SLIP protocol violation...received escape, but it is not an escaped byte
-                break;
+                m_rxOverflow = true;
+                return;
         }
+    } else if (receivedByte == SlipProtocolEsc) {
+        // The next byte will be escaped, lets wait for it
+        m_protocolEscaping = true;
+        return;
     }
 
-    switch (receivedByte) {
-        case SlipProtocolEnd:
-            // We are done with this package, process it and reset the buffer
-            if (m_bufferIndex > 0) {
-                processData(m_buffer, m_bufferIndex);
-            }
-            m_bufferIndex = 0;
-            m_protocolEscaping = false;
-            break;
-        case SlipProtocolEsc:
-            // The next byte will be escaped, lets wait for it
-            m_protocolEscaping = true;
-            break;
-        default:
-            // Nothing special, just add to buffer
-            m_buffer[m_bufferIndex++] = receivedByte;
-            break;
+    // Both halves still hold a frame when this one starts: only keep command and request id
+    if (m_rxIndex == 0)
+        m_rxBusy = m_rxFrameLength[m_rxReceiveBuffer] != 0;
+
+    if (m_rxBusy) {
+        if (m_rxIndex < 2)
+            m_rxBusyHeader[m_rxIndex] = receivedByte;
+
+        if (m_rxIndex < serialApiServerFrameSize)
+            m_rxIndex++;
+        return;
+    }
+
+    if (m_rxIndex >= serialApiServerFrameSize) {
+        m_rxOverflow = true;
+        return;
     }
+
+    buffer[m_rxIndex++] = receivedByte;
+}
+
+void SerialApiServer::processFrame(uint8_t buffer[], uint8_t length)
+{
+    // Command, request id and the CRC (low byte first)
+    if (length < 4)
+        return;
+
+    uint8_t dataLength = length - 2;
+    uint16_t crc = 0xffff;
+    for (uint8_t i = 0; i < dataLength; i++) {
+        crc = updateCrc(crc, buffer[i]);
+    }
+
+    if (crc != (buffer[dataLength] | (buffer[dataLength + 1] << 8))) {
+        sendResponse(buffer[0], buffer[1], StatusInvalidProtocol);
+        return;
+    }
+
+    // Hand the frame over in place and continue receiving into the other half
+    m_rxFrameLength[m_rxReceiveBuffer] = dataLength;
+    m_rxReceiveBuffer ^= 1;
 }
 
 void SerialApiServer::streamByte(uint8_t dataByte, boolean specialCharacter)
@@ -134,83 +228,404 @@ void SerialApiServer::writeByte(uint8_t dataByte)
     m_hardwareSerial->write(dataByte);
 }
 
+// Flash resident dispatch table indexed by the command byte. Commands get registered
+// here together with their allowed payload length, everything else is rejected.
+struct SerialApiServer::CommandTable
+{
+    CommandEntry entries[serialApiServerCommandTableSize];
+
+    constexpr CommandTable() : entries() {
+        registerCommand(CommandGetFirmwareVersion, &SerialApiServer::handleGetFirmwareVersion, 0, 0);
+        registerCommand(CommandGetStatus, &SerialApiServer::handleGetStatus, 0, 0);
+        registerCommand(CommandSubscribeStatus, &SerialApiServer::handleSubscribeStatus, 2, 2);
+        registerCommand(CommandEnableSteppers, &SerialApiServer::handleEnableSteppers, 1, 1);
+        registerCommand(CommandMoveTo, &SerialApiServer::handleMoveTo, 16, 20);
+        registerCommand(CommandJog, &SerialApiServer::handleJog, 8, 8);
+        registerCommand(CommandMoveSegment, &SerialApiServer::handleMoveSegment, 20, 20);
+        registerCommand(CommandStepTable, &SerialApiServer::handleStepTable, 0, 4 * stepTableEntrySize);
+    }
+
+    constexpr void registerCommand(Command command, CommandHandler handler, uint8_t minPayloadLength, uint8_t maxPayloadLength) {
+        entries[command].handler = handler;
+        entries[command].minPayloadLength = minPayloadLength;
+        entries[command].maxPayloadLength = maxPayloadLength;
+    }
+};
+
+const SerialApiServer::CommandTable SerialApiServer::s_commandTable PROGMEM = SerialApiServer::CommandTable();
+
 void SerialApiServer::processData(uint8_t buffer[], uint8_t length)
 {
     uint8_t command = buffer[0];
     uint8_t requestId = buffer[1];
+    uint8_t payloadLength = length - 2;
 
-    switch (command) {
-        case CommandGetFirmwareVersion: {
-            if (length != 2) {
-                sendResponse(command, requestId, StatusInvalidPlayload);
-                return;
-            }
-            
-            uint8_t payloadSize = 3;
-            uint8_t payload[payloadSize];
-            payload[0] = FIRMWARE_MAJOR;
-            payload[1] = FIRMWARE_MINOR;
-            payload[2] = FIRMWARE_PATCH;
-            sendResponse(command, requestId, StatusSuccess, payload, payloadSize);
-            break;
+    CommandEntry entry;
+    if (command < serialApiServerCommandTableSize) {
+        memcpy_P(&entry, &s_commandTable.entries[command], sizeof(CommandEntry));
+    }
+
+    if (!entry.handler) {
+        sendResponse(command, requestId, StatusInvalidCommand);
+        return;
+    }
+
+    if (payloadLength < entry.minPayloadLength || payloadLength > entry.maxPayloadLength) {
+        sendResponse(command, requestId, StatusInvalidPlayload);
+        return;
+    }
+
+    entry.handler(this, command, requestId, &buffer[2], payloadLength);
+}
+
+void SerialApiServer::handleGetFirmwareVersion(SerialApiServer *server, uint8_t command, uint8_t requestId, const uint8_t payload[], uint8_t payloadLength)
+{
+    (void)payload;
+    (void)payloadLength;
+
+    const uint8_t version[] = { FIRMWARE_MAJOR, FIRMWARE_MINOR, FIRMWARE_PATCH };
+    server->sendResponse(command, requestId, StatusSuccess, version, sizeof(version));
+}
+
+void SerialApiServer::handleGetStatus(SerialApiServer *server, uint8_t command, uint8_t requestId, const uint8_t payload[], uint8_t payloadLength)
+{
+    (void)payload;
+    (void)payloadLength;
+
+    StatusSnapshot status;
+    server->m_motorController->snapshot(&status);
+
+    // Payload: x, y, z as int32, queue depth, flags, timestamp [us] as uint32, little endian
+    uint8_t statusPayload[18];
+    for (uint8_t i = 0; i < 3; i++) {
+        int32_t position = status.positions[i];
+        memcpy(&statusPayload[i * 4], &position, sizeof(position));
+    }
+    statusPayload[12] = status.queueDepth;
+    statusPayload[13] = status.flags;
+    uint32_t timestamp = status.timestamp;
+    memcpy(&statusPayload[14], &timestamp, sizeof(timestamp));
+
+    server->sendResponse(command, requestId, StatusSuccess, statusPayload, sizeof(statusPayload));
+}
+
+void SerialApiServer::handleSubscribeStatus(SerialApiServer *server, uint8_t command, uint8_t requestId, const uint8_t payload[], uint8_t payloadLength)
+{
+    (void)payloadLength;
+
+    // Payload: rate [Hz] as uint16, 0 stops the stream
+    uint16_t rate = payload[0] | (payload[1] << 8);
+    if (rate != 0 && (rate < statusStreamMinRate || rate > statusStreamMaxRate)) {
+        server->sendResponse(command, requestId, StatusInvalidPlayload);
+        return;
+    }
+
+    server->m_statusInterval = rate == 0 ? 0 : 1000000UL / rate;
+    server->m_statusThrottle = 0;
+
+    // Start with a complete status
+    server->m_lastStatusTime = micros() - server->m_statusInterval;
+    server->m_lastStatusRefreshTime = micros() - statusStreamRefreshInterval;
+    server->sendResponse(command, requestId, StatusSuccess);
+}
+
+void SerialApiServer::handleEnableSteppers(SerialApiServer *server, uint8_t command, uint8_t requestId, const uint8_t payload[], uint8_t payloadLength)
+{
+    (void)payloadLength;
+
+    server->m_motorController->setStepperEnabled(payload[0] != 0);
+    server->sendResponse(command, requestId, StatusSuccess);
+}
+
+void SerialApiServer::handleMoveTo(SerialApiServer *server, uint8_t command, uint8_t requestId, const uint8_t payload[], uint8_t payloadLength)
+{
+    // Payload: x, y, z as int32, acceleration and max speed as uint16, optional jerk as uint32, little endian
+    if (payloadLength != 16 && payloadLength != 20) {
+        server->sendResponse(command, requestId, StatusInvalidPlayload);
+        return;
+    }
+
+    int32_t target[3];
+    memcpy(target, payload, sizeof(target));
+    uint16_t acceleration = payload[12] | (payload[13] << 8);
+    uint16_t maxSpeed = payload[14] | (payload[15] << 8);
+    uint32_t jerk = 0;
+    if (payloadLength == 20)
+        memcpy(&jerk, &payload[16], sizeof(jerk));
+
+    if (acceleration == 0 || maxSpeed == 0) {
+        server->sendResponse(command, requestId, StatusInvalidPlayload);
+        return;
+    }
+
+    long absolute[3] = { target[0], target[1], target[2] };
+    if (!server->m_motorController->stepperController()->moveTo(absolute, acceleration, maxSpeed, jerk)) {
+        server->sendResponse(command, requestId, StatusBusy);
+        return;
+    }
+
+    server->sendResponse(command, requestId, StatusSuccess);
+}
+
+void SerialApiServer::handleMoveSegment(SerialApiServer *server, uint8_t command, uint8_t requestId, const uint8_t payload[], uint8_t payloadLength)
+{
+    (void)payloadLength;
+
+    // Payload: x, y, z as int32, acceleration, max speed, entry and exit ramp index as uint16, little endian
+    int32_t target[3];
+    memcpy(target, payload, sizeof(target));
+    uint16_t acceleration = payload[12] | (payload[13] << 8);
+    uint16_t maxSpeed = payload[14] | (payload[15] << 8);
+    uint16_t entryIndex = payload[16] | (payload[17] << 8);
+    uint16_t exitIndex = payload[18] | (payload[19] << 8);
+
+    if (acceleration == 0 || maxSpeed == 0) {
+        server->sendResponse(command, requestId, StatusInvalidPlayload);
+        return;
+    }
+
+    long absolute[3] = { target[0], target[1], target[2] };
+    if (!server->m_motorController->stepperController()->moveSegment(absolute, acceleration, maxSpeed, entryIndex, exitIndex)) {
+        server->sendResponse(command, requestId, StatusBusy);
+        return;
+    }
+
+    server->sendResponse(command, requestId, StatusSuccess);
+}
+
+void SerialApiServer::handleStepTable(SerialApiServer *server, uint8_t command, uint8_t requestId, const uint8_t payload[], uint8_t payloadLength)
+{
+    // Payload: up to 4 step table entries, no entries starts playing what is buffered
+    StepperController *stepperController = server->m_motorController->stepperController();
+    uint8_t entryCount = payloadLength / stepTableEntrySize;
+    if (payloadLength % stepTableEntrySize != 0) {
+        server->sendResponse(command, requestId, StatusInvalidPlayload);
+        return;
+    }
+
+    if (entryCount == 0) {
+        stepperController->startStepTable();
+        server->sendResponse(command, requestId, StatusSuccess);
+        return;
+    }
+
+    // All or nothing, the host resends the whole request if we are busy
+    StepTableEntry entries[4];
+    for (uint8_t i = 0; i < entryCount; i++) {
+        if (!StepTablePlayer::decodeEntry(&payload[i * stepTableEntrySize], &entries[i])) {
+            server->sendResponse(command, requestId, StatusInvalidPlayload);
+            return;
         }
-        case CommandEnableSteppers: {
-            if (length != 3) {
-                sendResponse(command, requestId, StatusInvalidPlayload);
-                return;
-            }
-            boolean enabled = buffer[2] != 0;
-            m_motorController->setStepperEnabled(enabled);
-            sendResponse(command, requestId, StatusSuccess);
-            break;
+    }
+
+    if (stepperController->stepTableSpace() < entryCount) {
+        server->sendResponse(command, requestId, StatusBusy);
+        return;
+    }
+
+    for (uint8_t i = 0; i < entryCount; i++) {
+        if (!stepperController->queueStepTableEntry(entries[i])) {
+            server->sendResponse(command, requestId, StatusBusy);
+            return;
         }
-        default:
-            sendResponse(command, requestId, StatusInvalidCommand);
-            break;
     }
+
+    server->sendResponse(command, requestId, StatusSuccess);
 }
 
-void SerialApiServer::sendPacket(uint8_t packet[], uint8_t length)
+void SerialApiServer::handleJog(SerialApiServer *server, uint8_t command, uint8_t requestId, const uint8_t payload[], uint8_t payloadLength)
+{
+    (void)payloadLength;
+
+    // Payload: x, y, z velocity [steps/s] as int16, acceleration as uint16, little endian.
+    // Setpoints get streamed, so only failures get a response.
+    int16_t velocities[3];
+    memcpy(velocities, payload, sizeof(velocities));
+    uint16_t acceleration = payload[6] | (payload[7] << 8);
+
+    if (acceleration == 0) {
+        server->sendResponse(command, requestId, StatusInvalidPlayload);
+        return;
+    }
+
+    if (!server->m_motorController->stepperController()->jog(velocities, acceleration)) {
+        server->sendResponse(command, requestId, StatusBusy);
+    }
+}
+
+void SerialApiServer::beginFrame()
 {
     streamByte(SlipProtocolEnd, true);
+    m_txCrc = 0xffff;
+}
+
+void SerialApiServer::writeFrameByte(uint8_t dataByte)
+{
+    m_txCrc = updateCrc(m_txCrc, dataByte);
+    streamByte(dataByte);
+}
 
-    // Stream data
+void SerialApiServer::writeFrameData(const uint8_t data[], size_t length)
+{
     for (size_t i = 0; i < length; i++) {
-        streamByte(packet[i]);
+        writeFrameByte(data[i]);
     }
+}
 
-    // Send crc
-    uint16_t crc = calculateCrc(packet, length);
+void SerialApiServer::endFrame()
+{
+    // Send crc, low byte first
+    uint16_t crc = m_txCrc;
     streamByte(static_cast<uint8_t>(crc & 0xff));
     streamByte(static_cast<uint8_t>((crc >> 8) & 0xff));
 
     streamByte(SlipProtocolEnd, true);
 
-    m_hardwareSerial->flush();
+    // No flush() here, the TX ring gets drained by the UART data register empty interrupt
 }
 
-void SerialApiServer::sendResponse(uint8_t command, uint8_t requestId, Status status, uint8_t payload[], size_t payloadLenght)
+void SerialApiServer::sendResponse(uint8_t command, uint8_t requestId, Status status, const uint8_t payload[], size_t payloadLenght)
 {
-    size_t packetSize = 3 + payloadLenght;
-    uint8_t packet[packetSize];
-    packet[0] = command;
-    packet[1] = requestId;
-    packet[2] = status;
-    for (size_t i = 0; i < payloadLenght; i++) {
-        packet[i + 3] = payload[i];
-    }
+    beginFrame();
+    writeFrameByte(command);
+    writeFrameByte(requestId);
+    writeFrameByte(status);
+    writeFrameData(payload, payloadLenght);
+    endFrame();
+}
+
+void SerialApiServer::sendNotification(SerialApiServer::Notification notification, const uint8_t payload[], size_t payloadLenght)
+{
+    if (!beginNotification(notification, payloadLenght))
+        return;
 
-    sendPacket(packet, packetSize);
+    writeFrameData(payload, payloadLenght);
+    endFrame();
 }
 
-void SerialApiServer::sendNotification(SerialApiServer::Notification notification, uint8_t payload[], size_t payloadLenght)
+boolean SerialApiServer::beginNotification(SerialApiServer::Notification notification, size_t payloadLenght)
 {
     size_t packetSize = 2 + payloadLenght;
-    uint8_t packet[packetSize];
-    packet[0] = notification;
-    packet[1] = m_notificationId++;
-    for (size_t i = 0; i < payloadLenght; i++) {
-        packet[2 + i] = payload[i];
-    }
-    sendPacket(packet, packetSize);
-}
\ No newline at end of file
+
+    // Notifications must never block the loop. Drop them if the worst case (every byte
+    // escaped) does not fit into the TX ring right now. Responses always get sent.
+    int encodedSize = 2 + 2 * (packetSize + 2);
+    if (txBufferAvailable() < encodedSize) {
+        m_droppedNotifications++;
+        return false;
+    }
+
+    beginFrame();
+    writeFrameByte(notification);
+    writeFrameByte(m_notificationId++);
+    return true;
+}
+
+void SerialApiServer::processStatusStream()
+{
+    if (m_statusInterval == 0)
+        return;
+
+    unsigned long now = micros();
+    if (now - m_lastStatusTime < (m_statusInterval << m_statusThrottle))
+        return;
+
+    m_lastStatusTime = now;
+
+    // Back off while the TX ring is more than half full, speed up again once it drained
+    int txAvailable = txBufferAvailable();
+    if (txAvailable < SERIAL_TX_BUFFER_SIZE / 2) {
+        if (m_statusThrottle < 3)
+            m_statusThrottle++;
+
+        return;
+    } else if (txAvailable > SERIAL_TX_BUFFER_SIZE * 3 / 4 && m_statusThrottle > 0) {
+        m_statusThrottle--;
+    }
+
+    StatusSnapshot status;
+    m_motorController->snapshot(&status);
+
+    // Keyframe once in a while, so the host can resync after a lost notification
+    sendStatusNotification(status, now - m_lastStatusRefreshTime >= statusStreamRefreshInterval);
+}
+
+void SerialApiServer::sendStatusNotification(const StatusSnapshot &status, boolean keyframe)
+{
+    uint8_t fields = 0;
+    if (keyframe) {
+        fields = StatusFieldKeyframe | StatusFieldPositionX | StatusFieldPositionY | StatusFieldPositionZ | StatusFieldQueueDepth | StatusFieldFlags;
+    } else {
+        for (uint8_t i = 0; i < 3; i++) {
+            if (status.positions[i] != m_lastStatus.positions[i]) {
+                fields |= StatusFieldPositionX << i;
+            }
+        }
+        if (status.queueDepth != m_lastStatus.queueDepth)
+            fields |= StatusFieldQueueDepth;
+        if (status.flags != m_lastStatus.flags)
+            fields |= StatusFieldFlags;
+    }
+
+    if (fields == 0)
+        return;
+
+    // Keyframe payload: field mask, timestamp [us] as uint32 and x, y, z as int32, little endian.
+    // Delta payload: field mask, timestamp and changed positions as zig-zag varint deltas
+    // against the previous notification. Queue depth and flags always follow as plain bytes.
+    uint8_t payload[statusStreamMaxPayloadSize];
+    uint8_t payloadLength = 0;
+    payload[payloadLength++] = fields;
+    if (keyframe) {
+        uint32_t timestamp = status.timestamp;
+        memcpy(&payload[payloadLength], &timestamp, sizeof(timestamp));
+        payloadLength += sizeof(timestamp);
+        for (uint8_t i = 0; i < 3; i++) {
+            int32_t position = status.positions[i];
+            memcpy(&payload[payloadLength], &position, sizeof(position));
+            payloadLength += sizeof(position);
+        }
+    } else {
+        payloadLength += writeVarint(&payload[payloadLength], status.timestamp - m_lastStatus.timestamp);
+        for (uint8_t i = 0; i < 3; i++) {
+            if (fields & (StatusFieldPositionX << i)) {
+                int32_t delta = static_cast<int32_t>(static_cast<uint32_t>(status.positions[i]) - static_cast<uint32_t>(m_lastStatus.positions[i]));
+                payloadLength += writeVarint(&payload[payloadLength], zigZagEncode(delta));
+            }
+        }
+    }
+    if (fields & StatusFieldQueueDepth)
+        payload[payloadLength++] = status.queueDepth;
+    if (fields & StatusFieldFlags)
+        payload[payloadLength++] = status.flags;
+
+    // Dropped notifications do not move the delta base, the next one covers both
+    if (!beginNotification(NotificationStatus, payloadLength))
+        return;
+
+    writeFrameData(payload, payloadLength);
+    endFrame();
+
+    if (keyframe)
+        m_lastStatusRefreshTime = status.timestamp;
+
+    m_lastStatus = status;
+}
+
+uint32_t SerialApiServer::zigZagEncode(int32_t value)
+{
+    // Small deltas in either direction become small unsigned values
+    return (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31);
+}
+
+uint8_t SerialApiServer::writeVarint(uint8_t buffer[], uint32_t value)
+{
+    // 7 bits per byte, least significant group first, the MSB marks a following byte
+    uint8_t length = 0;
+    while (value >= 0x80) {
+        buffer[length++] = static_cast<uint8_t>(value) | 0x80;
+        value >>= 7;
+    }
+    buffer[length++] = static_cast<uint8_t>(value);
+    return length;
+}
@@ -3,7 +3,26 @@
 
 #include <Arduino.h>
 
-class MotorController;
+#include "MotorController.h"
+
+// Size of the interrupt driven TX ring of the core, set in platformio.ini for AVR
+#ifndef SERIAL_TX_BUFFER_SIZE
+#define SERIAL_TX_BUFFER_SIZE 64
+#endif
+
+// Largest unescaped frame: command, request id, payload and CRC
+const uint8_t serialApiServerFrameSize = 32;
+
+// Status stream rate limits [Hz] and the interval of complete status notifications [us]
+const uint16_t statusStreamMinRate = 10;
+const uint16_t statusStreamMaxRate = 1000;
+const unsigned long statusStreamRefreshInterval = 1000000;
+
+// Field mask, timestamp and three positions as varints (5 bytes worst case), queue depth and flags
+const uint8_t statusStreamMaxPayloadSize = 1 + 5 + 3 * 5 + 2;
+
+// Number of entries in the command dispatch table, covers the command bytes 0x00 - 0x2f
+const uint8_t serialApiServerCommandTableSize = 0x30;
 
 class SerialApiServer
 {
@@ -11,19 +30,35 @@ public:
     enum Command {
         CommandGetFirmwareVersion = 0x00,
         CommandGetStatus = 0x01,
-        CommandEnableSteppers = 0x10
+        CommandSubscribeStatus = 0x02,
+        CommandEnableSteppers = 0x10,
+        CommandMoveTo = 0x20,
+        CommandJog = 0x21,
+        CommandMoveSegment = 0x22,
+        CommandStepTable = 0x23
     };
 
     enum Notification {
         NotificationReady = 0xf0,
+        NotificationStatus = 0xf1,
         NotificationDebugMessage = 0xff
     };
 
+    // Single bytes outside of any frame, handled as soon as they arrive. Inside a frame these
+    // values get escaped like SLIP end and escape: SlipProtocolEsc followed by the byte ^ 0x10.
+    enum RealtimeCommand {
+        RealtimeCommandStatus = 0xF8,
+        RealtimeCommandFeedHold = 0xF9,
+        RealtimeCommandResume = 0xFA,
+        RealtimeCommandEmergencyStop = 0xFB
+    };
+
     enum Status {
         StatusSuccess = 0x00,
         StatusInvalidProtocol = 0x01,
         StatusInvalidCommand = 0x02,
         StatusInvalidPlayload = 0x03,
+        StatusBusy = 0x04,
         StatusUnknownError = 0xff
     };
 
@@ -37,37 +72,107 @@ public:
     void sendData(const char *data, size_t len);
     void debug(const char *message);
 
+    // Free space in the interrupt driven TX ring
+    int txBufferAvailable() const;
+    uint16_t droppedNotifications() const;
+
 private:
     enum SlipProtocol {
         SlipProtocolEnd = 0xC0,
         SlipProtocolEsc = 0xDB,
         SlipProtocolTransposedEnd = 0xDC,
-        SlipProtocolTransposedEsc = 0xDD
+        SlipProtocolTransposedEsc = 0xDD,
+        SlipProtocolTransposedRealtimeMask = 0x10
+    };
+
+    typedef void (*CommandHandler)(SerialApiServer *server, uint8_t command, uint8_t requestId, const uint8_t payload[], uint8_t payloadLength);
+
+    struct CommandEntry {
+        CommandHandler handler = nullptr;
+        uint8_t minPayloadLength = 0;
+        uint8_t maxPayloadLength = 0;
     };
 
+    struct CommandTable;
+    static const CommandTable s_commandTable;
+
+    static void handleGetFirmwareVersion(SerialApiServer *server, uint8_t command, uint8_t requestId, const uint8_t payload[], uint8_t payloadLength);
+    static void handleGetStatus(SerialApiServer *server, uint8_t command, uint8_t requestId, const uint8_t payload[], uint8_t payloadLength);
+    static void handleSubscribeStatus(SerialApiServer *server, uint8_t command, uint8_t requestId, const uint8_t payload[], uint8_t payloadLength);
+    static void handleEnableSteppers(SerialApiServer *server, uint8_t command, uint8_t requestId, const uint8_t payload[], uint8_t payloadLength);
+    static void handleMoveTo(SerialApiServer *server, uint8_t command, uint8_t requestId, const uint8_t payload[], uint8_t payloadLength);
+    static void handleMoveSegment(SerialApiServer *server, uint8_t command, uint8_t requestId, const uint8_t payload[], uint8_t payloadLength);
+    static void handleStepTable(SerialApiServer *server, uint8_t command, uint8_t requestId, const uint8_t payload[], uint8_t payloadLength);
+    static void handleJog(SerialApiServer *server, uint8_t command, uint8_t requestId, const uint8_t payload[], uint8_t payloadLength);
+
     MotorController *m_motorController = nullptr;
 
-    // UART read
+    // UART read, double buffered: one half receives while the other one holds a complete frame
     HardwareSerial *m_hardwareSerial = nullptr;
-    
-    uint8_t m_buffer[255];
-    uint8_t m_bufferIndex = 0;
+
+    uint8_t m_rxBuffers[2][serialApiServerFrameSize];
+    uint8_t m_rxFrameLength[2] = { 0, 0 }; // 0: half is free
+    uint8_t m_rxReceiveBuffer = 0;
+    uint8_t m_rxProcessBuffer = 0;
+    uint8_t m_rxIndex = 0;
+    boolean m_rxOverflow = false;
+
+    // Frame started while both halves were busy, it gets answered with StatusBusy
+    boolean m_rxBusy = false;
+    uint8_t m_rxBusyHeader[2] = { 0, 0 };
     boolean m_protocolEscaping = false;
+
+    // UART write, frames get encoded straight into the TX ring
+    uint16_t m_txCrc = 0;
     uint8_t m_notificationId = 0;
+    uint16_t m_droppedNotifications = 0;
+
+    // Status stream, fields which did not change since the last notification are skipped
+    enum StatusField {
+        StatusFieldPositionX = 0x01,
+        StatusFieldPositionY = 0x02,
+        StatusFieldPositionZ = 0x04,
+        StatusFieldQueueDepth = 0x08,
+        StatusFieldFlags = 0x10,
+        StatusFieldKeyframe = 0x80
+    };
+
+    unsigned long m_statusInterval = 0; // us, 0: not subscribed
+    unsigned long m_lastStatusTime = 0;
+    unsigned long m_lastStatusRefreshTime = 0;
+    uint8_t m_statusThrottle = 0; // Interval gets doubled per level while the TX ring is filling up
+    StatusSnapshot m_lastStatus = StatusSnapshot();
+
+    void processStatusStream();
+    void sendStatusNotification(const StatusSnapshot &status, boolean keyframe);
 
-    uint16_t calculateCrc(uint8_t data[], size_t length);
+    static uint32_t zigZagEncode(int32_t value);
+    static uint8_t writeVarint(uint8_t buffer[], uint32_t value);
+
+    static uint16_t updateCrc(uint16_t crc, uint8_t dataByte);
+
+    void resetReceiveBuffer();
 
 protected:
+    virtual void processRealtimeCommand(RealtimeCommand command);
     virtual void processReceivedByte(uint8_t receivedByte);
+    virtual void processFrame(uint8_t buffer[], uint8_t length);
     
     virtual void streamByte(uint8_t dataByte, boolean specialCharacter = false);
 
     virtual void writeByte(uint8_t dataByte);
     virtual void processData(uint8_t buffer[], uint8_t length);
-    
-    virtual void sendPacket(uint8_t packet[], uint8_t length);
-    virtual void sendResponse(uint8_t command, uint8_t requestId, Status status, uint8_t payload[] = nullptr, size_t payloadLenght = 0);
-    virtual void sendNotification(SerialApiServer::Notification notification, uint8_t payload[] = nullptr, size_t payloadLenght = 0);
+
+    void beginFrame();
+    void writeFrameByte(uint8_t dataByte);
+    void writeFrameData(const uint8_t data[], size_t length);
+    void endFrame();
+
+    virtual void sendResponse(uint8_t command, uint8_t requestId, Status status, const uint8_t payload[] = nullptr, size_t payloadLenght = 0);
+    virtual void sendNotification(SerialApiServer::Notification notification, const uint8_t payload[] = nullptr, size_t payloadLenght = 0);
+
+    // Starts a notification frame, returns false if it had to be dropped to avoid blocking
+    boolean beginNotification(SerialApiServer::Notification notification, size_t payloadLenght);
 
 };
 
@@ -0,0 +1,124 @@
+#include "StepTablePlayer.h"
+
+bool StepTablePlayer::decodeEntry(const uint8_t data[], StepTableEntry *entry)
+{
+    entry->interval = data[0] | (data[1] << 8);
+    entry->remainder = data[2];
+    entry->events = data[3];
+    for (uint8_t i = 0; i < STEPTABLEPLAYER_AXES; i++) {
+        entry->steps[i] = static_cast<int8_t>(data[4 + i]);
+    }
+
+    if (entry->events == 0)
+        return entry->interval > 0 && entry->remainder == 0 && !entry->steps[0] && !entry->steps[1] && !entry->steps[2];
+
+    // Keeps the 8 bit counters from overflowing
+    if (entry->events > stepTableMaxEvents || entry->remainder >= entry->events)
+        return false;
+
+    // The dominant axis defines the events, no axis can step more often
+    for (uint8_t i = 0; i < STEPTABLEPLAYER_AXES; i++) {
+        int16_t steps = entry->steps[i];
+        if (steps > entry->events || -steps > entry->events) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool StepTablePlayer::push(const StepTableEntry &entry)
+{
+    if (isFull())
+        return false;
+
+    m_buffer[m_head] = entry;
+    m_head = (m_head + 1) % stepTablePlayerBufferSize;
+    m_count++;
+    return true;
+}
+
+void StepTablePlayer::clear()
+{
+    m_head = 0;
+    m_tail = 0;
+    m_count = 0;
+    m_entryActive = false;
+}
+
+uint8_t StepTablePlayer::count() const
+{
+    return m_count;
+}
+
+bool StepTablePlayer::isFull() const
+{
+    return m_count >= stepTablePlayerBufferSize;
+}
+
+bool StepTablePlayer::isActive() const
+{
+    return m_entryActive || m_count > 0;
+}
+
+bool StepTablePlayer::nextEvent(uint32_t *interval, uint8_t *stepBits, uint8_t *directionBits)
+{
+    if (!m_entryActive && !loadEntry())
+        return false;
+
+    *stepBits = 0;
+    *directionBits = m_directionBits;
+
+    if (m_entry.events == 0) {
+        // Dwell
+        *interval = m_entry.interval;
+        m_entryActive = false;
+        return true;
+    }
+
+    // Spread the remainder over the events, like the steps of the axes
+    *interval = m_entry.interval;
+    m_timeCounter += m_entry.remainder;
+    if (m_timeCounter >= m_entry.events) {
+        m_timeCounter -= m_entry.events;
+        (*interval)++;
+    }
+
+    for (uint8_t i = 0; i < STEPTABLEPLAYER_AXES; i++) {
+        int8_t steps = m_entry.steps[i];
+        m_counters[i] += steps < 0 ? -steps : steps;
+        if (m_counters[i] >= m_entry.events) {
+            m_counters[i] -= m_entry.events;
+            *stepBits |= 1 << i;
+        }
+    }
+
+    if (--m_eventsRemaining == 0)
+        m_entryActive = false;
+
+    return true;
+}
+
+bool StepTablePlayer::loadEntry()
+{
+    if (m_count == 0)
+        return false;
+
+    m_entry = m_buffer[m_tail];
+    m_tail = (m_tail + 1) % stepTablePlayerBufferSize;
+    m_count--;
+
+    m_entryActive = true;
+    m_eventsRemaining = m_entry.events;
+    m_timeCounter = 0;
+    m_directionBits = 0;
+    for (uint8_t i = 0; i < STEPTABLEPLAYER_AXES; i++) {
+        // Start in the middle, so the steps end up centered within the events
+        m_counters[i] = m_entry.events >> 1;
+        if (m_entry.steps[i] > 0) {
+            m_directionBits |= 1 << i;
+        }
+    }
+
+    return true;
+}
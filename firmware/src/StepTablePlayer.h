@@ -0,0 +1,66 @@
+#ifndef STEPTABLEPLAYER_H
+#define STEPTABLEPLAYER_H
+
+#include <stdint.h>
+
+#define STEPTABLEPLAYER_AXES 3
+
+// Entries buffered for playback, 7 bytes each
+const uint8_t stepTablePlayerBufferSize = 16;
+
+// Most step events within one entry, the dominant axis steps on every event
+const uint8_t stepTableMaxEvents = 127;
+
+// Size of one entry on the wire: interval (uint16), remainder, events (uint8), x, y, z steps (int8)
+const uint8_t stepTableEntrySize = 7;
+
+// One interval of a step table compiled on the host. The interval lasts events * interval + remainder us,
+// the step events get spread over it with the remainder added one us at a time. Every axis moves its steps
+// evenly distributed over the events. Without events the entry is a dwell of interval us.
+struct StepTableEntry
+{
+    uint16_t interval; // us between step events
+    uint8_t remainder; // us spread over the events, < events
+    uint8_t events; // Steps of the dominant axis
+    int8_t steps[STEPTABLEPLAYER_AXES]; // Signed
+};
+
+// Plays step tables without any math on the chip, only additions and comparisons per step event.
+//
+// Does not depend on Arduino, so the host side motion simulator can run the exact same code.
+class StepTablePlayer
+{
+public:
+    // Decodes one entry from the wire format, returns false if it is invalid
+    static bool decodeEntry(const uint8_t data[], StepTableEntry *entry);
+
+    bool push(const StepTableEntry &entry);
+    void clear();
+
+    uint8_t count() const;
+    bool isFull() const;
+    bool isActive() const;
+
+    // Advances to the next step event. Returns false once the table ran empty, otherwise the event
+    // happens interval us after the previous one and moves the axes in stepBits in directionBits.
+    bool nextEvent(uint32_t *interval, uint8_t *stepBits, uint8_t *directionBits);
+
+private:
+    StepTableEntry m_buffer[stepTablePlayerBufferSize];
+    uint8_t m_head = 0;
+    uint8_t m_tail = 0;
+    uint8_t m_count = 0;
+
+    // Current entry
+    bool m_entryActive = false;
+    StepTableEntry m_entry;
+    uint8_t m_eventsRemaining = 0;
+    uint8_t m_timeCounter = 0;
+    uint8_t m_counters[STEPTABLEPLAYER_AXES];
+    uint8_t m_directionBits = 0;
+
+    bool loadEntry();
+
+};
+
+#endif // STEPTABLEPLAYER_H
@@ -0,0 +1,473 @@
+#include "StepperController.h"
+
+StepperController::StepperController()
+{
+
+}
+
+StepperController::~StepperController()
+{
+
+}
+
+boolean StepperController::addStepper(RobotStepper &stepper)
+{
+    if (m_stepperCount >= STEPPERCONTROLLER_MAX_STEPPERS)
+        return false;
+
+    m_plannedPosition[m_stepperCount] = stepper.currentPosition();
+    m_steppers[m_stepperCount++] = &stepper;
+    return true;
+}
+
+boolean StepperController::moveTo(const long absolute[], uint16_t acceleration, uint16_t maxSpeed, uint32_t jerk)
+{
+    return queueSegment(absolute, acceleration, maxSpeed, jerk, 0, 0);
+}
+
+boolean StepperController::moveSegment(const long absolute[], uint16_t acceleration, uint16_t maxSpeed, uint16_t entryIndex, uint16_t exitIndex)
+{
+    return queueSegment(absolute, acceleration, maxSpeed, 0, entryIndex, exitIndex);
+}
+
+boolean StepperController::queueSegment(const long absolute[], uint16_t acceleration, uint16_t maxSpeed, uint32_t jerk, uint16_t entryIndex, uint16_t exitIndex)
+{
+    if (queueFull() || m_jogging || m_stepTablePlayer.isActive() || acceleration == 0 || maxSpeed == 0)
+        return false;
+
+    MotionSegment *segment = &m_queue[m_queueHead];
+    segment->stepEventCount = 0;
+    for (uint8_t i = 0; i < m_stepperCount; i++) {
+        segment->steps[i] = absolute[i] - m_plannedPosition[i];
+        unsigned long steps = labs(segment->steps[i]);
+        if (steps > segment->stepEventCount) {
+            segment->stepEventCount = steps;
+        }
+    }
+
+    // Nothing to move
+    if (segment->stepEventCount == 0)
+        return true;
+
+    segment->acceleration = acceleration;
+    segment->maxSpeed = maxSpeed;
+    segment->jerk = jerk;
+    segment->entryIndex = entryIndex;
+    segment->exitIndex = exitIndex;
+
+    for (uint8_t i = 0; i < m_stepperCount; i++) {
+        m_plannedPosition[i] = absolute[i];
+    }
+
+    m_queueHead = (m_queueHead + 1) % stepperControllerQueueSize;
+    m_queueCount++;
+    return true;
+}
+
+uint8_t StepperController::queueDepth() const
+{
+    return m_queueCount;
+}
+
+boolean StepperController::queueFull() const
+{
+    return m_queueCount >= stepperControllerQueueSize;
+}
+
+boolean StepperController::isRunning() const
+{
+    return m_segment != nullptr || m_queueCount > 0 || m_jogging || m_stepTablePlayer.isActive();
+}
+
+void StepperController::feedHold()
+{
+    if (m_feedHold)
+        return;
+
+    m_feedHold = true;
+    if (!m_segment || m_segment->jerk == 0)
+        return;
+
+    // The S-curve can not be cut short, continue the segment with a linear ramp down from the current speed
+    continueRampFrom(1000000.0 / m_stepInterval);
+}
+
+void StepperController::resume()
+{
+    if (!m_feedHold)
+        return;
+
+    m_feedHold = false;
+    m_entryScale = 0;
+    if (!m_segment)
+        return;
+
+    // Still slowing down: the ramp turns around and accelerates again from the current speed
+    if (m_rampIndex > 1)
+        return;
+
+    // Accelerate again from standstill with what is left of the segment
+    m_rampIndex = 0;
+    m_stepInterval = 0;
+    if (!m_rampTableActive) {
+        m_interval = RampTable::initialInterval(m_segment->acceleration);
+    }
+}
+
+boolean StepperController::feedHoldActive() const
+{
+    return m_feedHold;
+}
+
+void StepperController::stop()
+{
+    m_jogging = false;
+    m_stepTablePlaying = false;
+    m_stepTablePlayer.clear();
+    m_segment = nullptr;
+    m_stepEventsRemaining = 0;
+    m_queueHead = 0;
+    m_queueTail = 0;
+    m_queueCount = 0;
+    m_feedHold = false;
+    m_entryScale = 0;
+    m_carriedSpeed = 0;
+
+    // New moves are relative to where the steppers stopped
+    for (uint8_t i = 0; i < m_stepperCount; i++) {
+        m_plannedPosition[i] = m_steppers[i]->currentPosition();
+    }
+}
+
+boolean StepperController::jog(const int16_t velocities[], uint16_t acceleration)
+{
+    if (m_segment || m_queueCount > 0 || m_feedHold || m_stepTablePlayer.isActive() || acceleration == 0)
+        return false;
+
+    unsigned long now = micros();
+    if (!m_jogging) {
+        m_jogging = true;
+        m_lastTickTime = now;
+        for (uint8_t i = 0; i < m_stepperCount; i++) {
+            m_jogSpeed[i] = 0;
+            m_jogInterval[i] = 0;
+            m_jogLastStepTime[i] = now;
+        }
+    }
+
+    for (uint8_t i = 0; i < m_stepperCount; i++) {
+        m_jogTarget[i] = velocities[i];
+    }
+    m_jogAcceleration = acceleration;
+    m_lastJogTime = now;
+    return true;
+}
+
+boolean StepperController::isJogging() const
+{
+    return m_jogging;
+}
+
+boolean StepperController::queueStepTableEntry(const StepTableEntry &entry)
+{
+    if (m_segment || m_queueCount > 0 || m_jogging)
+        return false;
+
+    if (!m_stepTablePlayer.push(entry))
+        return false;
+
+    // Start with a full buffer, so the host has time to keep up
+    if (m_stepTablePlayer.isFull())
+        startStepTable();
+
+    return true;
+}
+
+uint8_t StepperController::stepTableSpace() const
+{
+    return stepTablePlayerBufferSize - m_stepTablePlayer.count();
+}
+
+void StepperController::startStepTable()
+{
+    if (m_stepTablePlaying || m_stepTablePlayer.count() == 0)
+        return;
+
+    m_stepTablePlaying = true;
+    m_stepTableStepBits = 0;
+    m_stepInterval = 0;
+    m_lastStepTime = micros();
+}
+
+boolean StepperController::isPlayingStepTable() const
+{
+    return m_stepTablePlaying;
+}
+
+boolean StepperController::run()
+{
+    if (m_jogging) {
+        runJog();
+        return true;
+    }
+
+    if (m_stepTablePlaying) {
+        runStepTable();
+        return true;
+    }
+
+    if (!m_segment) {
+        // A feed hold only continues into the next segment to finish slowing down
+        if (m_queueCount == 0 || (m_feedHold && m_carriedSpeed == 0))
+            return false;
+
+        startSegment();
+    }
+
+    // Held once the ramp is down to standstill
+    if (m_feedHold && m_rampIndex <= 1)
+        return true;
+
+    if (m_segment->jerk != 0 && micros() - m_lastTickTime >= 1000000UL / sCurveTicksPerSecond) {
+        m_lastTickTime += 1000000UL / sCurveTicksPerSecond;
+        m_stepInterval = m_sCurveProfile.update(m_stepEventsRemaining);
+    }
+
+    if (micros() - m_lastStepTime >= m_stepInterval) {
+        m_lastStepTime = micros();
+        stepEvent();
+    }
+
+    return true;
+}
+
+void StepperController::startSegment()
+{
+    m_segment = &m_queue[m_queueTail];
+    m_stepEventsRemaining = m_segment->stepEventCount;
+
+    for (uint8_t i = 0; i < m_stepperCount; i++) {
+        m_counters[i] = m_segment->stepEventCount >> 1;
+    }
+
+    // The previous segment ended during a feed hold before it got down to standstill
+    if (m_carriedSpeed > 0) {
+        continueRampFrom(m_carriedSpeed);
+        m_stepInterval = m_interval;
+        m_carriedSpeed = 0;
+        return;
+    }
+
+    if (m_segment->jerk != 0) {
+        // The first step happens once the profile picked up some speed
+        m_sCurveProfile.plan(m_segment->stepEventCount, m_segment->maxSpeed, m_segment->acceleration, m_segment->jerk);
+        m_lastTickTime = micros();
+        m_lastStepTime = m_lastTickTime;
+        m_stepInterval = m_sCurveProfile.update(m_stepEventsRemaining);
+        return;
+    }
+
+    // Prefer the precomputed ramp, fall back to computing it while stepping
+    m_rampTableActive = RampTable::find(m_segment->acceleration, m_segment->maxSpeed, &m_rampProfile);
+    if (!m_rampTableActive) {
+        m_interval = RampTable::initialInterval(m_segment->acceleration);
+        m_minInterval = 1000000.0 / m_segment->maxSpeed;
+    }
+
+    // Continue with the speed the previous segment left with, otherwise the first step happens right away
+    m_rampIndex = static_cast<unsigned long>(m_segment->entryIndex * m_entryScale);
+    if (m_rampIndex == 0) {
+        m_stepInterval = 0;
+        return;
+    }
+
+    if (m_rampTableActive) {
+        if (m_rampIndex > m_rampProfile.length)
+            m_rampIndex = m_rampProfile.length;
+
+        m_stepInterval = RampTable::interval(m_rampProfile, m_rampIndex - 1);
+    } else {
+        m_interval = 1000000.0 / sqrt(2.0 * m_segment->acceleration * m_rampIndex);
+        if (m_interval < m_minInterval)
+            m_interval = m_minInterval;
+
+        m_stepInterval = m_interval;
+    }
+}
+
+void StepperController::finishSegment()
+{
+    // Fraction of the planned exit speed (squared) we really reached, 0 once we had to stop. A feed hold which
+    // is not down to standstill yet carries the speed into the next segment and keeps ramping down there.
+    m_entryScale = 0;
+    m_carriedSpeed = 0;
+    if (m_feedHold) {
+        if (m_rampIndex > 1 && m_queueCount > 1) {
+            m_carriedSpeed = 1000000.0 / m_stepInterval;
+        }
+    } else if (m_segment->jerk == 0 && m_segment->exitIndex > 0 && m_queueCount > 1) {
+        m_entryScale = static_cast<float>(min(m_rampIndex, static_cast<unsigned long>(m_segment->exitIndex))) / m_segment->exitIndex;
+    }
+
+    m_segment = nullptr;
+    m_queueTail = (m_queueTail + 1) % stepperControllerQueueSize;
+    m_queueCount--;
+}
+
+void StepperController::stepEvent()
+{
+    for (uint8_t i = 0; i < m_stepperCount; i++) {
+        m_counters[i] += labs(m_segment->steps[i]);
+        if (m_counters[i] >= static_cast<long>(m_segment->stepEventCount)) {
+            m_counters[i] -= m_segment->stepEventCount;
+            m_steppers[i]->singleStep(m_segment->steps[i] > 0);
+        }
+    }
+
+    if (--m_stepEventsRemaining == 0) {
+        finishSegment();
+        return;
+    }
+
+    computeNextInterval();
+}
+
+void StepperController::computeNextInterval()
+{
+    // Jerk limited ramps get updated by time, see run()
+    if (m_segment->jerk != 0)
+        return;
+
+    // Decelerate once the remaining steps are just enough to reach the exit speed, or right away on a feed hold
+    unsigned long targetIndex = m_feedHold ? 0 : exitIndex();
+    if (m_feedHold || m_stepEventsRemaining + targetIndex <= m_rampIndex) {
+        if (m_rampIndex > 1 && m_rampIndex > targetIndex) {
+            m_rampIndex--;
+            if (!m_rampTableActive) {
+                m_interval = m_interval + ((2.0 * m_interval) / ((4.0 * m_rampIndex) - 1)); // Equation 13 reversed
+            }
+        }
+    } else if (m_rampTableActive) {
+        if (m_rampIndex < m_rampProfile.length) {
+            m_rampIndex++;
+        }
+    } else if (m_rampIndex == 0) {
+        m_rampIndex++;
+    } else if (m_interval > m_minInterval) {
+        m_interval = RampTable::nextInterval(m_interval, m_rampIndex++);
+        if (m_interval < m_minInterval) {
+            m_interval = m_minInterval;
+        }
+    }
+
+    if (m_rampTableActive) {
+        m_stepInterval = RampTable::interval(m_rampProfile, m_rampIndex - 1);
+    } else {
+        m_stepInterval = m_interval;
+    }
+}
+
+void StepperController::runJog()
+{
+    unsigned long now = micros();
+
+    // Watchdog: no setpoint from the host for too long, ramp down like on a feed hold
+    if (m_feedHold || now - m_lastJogTime > jogWatchdogTimeout) {
+        for (uint8_t i = 0; i < m_stepperCount; i++) {
+            m_jogTarget[i] = 0;
+        }
+    }
+
+    if (now - m_lastTickTime >= 1000000UL / jogTicksPerSecond) {
+        m_lastTickTime += 1000000UL / jogTicksPerSecond;
+
+        // Blend every axis towards its target velocity within the acceleration limit
+        float speedChange = static_cast<float>(m_jogAcceleration) / jogTicksPerSecond;
+        boolean moving = false;
+        for (uint8_t i = 0; i < m_stepperCount; i++) {
+            float difference = m_jogTarget[i] - m_jogSpeed[i];
+            if (difference > speedChange) {
+                m_jogSpeed[i] += speedChange;
+            } else if (difference < -speedChange) {
+                m_jogSpeed[i] -= speedChange;
+            } else {
+                m_jogSpeed[i] = m_jogTarget[i];
+            }
+
+            float speed = fabs(m_jogSpeed[i]);
+            m_jogInterval[i] = speed > 0 ? static_cast<unsigned long>(1000000.0 / speed) : 0;
+            if (m_jogInterval[i] != 0 || m_jogTarget[i] != 0) {
+                moving = true;
+            }
+        }
+
+        if (!moving) {
+            finishJog();
+            return;
+        }
+    }
+
+    for (uint8_t i = 0; i < m_stepperCount; i++) {
+        if (m_jogInterval[i] != 0 && now - m_jogLastStepTime[i] >= m_jogInterval[i]) {
+            m_jogLastStepTime[i] = now;
+            m_steppers[i]->singleStep(m_jogSpeed[i] > 0);
+        }
+    }
+}
+
+void StepperController::finishJog()
+{
+    m_jogging = false;
+    finishMotion();
+}
+
+void StepperController::runStepTable()
+{
+    if (micros() - m_lastStepTime < m_stepInterval)
+        return;
+
+    // Advance by the interval instead of taking the current time, so the table timing does not drift
+    m_lastStepTime += m_stepInterval;
+    for (uint8_t i = 0; i < m_stepperCount; i++) {
+        if (m_stepTableStepBits & (1 << i)) {
+            m_steppers[i]->singleStep(m_stepTableDirectionBits & (1 << i));
+        }
+    }
+
+    uint32_t interval = 0;
+    if (!m_stepTablePlayer.nextEvent(&interval, &m_stepTableStepBits, &m_stepTableDirectionBits)) {
+        m_stepTablePlaying = false;
+        finishMotion();
+        return;
+    }
+
+    m_stepInterval = interval;
+}
+
+void StepperController::finishMotion()
+{
+    // Queued moves continue from where jogging or the table stopped
+    for (uint8_t i = 0; i < m_stepperCount; i++) {
+        m_plannedPosition[i] = m_steppers[i]->currentPosition();
+    }
+}
+
+void StepperController::continueRampFrom(float speed)
+{
+    // Computed ramp of the segment starting at the given speed. Ramp index n = v^2 / (2 * a) are the steps
+    // required to stop.
+    m_segment->jerk = 0;
+    m_rampTableActive = false;
+    m_interval = 1000000.0 / speed;
+    m_minInterval = 1000000.0 / m_segment->maxSpeed;
+    m_rampIndex = static_cast<unsigned long>(speed * speed / (2.0 * m_segment->acceleration)) + 1;
+}
+
+unsigned long StepperController::exitIndex() const
+{
+    // Leaving with speed is only safe if there is a segment to continue with
+    if (m_queueCount > 1)
+        return m_segment->exitIndex;
+
+    return 0;
+}
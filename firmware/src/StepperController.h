@@ -0,0 +1,149 @@
+#ifndef STEPPERCONTROLLER_H
+#define STEPPERCONTROLLER_H
+
+#include <Arduino.h>
+
+#include "RobotStepper.h"
+#include "RampTable.h"
+#include "SCurveProfile.h"
+#include "StepTablePlayer.h"
+
+#define STEPPERCONTROLLER_MAX_STEPPERS 3
+
+const uint8_t stepperControllerQueueSize = 8;
+
+// Jog mode: velocities get blended every tick, without a new setpoint within the timeout [us] the axes ramp down
+const uint16_t jogTicksPerSecond = 1000;
+const unsigned long jogWatchdogTimeout = 200000;
+
+struct MotionSegment
+{
+    long steps[STEPPERCONTROLLER_MAX_STEPPERS]; // Relative, signed
+    unsigned long stepEventCount; // Steps of the dominant axis
+    uint16_t acceleration; // Dominant axis, steps/s^2
+    uint16_t maxSpeed; // Dominant axis, steps/s
+    uint32_t jerk; // Dominant axis, steps/s^3, 0 for a trapezoidal ramp
+    uint16_t entryIndex; // Ramp index (v^2 / 2a) when entering the segment, 0 starts from standstill
+    uint16_t exitIndex; // Ramp index when leaving the segment, only used if the next segment is queued in time
+};
+
+// Successor of the bundled MultiStepper: coordinated moves where all steppers ramp
+// together and arrive at the same time. The dominant axis (the one with the most steps)
+// runs a trapezoidal or jerk limited ramp, the other axes follow it using integer line interpolation.
+class StepperController
+{
+public:
+    StepperController();
+    ~StepperController();
+
+    boolean addStepper(RobotStepper &stepper);
+
+    // Queue a move to the given absolute positions, one per added stepper. A jerk > 0 selects
+    // the S-curve profile. Returns false if the queue is full.
+    boolean moveTo(const long absolute[], uint16_t acceleration, uint16_t maxSpeed, uint32_t jerk = 0);
+
+    // Queue a planned segment which gets entered and left with the given ramp indices (n = v^2 / 2a of
+    // the dominant axis), so consecutive segments blend without stopping. Returns false if the queue is full.
+    boolean moveSegment(const long absolute[], uint16_t acceleration, uint16_t maxSpeed, uint16_t entryIndex, uint16_t exitIndex);
+
+    uint8_t queueDepth() const;
+    boolean queueFull() const;
+    boolean isRunning() const;
+
+    // Decelerate the current segment to a stop and keep the remaining steps and the queue
+    void feedHold();
+    // Continue after a feed hold, the interrupted segment ramps up again from the speed it got down to
+    void resume();
+    boolean feedHoldActive() const;
+
+    // Stop stepping right away without a ramp and drop all queued segments
+    void stop();
+
+    // Velocity mode: every axis moves with its own target velocity [steps/s], approached with the
+    // given acceleration [steps/s^2]. Call again before the watchdog timeout to keep moving.
+    // Returns false while queued motion or a feed hold is active.
+    boolean jog(const int16_t velocities[], uint16_t acceleration);
+    boolean isJogging() const;
+
+    // Step table playback: entries compiled on the host get buffered and played back once the
+    // buffer is full or startStepTable() got called. The table ends when the buffer runs empty.
+    // Returns false while other motion is active or the buffer is full. A feed hold does not
+    // apply to a table, it has to be played to the end or stopped.
+    boolean queueStepTableEntry(const StepTableEntry &entry);
+    uint8_t stepTableSpace() const;
+    void startStepTable();
+    boolean isPlayingStepTable() const;
+
+    // Call as often as possible, executes at most one step event per call
+    boolean run();
+
+private:
+    RobotStepper *m_steppers[STEPPERCONTROLLER_MAX_STEPPERS];
+    uint8_t m_stepperCount = 0;
+
+    // Position at the end of the last queued segment
+    long m_plannedPosition[STEPPERCONTROLLER_MAX_STEPPERS];
+
+    MotionSegment m_queue[stepperControllerQueueSize];
+    uint8_t m_queueHead = 0;
+    uint8_t m_queueTail = 0;
+    uint8_t m_queueCount = 0;
+
+    // Current segment
+    MotionSegment *m_segment = nullptr;
+    long m_counters[STEPPERCONTROLLER_MAX_STEPPERS];
+    unsigned long m_stepEventsRemaining = 0;
+
+    // Ramp of the dominant axis, the ramp index equals the steps required to stop
+    RampProfile m_rampProfile;
+    boolean m_rampTableActive = false;
+    unsigned long m_rampIndex = 0;
+    float m_interval = 0; // Computed ramp only
+    float m_minInterval = 0; // Computed ramp only
+
+    // Speed carried into the next segment as fraction of its entry ramp index, less than 1
+    // if the previous segment had to slow down because the next one was not queued in time
+    float m_entryScale = 0;
+
+    // Speed [steps/s] of a feed hold still ramping down when its segment ended, continues in the next segment
+    float m_carriedSpeed = 0;
+
+    // Jerk limited ramp of the dominant axis, the step interval gets updated every tick
+    SCurveProfile m_sCurveProfile;
+    unsigned long m_lastTickTime = 0;
+
+    unsigned long m_stepInterval = 0;
+    unsigned long m_lastStepTime = 0;
+
+    boolean m_feedHold = false;
+
+    // Jog mode
+    boolean m_jogging = false;
+    float m_jogSpeed[STEPPERCONTROLLER_MAX_STEPPERS]; // steps/s, signed
+    int16_t m_jogTarget[STEPPERCONTROLLER_MAX_STEPPERS];
+    unsigned long m_jogInterval[STEPPERCONTROLLER_MAX_STEPPERS]; // us, 0: standing still
+    unsigned long m_jogLastStepTime[STEPPERCONTROLLER_MAX_STEPPERS];
+    uint16_t m_jogAcceleration = 0;
+    unsigned long m_lastJogTime = 0;
+
+    // Step table playback, the step bits get applied once the interval of the event passed
+    StepTablePlayer m_stepTablePlayer;
+    boolean m_stepTablePlaying = false;
+    uint8_t m_stepTableStepBits = 0;
+    uint8_t m_stepTableDirectionBits = 0;
+
+    boolean queueSegment(const long absolute[], uint16_t acceleration, uint16_t maxSpeed, uint32_t jerk, uint16_t entryIndex, uint16_t exitIndex);
+    void startSegment();
+    void finishSegment();
+    void stepEvent();
+    void computeNextInterval();
+    void continueRampFrom(float speed);
+    unsigned long exitIndex() const;
+    void runJog();
+    void runStepTable();
+    void finishMotion();
+    void finishJog();
+
+};
+
+#endif // STEPPERCONTROLLER_H
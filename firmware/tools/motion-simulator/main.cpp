@@ -0,0 +1,197 @@
+// Host side motion simulator for the firmware speed profiles.
+//
+// Runs the firmware SCurveProfile with the same tick and step scheduling as the
+// StepperController and prints the resulting profile as CSV, one line per tick.
+//
+// In table mode it plays a step table (see robot-control/tools/step-table-compiler) through the
+// firmware StepTablePlayer with the timing of StepperController::runStepTable(). Every entry has
+// to end at the planned time, within half a step of the position of the planner trapezoids.
+//
+// Build:  g++ -std=c++17 -O2 -I../../src main.cpp ../../src/SCurveProfile.cpp ../../src/StepTablePlayer.cpp -o motion-simulator
+// Usage:  ./motion-simulator <steps> <max speed> <acceleration> <jerk> > profile.csv
+//         gnuplot -persist plot-profile.gp
+//         ./motion-simulator table <table.bin> <samples.csv> > steps.csv
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <vector>
+
+#include "SCurveProfile.h"
+#include "StepTablePlayer.h"
+
+struct TableSample
+{
+    unsigned long long time;
+    double position[STEPTABLEPLAYER_AXES];
+};
+
+// The compiler rounds the planned position to the closest step, plus the 3 decimals of the CSV
+static const double positionTolerance = 0.5005;
+
+static int runTable(const char *tableFileName, const char *samplesFileName)
+{
+    FILE *tableFile = fopen(tableFileName, "rb");
+    if (!tableFile) {
+        fprintf(stderr, "Could not open %s\n", tableFileName);
+        return EXIT_FAILURE;
+    }
+
+    std::vector<StepTableEntry> entries;
+    uint8_t data[stepTableEntrySize];
+    while (fread(data, 1, stepTableEntrySize, tableFile) == stepTableEntrySize) {
+        StepTableEntry entry;
+        if (!StepTablePlayer::decodeEntry(data, &entry)) {
+            fprintf(stderr, "Invalid entry %zu\n", entries.size());
+            fclose(tableFile);
+            return EXIT_FAILURE;
+        }
+        entries.push_back(entry);
+    }
+    fclose(tableFile);
+
+    FILE *samplesFile = fopen(samplesFileName, "r");
+    if (!samplesFile) {
+        fprintf(stderr, "Could not open %s\n", samplesFileName);
+        return EXIT_FAILURE;
+    }
+
+    std::vector<TableSample> samples;
+    char line[128];
+    while (fgets(line, sizeof(line), samplesFile)) {
+        TableSample sample;
+        if (sscanf(line, "%llu,%lf,%lf,%lf", &sample.time, &sample.position[0], &sample.position[1], &sample.position[2]) == 4) {
+            samples.push_back(sample);
+        }
+    }
+    fclose(samplesFile);
+
+    if (samples.size() != entries.size() + 1) {
+        fprintf(stderr, "Expected %zu samples for %zu entries, got %zu\n", entries.size() + 1, entries.size(), samples.size());
+        return EXIT_FAILURE;
+    }
+
+    // Feed the player like the firmware does while the host streams the table
+    StepTablePlayer player;
+    size_t nextEntry = 0;
+    while (nextEntry < entries.size() && player.push(entries[nextEntry])) {
+        nextEntry++;
+    }
+
+    long position[STEPTABLEPLAYER_AXES];
+    for (uint8_t i = 0; i < STEPTABLEPLAYER_AXES; i++) {
+        position[i] = lround(samples[0].position[i]);
+    }
+
+    unsigned long long time = samples[0].time;
+    size_t entryIndex = 0;
+    uint32_t eventsRemaining = entries[0].events == 0 ? 1 : entries[0].events;
+    unsigned long mismatches = 0;
+    unsigned long events = 0;
+    double largestDeviation = 0;
+
+    printf("time,x,y,z\n");
+    uint32_t interval = 0;
+    uint8_t stepBits = 0;
+    uint8_t directionBits = 0;
+    while (player.nextEvent(&interval, &stepBits, &directionBits)) {
+        while (nextEntry < entries.size() && player.push(entries[nextEntry])) {
+            nextEntry++;
+        }
+
+        // The steps of an event happen once its interval passed
+        time += interval;
+        for (uint8_t i = 0; i < STEPTABLEPLAYER_AXES; i++) {
+            if (stepBits & (1 << i)) {
+                position[i] += (directionBits & (1 << i)) ? 1 : -1;
+            }
+        }
+        events++;
+
+        if (stepBits)
+            printf("%llu,%ld,%ld,%ld\n", time, position[0], position[1], position[2]);
+
+        if (--eventsRemaining > 0)
+            continue;
+
+        // End of an entry, has to be where the planner is at that time
+        const TableSample &sample = samples[++entryIndex];
+        double deviation = 0;
+        for (uint8_t i = 0; i < STEPTABLEPLAYER_AXES; i++) {
+            deviation = fmax(deviation, fabs(position[i] - sample.position[i]));
+        }
+        largestDeviation = fmax(largestDeviation, deviation);
+
+        if (time != sample.time || deviation > positionTolerance) {
+            if (mismatches++ < 10) {
+                fprintf(stderr, "Entry %zu: %llu us (%ld, %ld, %ld), planned %llu us (%.3f, %.3f, %.3f)\n", entryIndex - 1,
+                        time, position[0], position[1], position[2],
+                        sample.time, sample.position[0], sample.position[1], sample.position[2]);
+            }
+        }
+
+        if (entryIndex < entries.size())
+            eventsRemaining = entries[entryIndex].events == 0 ? 1 : entries[entryIndex].events;
+    }
+
+    fprintf(stderr, "%zu entries, %lu step events, %.6f s, largest deviation %.3f steps, %lu mismatches\n", entryIndex, events,
+            time / 1000000.0, largestDeviation, mismatches);
+    return mismatches == 0 && entryIndex == entries.size() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc == 4 && strcmp(argv[1], "table") == 0)
+        return runTable(argv[2], argv[3]);
+
+    if (argc != 5) {
+        fprintf(stderr, "Usage: %s <steps> <max speed> <acceleration> <jerk>\n", argv[0]);
+        fprintf(stderr, "       %s table <table.bin> <samples.csv>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    uint32_t steps = strtoul(argv[1], nullptr, 10);
+    float maxSpeed = strtof(argv[2], nullptr);
+    float acceleration = strtof(argv[3], nullptr);
+    float jerk = strtof(argv[4], nullptr);
+    if (steps == 0 || maxSpeed <= 0 || acceleration <= 0 || jerk <= 0) {
+        fprintf(stderr, "All values must be greater than 0\n");
+        return EXIT_FAILURE;
+    }
+
+    SCurveProfile profile;
+    profile.plan(steps, maxSpeed, acceleration, jerk);
+    fprintf(stderr, "Jerk ticks: %u, acceleration ticks: %u, deceleration steps: %u\n",
+            profile.jerkTicks(), profile.accelerationTicks(), profile.decelerationSteps());
+
+    const unsigned long tickInterval = 1000000UL / sCurveTicksPerSecond;
+    unsigned long time = 0;
+    unsigned long lastTickTime = 0;
+    unsigned long lastStepTime = 0;
+    unsigned long stepInterval = 0;
+    uint32_t remainingSteps = steps;
+
+    printf("time,speed,acceleration,position,phase\n");
+    stepInterval = profile.update(remainingSteps);
+
+    // Simulate in microseconds, like StepperController::run() being called continuously
+    while (remainingSteps > 0) {
+        time++;
+        if (time - lastTickTime >= tickInterval) {
+            lastTickTime += tickInterval;
+            stepInterval = profile.update(remainingSteps);
+            printf("%.3f,%.2f,%.1f,%u,%d\n", time / 1000000.0, profile.speed() / 65536.0,
+                   profile.acceleration() / 65536.0 * sCurveTicksPerSecond, steps - remainingSteps, profile.phase());
+        }
+
+        if (time - lastStepTime >= stepInterval) {
+            lastStepTime = time;
+            remainingSteps--;
+        }
+    }
+
+    fprintf(stderr, "Duration: %.3f s\n", time / 1000000.0);
+    return EXIT_SUCCESS;
+}
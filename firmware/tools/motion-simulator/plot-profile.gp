@@ -0,0 +1,11 @@
+# Plots the CSV written by the motion-simulator
+set datafile separator ","
+set key autotitle columnhead
+set xlabel "time [s]"
+set ylabel "speed [steps/s]"
+set y2label "acceleration [steps/s^2]"
+set y2tics
+set ytics nomirror
+set grid
+plot "profile.csv" using 1:2 with lines title "speed", \
+     "" using 1:3 axes x1y2 with lines title "acceleration"
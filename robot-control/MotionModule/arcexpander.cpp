@@ -0,0 +1,225 @@
+#include "arcexpander.h"
+
+#include <cmath>
+#include <algorithm>
+
+// Offset format arcs whose start and end radius differ more than this are rejected, like in later GRBL versions
+static const double radiusErrorAbsolute = 0.005;
+static const double radiusErrorRelative = 0.001;
+
+ArcExpander::ArcExpander(double tolerance) :
+    m_tolerance(tolerance)
+{
+
+}
+
+double ArcExpander::tolerance() const
+{
+    return m_tolerance;
+}
+
+void ArcExpander::setTolerance(double tolerance)
+{
+    m_tolerance = tolerance;
+}
+
+bool ArcExpander::expand(const GCodeMove &move)
+{
+    m_pointCount = 0;
+    m_errorString.clear();
+
+    if (m_tolerance <= 0) {
+        m_errorString = QString("The arc tolerance must be positive");
+        return false;
+    }
+
+    int axis0, axis1, linearAxis;
+    planeAxes(move.plane, &axis0, &axis1, &linearAxis);
+
+    bool clockwise = move.type == GCodeMove::TypeArcClockwise;
+    double x = move.target[axis0] - move.start[axis0];
+    double y = move.target[axis1] - move.start[axis1];
+
+    double offset0 = move.offset[axis0];
+    double offset1 = move.offset[axis1];
+    if (move.hasRadius) {
+        // Center on the perpendicular bisector of start and target, see the radius mode of gc_execute_line()
+        double radius = move.radius;
+        double distanceSqr = x * x + y * y;
+        if (distanceSqr == 0) {
+            m_errorString = QString("Arc with radius needs a target different from the start");
+            return false;
+        }
+
+        double h = 4 * radius * radius - distanceSqr;
+        if (h < 0) {
+            // Let rounding in the program through, a half circle needs exactly twice the radius
+            if (-h > 4 * radius * radius * 1e-9) {
+                m_errorString = QString("Arc radius %1 is too small for the distance %2").arg(std::fabs(radius)).arg(std::sqrt(distanceSqr));
+                return false;
+            }
+            h = 0;
+        }
+
+        double hDivD = -std::sqrt(h) / std::sqrt(distanceSqr);
+        if (!clockwise)
+            hDivD = -hDivD;
+
+        // Negative radius: the arc with more than 180 degrees
+        if (radius < 0)
+            hDivD = -hDivD;
+
+        offset0 = 0.5 * (x - y * hDivD);
+        offset1 = 0.5 * (y + x * hDivD);
+    }
+
+    m_radius = std::hypot(offset0, offset1);
+    if (m_radius == 0) {
+        m_errorString = QString("Arc without radius");
+        return false;
+    }
+
+    m_center[axis0] = move.start[axis0] + offset0;
+    m_center[axis1] = move.start[axis1] + offset1;
+    m_center[linearAxis] = move.start[linearAxis];
+
+    double r0 = -offset0;
+    double r1 = -offset1;
+    double rt0 = move.target[axis0] - m_center[axis0];
+    double rt1 = move.target[axis1] - m_center[axis1];
+
+    if (!move.hasRadius) {
+        double radiusError = std::fabs(std::hypot(rt0, rt1) - m_radius);
+        if (radiusError > radiusErrorAbsolute && radiusError > radiusErrorRelative * m_radius) {
+            m_errorString = QString("Arc target is %1 mm off the circle").arg(radiusError);
+            return false;
+        }
+    }
+
+    // Same as mc_arc(): full circle if start and target are the same
+    m_angularTravel = std::atan2(r0 * rt1 - r1 * rt0, r0 * rt0 + r1 * rt1);
+    if (clockwise) {
+        if (m_angularTravel >= 0)
+            m_angularTravel -= 2 * M_PI;
+    } else {
+        if (m_angularTravel <= 0)
+            m_angularTravel += 2 * M_PI;
+    }
+
+    int segments = segmentCount(m_radius, m_angularTravel, m_tolerance);
+    for (int axis = 0; axis < 3; axis++) {
+        m_points[axis].resize(segments);
+    }
+
+    double thetaPerSegment = m_angularTravel / segments;
+    double linearStart = move.start[linearAxis];
+    double linearPerSegment = (move.target[linearAxis] - linearStart) / segments;
+    double startAngle = std::atan2(r1, r0);
+
+    double cosTable[batchSize];
+    double sinTable[batchSize];
+    for (int k = 0; k < batchSize; k++) {
+        cosTable[k] = std::cos(k * thetaPerSegment);
+        sinTable[k] = std::sin(k * thetaPerSegment);
+    }
+
+    double center0 = m_center[axis0];
+    double center1 = m_center[axis1];
+    double *points0 = m_points[axis0].data();
+    double *points1 = m_points[axis1].data();
+    double *linearPoints = m_points[linearAxis].data();
+
+    // Point i is the end of segment i, the last one gets the exact target below
+    for (int base = 0; base < segments - 1; base += batchSize) {
+        double angle = startAngle + (base + 1) * thetaPerSegment;
+        double baseCos = m_radius * std::cos(angle);
+        double baseSin = m_radius * std::sin(angle);
+        int count = std::min(batchSize, segments - 1 - base);
+
+        double *__restrict batch0 = points0 + base;
+        double *__restrict batch1 = points1 + base;
+        double *__restrict batchLinear = linearPoints + base;
+        for (int k = 0; k < count; k++) {
+            batch0[k] = center0 + baseCos * cosTable[k] - baseSin * sinTable[k];
+            batch1[k] = center1 + baseSin * cosTable[k] + baseCos * sinTable[k];
+            batchLinear[k] = linearStart + (base + 1 + k) * linearPerSegment;
+        }
+    }
+
+    for (int axis = 0; axis < 3; axis++) {
+        m_points[axis][segments - 1] = move.target[axis];
+    }
+
+    m_pointCount = segments;
+    return true;
+}
+
+QString ArcExpander::errorString() const
+{
+    return m_errorString;
+}
+
+int ArcExpander::pointCount() const
+{
+    return m_pointCount;
+}
+
+void ArcExpander::point(int index, double position[3]) const
+{
+    for (int axis = 0; axis < 3; axis++) {
+        position[axis] = m_points[axis].at(index);
+    }
+}
+
+const double *ArcExpander::points(int axis) const
+{
+    return m_points[axis].constData();
+}
+
+double ArcExpander::radius() const
+{
+    return m_radius;
+}
+
+const double *ArcExpander::center() const
+{
+    return m_center;
+}
+
+double ArcExpander::angularTravel() const
+{
+    return m_angularTravel;
+}
+
+int ArcExpander::segmentCount(double radius, double angularTravel, double tolerance)
+{
+    // Sagitta r * (1 - cos(theta / 2)) <= tolerance
+    double cosHalfTheta = 1.0 - tolerance / radius;
+    if (cosHalfTheta <= -1.0)
+        return 1;
+
+    double maxTheta = 2.0 * std::acos(cosHalfTheta);
+    return std::max(1, static_cast<int>(std::ceil(std::fabs(angularTravel) / maxTheta)));
+}
+
+void ArcExpander::planeAxes(GCodeState::Plane plane, int *axis0, int *axis1, int *linearAxis)
+{
+    *axis0 = 0;
+    *axis1 = 1;
+    *linearAxis = 2;
+
+    switch (plane) {
+    case GCodeState::PlaneXY:
+        break;
+    case GCodeState::PlaneZX:
+        *axis0 = 2;
+        *axis1 = 0;
+        *linearAxis = 1;
+        break;
+    case GCodeState::PlaneYZ:
+        *axis0 = 1;
+        *axis1 = 2;
+        *linearAxis = 0;
+        break;
+    }
+}
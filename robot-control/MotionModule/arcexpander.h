@@ -0,0 +1,58 @@
+#ifndef ARCEXPANDER_H
+#define ARCEXPANDER_H
+
+#include <QList>
+#include <QString>
+
+#include "gcodemove.h"
+
+// Linearizes G2/G3 arcs for the planner. Unlike mc_arc() of GRBL, which uses a fixed segment length, the number
+// of segments follows from the chord tolerance: the largest distance between a chord and the arc (the sagitta
+// r * (1 - cos(theta / 2))) stays within the tolerance, so large radii get long segments and small ones short.
+//
+// The points are evaluated in batches: every batch starts from an exact sin / cos of its first angle and rotates
+// it with a table of the angles within the batch. The points of a batch do not depend on each other, so the inner
+// loop vectorizes and no rounding error accumulates along the arc. Points are stored per axis.
+class ArcExpander
+{
+public:
+    static constexpr int batchSize = 8;
+
+    explicit ArcExpander(double tolerance = 0.002);
+
+    // Largest deviation from the arc [mm]
+    double tolerance() const;
+    void setTolerance(double tolerance);
+
+    // Linearizes the arc of the move, the last point is the target of the move
+    bool expand(const GCodeMove &move);
+    QString errorString() const;
+
+    int pointCount() const;
+    void point(int index, double position[3]) const;
+    const double *points(int axis) const;
+
+    // Geometry of the last arc, the angular travel is negative for clockwise arcs
+    double radius() const;
+    const double *center() const;
+    double angularTravel() const;
+
+    static int segmentCount(double radius, double angularTravel, double tolerance);
+
+    // Axes of the plane: first and second axis of the arc, the third one moves linear (helix)
+    static void planeAxes(GCodeState::Plane plane, int *axis0, int *axis1, int *linearAxis);
+
+private:
+    double m_tolerance = 0.002;
+    QString m_errorString;
+
+    QList<double> m_points[3];
+    int m_pointCount = 0;
+
+    double m_radius = 0;
+    double m_center[3] = { 0, 0, 0 };
+    double m_angularTravel = 0;
+
+};
+
+#endif // ARCEXPANDER_H
@@ -0,0 +1,343 @@
+#include "armkinematics.h"
+
+#include <QFileInfo>
+#include <QSettings>
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+Q_LOGGING_CATEGORY(dcKinematics, "Kinematics")
+
+static const double pi = 3.14159265358979323846;
+static const double degreesPerRadian = 180.0 / pi;
+
+// Two points at once with the vector extensions of GCC and clang, the width of SSE2 and NEON. Left to the
+// auto-vectorizer the selects below would stay branches: GCC keeps floating point comparisons out of vectorized
+// loops unless built with -fno-trapping-math.
+static const int vectorSize = 2;
+
+typedef double DoubleVector __attribute__((vector_size(vectorSize * sizeof(double))));
+typedef qint64 MaskVector __attribute__((vector_size(vectorSize * sizeof(qint64))));
+typedef quint64 BitsVector __attribute__((vector_size(vectorSize * sizeof(quint64))));
+typedef qint32 StepVector __attribute__((vector_size(vectorSize * sizeof(qint32))));
+
+static inline DoubleVector broadcast(double value)
+{
+    return DoubleVector{ value, value };
+}
+
+static inline DoubleVector select(MaskVector mask, DoubleVector a, DoubleVector b)
+{
+    return (DoubleVector)(((MaskVector)a & mask) | ((MaskVector)b & ~mask));
+}
+
+static inline DoubleVector absolute(DoubleVector value)
+{
+    return (DoubleVector)((BitsVector)value & 0x7fffffffffffffffULL);
+}
+
+// atan() of Cephes for [0, 1]: above 0.66 the argument gets reduced with atan(x) = pi / 4 + atan((x - 1) / (x + 1)),
+// the rational function covers the rest (below 1e-15 rad off)
+static inline DoubleVector atanUnit(DoubleVector a)
+{
+    MaskVector reduce = a > 0.66;
+    DoubleVector t = select(reduce, (a - 1.0) / (a + 1.0), a);
+    DoubleVector z = t * t;
+    DoubleVector p = (((-8.750608600031904122785e-1 * z - 1.615753718733365076637e1) * z - 7.500855792314704667340e1) * z
+                      - 1.228866684490136173410e2) * z - 6.485021904942025371773e1;
+    DoubleVector q = ((((z + 2.485846490142306297962e1) * z + 1.650270098316988542046e2) * z + 4.328810604912902668951e2) * z
+                      + 4.853903996359136964868e2) * z + 1.945506571482613964425e2;
+    DoubleVector result = t + t * z * p / q;
+    return select(reduce, 0.25 * pi + (result + 0.25 * 6.123233995736765886130e-17), result);
+}
+
+static inline DoubleVector atan2Vector(DoubleVector y, DoubleVector x)
+{
+    DoubleVector ax = absolute(x);
+    DoubleVector ay = absolute(y);
+    MaskVector steep = ay > ax;
+    DoubleVector high = select(steep, ay, ax);
+    DoubleVector low = select(steep, ax, ay);
+    DoubleVector result = atanUnit(low / select(high > 0.0, high, broadcast(1.0)));
+    result = select(steep, 0.5 * pi - result, result);
+    result = select(x < 0.0, pi - result, result);
+    return select(y < 0.0, -result, result);
+}
+
+// There is no vector square root in the extensions: the reciprocal square root gets estimated from the bits and
+// refined with four Newton steps, which takes the relative error from 3.5 % to the double precision
+static inline DoubleVector sqrtVector(DoubleVector value)
+{
+    DoubleVector inverse = (DoubleVector)(0x5fe6eb50c7b537a9ULL - ((BitsVector)value >> 1));
+    DoubleVector half = 0.5 * value;
+    for (int i = 0; i < 4; i++)
+        inverse = inverse * (1.5 - half * inverse * inverse);
+
+    return value * inverse;
+}
+
+static inline StepVector roundSteps(DoubleVector steps)
+{
+    return __builtin_convertvector(select(steps >= 0.0, steps + 0.5, steps - 0.5), StepVector);
+}
+
+static inline qint32 roundSteps(double steps)
+{
+    return static_cast<qint32>(steps >= 0 ? steps + 0.5 : steps - 0.5);
+}
+
+// The inverse kinematics for one vector of points, angles in radians. Lanes out of reach or beyond a limit are
+// cleared in the returned mask.
+class InverseSolver
+{
+public:
+    explicit InverseSolver(const ArmConfiguration &arm) :
+        m_arm(arm),
+        m_linkSqr(arm.upperArmLength * arm.upperArmLength + arm.forearmLength * arm.forearmLength),
+        m_inverseLinkProduct(1.0 / (2 * arm.upperArmLength * arm.forearmLength)),
+        m_elbowSign(arm.elbowUp ? -1.0 : 1.0)
+    {
+        for (int i = 0; i < 3; i++) {
+            m_minAngle[i] = arm.minAngle[i] / degreesPerRadian;
+            m_maxAngle[i] = arm.maxAngle[i] / degreesPerRadian;
+        }
+    }
+
+    // Solves the points [base, base + vectorSize), a vector past the end gets filled up with the last point
+    MaskVector solve(const double *x, const double *y, const double *z, int base, int count, DoubleVector angles[3]) const
+    {
+        DoubleVector px, py, pz;
+        for (int k = 0; k < vectorSize; k++) {
+            int index = std::min(base + k, count - 1);
+            px[k] = x[index];
+            py[k] = y[index];
+            pz[k] = z[index];
+        }
+
+        const double l1 = m_arm.upperArmLength;
+        const double l2 = m_arm.forearmLength;
+        DoubleVector r = sqrtVector(px * px + py * py) - m_arm.shoulderOffset;
+        DoubleVector h = pz - m_arm.baseHeight;
+        DoubleVector cosElbow = (r * r + h * h - m_linkSqr) * m_inverseLinkProduct;
+        DoubleVector sinElbowSqr = 1.0 - cosElbow * cosElbow;
+        DoubleVector sinElbow = m_elbowSign * sqrtVector(select(sinElbowSqr > 0.0, sinElbowSqr, broadcast(0.0)));
+
+        angles[0] = atan2Vector(py, px);
+        angles[1] = atan2Vector(h, r) - atan2Vector(l2 * sinElbow, l1 + l2 * cosElbow);
+        angles[2] = atan2Vector(sinElbow, cosElbow);
+
+        MaskVector valid = sinElbowSqr >= 0.0;
+        for (int i = 0; i < 3; i++)
+            valid &= (angles[i] >= m_minAngle[i]) & (angles[i] <= m_maxAngle[i]);
+
+        return valid;
+    }
+
+private:
+    const ArmConfiguration &m_arm;
+    double m_linkSqr;
+    double m_inverseLinkProduct;
+    double m_elbowSign;
+    double m_minAngle[3];
+    double m_maxAngle[3];
+
+};
+
+ArmKinematics::ArmKinematics()
+{
+
+}
+
+ArmKinematics::ArmKinematics(const ArmConfiguration &configuration) :
+    m_configuration(configuration)
+{
+
+}
+
+const ArmConfiguration &ArmKinematics::configuration() const
+{
+    return m_configuration;
+}
+
+void ArmKinematics::setConfiguration(const ArmConfiguration &configuration)
+{
+    m_configuration = configuration;
+}
+
+bool ArmKinematics::loadConfiguration(const QString &fileName)
+{
+    m_errorString.clear();
+    if (!QFileInfo::exists(fileName)) {
+        m_errorString = QString("%1 does not exist").arg(fileName);
+        return false;
+    }
+
+    QSettings settings(fileName, QSettings::IniFormat);
+    if (settings.status() != QSettings::NoError) {
+        m_errorString = QString("Could not read %1").arg(fileName);
+        return false;
+    }
+
+    ArmConfiguration configuration = m_configuration;
+    settings.beginGroup("Arm");
+    configuration.baseHeight = settings.value("baseHeight", configuration.baseHeight).toDouble();
+    configuration.shoulderOffset = settings.value("shoulderOffset", configuration.shoulderOffset).toDouble();
+    configuration.upperArmLength = settings.value("upperArmLength", configuration.upperArmLength).toDouble();
+    configuration.forearmLength = settings.value("forearmLength", configuration.forearmLength).toDouble();
+    configuration.elbowUp = settings.value("elbowUp", configuration.elbowUp).toBool();
+    configuration.lineTolerance = settings.value("lineTolerance", configuration.lineTolerance).toDouble();
+
+    const char *const joints[3] = { "base", "shoulder", "elbow" };
+    for (int i = 0; i < 3; i++) {
+        QString joint(joints[i]);
+        configuration.stepsPerDegree[i] = settings.value(joint + "StepsPerDegree", configuration.stepsPerDegree[i]).toDouble();
+        configuration.zeroAngle[i] = settings.value(joint + "ZeroAngle", configuration.zeroAngle[i]).toDouble();
+        configuration.minAngle[i] = settings.value(joint + "MinAngle", configuration.minAngle[i]).toDouble();
+        configuration.maxAngle[i] = settings.value(joint + "MaxAngle", configuration.maxAngle[i]).toDouble();
+    }
+    settings.endGroup();
+
+    if (configuration.upperArmLength <= 0 || configuration.forearmLength <= 0) {
+        m_errorString = QString("The link lengths in %1 must be positive").arg(fileName);
+        return false;
+    }
+
+    for (int i = 0; i < 3; i++) {
+        QString joint(joints[i]);
+        if (configuration.stepsPerDegree[i] == 0) {
+            m_errorString = QString("The steps per degree of the %1 joint in %2 must not be 0").arg(joint, fileName);
+            return false;
+        }
+    }
+
+    m_configuration = configuration;
+    qCDebug(dcKinematics()) << "Loaded the arm configuration from" << fileName;
+    return true;
+}
+
+QString ArmKinematics::errorString() const
+{
+    return m_errorString;
+}
+
+bool ArmKinematics::inverse(const double position[3], double angles[3]) const
+{
+    const ArmConfiguration &arm = m_configuration;
+    double l1 = arm.upperArmLength;
+    double l2 = arm.forearmLength;
+
+    double r = std::hypot(position[0], position[1]) - arm.shoulderOffset;
+    double h = position[2] - arm.baseHeight;
+    double cosElbow = (r * r + h * h - l1 * l1 - l2 * l2) / (2 * l1 * l2);
+    if (cosElbow < -1 || cosElbow > 1)
+        return false;
+
+    double sinElbow = std::sqrt(1 - cosElbow * cosElbow);
+    if (arm.elbowUp)
+        sinElbow = -sinElbow;
+
+    angles[0] = std::atan2(position[1], position[0]) * degreesPerRadian;
+    angles[1] = (std::atan2(h, r) - std::atan2(l2 * sinElbow, l1 + l2 * cosElbow)) * degreesPerRadian;
+    angles[2] = std::atan2(sinElbow, cosElbow) * degreesPerRadian;
+
+    for (int i = 0; i < 3; i++) {
+        if (angles[i] < arm.minAngle[i] || angles[i] > arm.maxAngle[i])
+            return false;
+    }
+
+    return true;
+}
+
+void ArmKinematics::forward(const double angles[3], double position[3]) const
+{
+    const ArmConfiguration &arm = m_configuration;
+    double base = angles[0] / degreesPerRadian;
+    double shoulder = angles[1] / degreesPerRadian;
+    double forearm = shoulder + angles[2] / degreesPerRadian;
+
+    double r = arm.shoulderOffset + arm.upperArmLength * std::cos(shoulder) + arm.forearmLength * std::cos(forearm);
+    position[0] = r * std::cos(base);
+    position[1] = r * std::sin(base);
+    position[2] = arm.baseHeight + arm.upperArmLength * std::sin(shoulder) + arm.forearmLength * std::sin(forearm);
+}
+
+bool ArmKinematics::toSteps(const double position[3], qint32 steps[3]) const
+{
+    double angles[3];
+    if (!inverse(position, angles))
+        return false;
+
+    anglesToSteps(angles, steps);
+    return true;
+}
+
+void ArmKinematics::anglesToSteps(const double angles[3], qint32 steps[3]) const
+{
+    for (int i = 0; i < 3; i++)
+        steps[i] = roundSteps((angles[i] - m_configuration.zeroAngle[i]) * m_configuration.stepsPerDegree[i]);
+}
+
+void ArmKinematics::fromSteps(const qint32 steps[3], double position[3]) const
+{
+    double angles[3];
+    for (int i = 0; i < 3; i++)
+        angles[i] = steps[i] / m_configuration.stepsPerDegree[i] + m_configuration.zeroAngle[i];
+
+    forward(angles, position);
+}
+
+int ArmKinematics::inverse(const double *x, const double *y, const double *z, int count, double *angles[3]) const
+{
+    const InverseSolver solver(m_configuration);
+    for (int base = 0; base < count; base += vectorSize) {
+        DoubleVector vectorAngles[3];
+        MaskVector valid = solver.solve(x, y, z, base, count, vectorAngles);
+
+        int vectorCount = std::min(vectorSize, count - base);
+        for (int k = 0; k < vectorCount; k++) {
+            if (!valid[k])
+                return base + k;
+
+            for (int i = 0; i < 3; i++)
+                angles[i][base + k] = vectorAngles[i][k] * degreesPerRadian;
+        }
+    }
+
+    return count;
+}
+
+int ArmKinematics::toSteps(const double *x, const double *y, const double *z, int count, qint32 *steps) const
+{
+    const InverseSolver solver(m_configuration);
+
+    // Step factors per joint, applied to the angles in radians
+    double scale[3];
+    double offset[3];
+    for (int i = 0; i < 3; i++) {
+        scale[i] = m_configuration.stepsPerDegree[i] * degreesPerRadian;
+        offset[i] = m_configuration.zeroAngle[i] * m_configuration.stepsPerDegree[i];
+    }
+
+    for (int base = 0; base < count; base += vectorSize) {
+        DoubleVector angles[3];
+        MaskVector valid = solver.solve(x, y, z, base, count, angles);
+
+        StepVector jointSteps[3];
+        for (int i = 0; i < 3; i++)
+            jointSteps[i] = roundSteps(angles[i] * scale[i] - offset[i]);
+
+        int vectorCount = std::min(vectorSize, count - base);
+        for (int k = 0; k < vectorCount; k++) {
+            if (!valid[k])
+                return base + k;
+
+            qint32 *point = steps + 3 * (base + k);
+            point[0] = jointSteps[0][k];
+            point[1] = jointSteps[1][k];
+            point[2] = jointSteps[2][k];
+        }
+    }
+
+    return count;
+}
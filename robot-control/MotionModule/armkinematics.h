@@ -0,0 +1,70 @@
+#ifndef ARMKINEMATICS_H
+#define ARMKINEMATICS_H
+
+#include <QString>
+#include <QLoggingCategory>
+
+Q_DECLARE_LOGGING_CATEGORY(dcKinematics)
+
+// Geometry of the 3-DOF arm: the base turns around the vertical axis, shoulder and elbow turn in the vertical plane
+// through it. Lengths in mm, angles in degrees.
+//
+// Base 0 points along +X, positive turns towards +Y. Shoulder 0 holds the upper arm horizontal, positive raises it.
+// Elbow 0 continues the upper arm straight, positive bends the forearm upwards.
+struct ArmConfiguration
+{
+    double baseHeight = 100; // Shoulder axis above the base plane (Z = 0)
+    double shoulderOffset = 0; // Shoulder axis away from the base axis
+    double upperArmLength = 150;
+    double forearmLength = 150; // Elbow to the tool point
+
+    double stepsPerDegree[3] = { 10, 10, 10 };
+    double zeroAngle[3] = { 0, 0, 0 }; // Joint angle at step 0
+    double minAngle[3] = { -180, -90, -170 };
+    double maxAngle[3] = { 180, 180, 170 };
+
+    // Of the two solutions for a point, the one with the elbow above the line from shoulder to tool point
+    bool elbowUp = true;
+
+    // Largest deviation of the tool point from a straight line while the joints move linear [mm]
+    double lineTolerance = 0.01;
+};
+
+// Analytic inverse and forward kinematics of the arm, converting between Cartesian positions [mm] and joint steps.
+//
+// The batch conversion takes the positions per axis (like the ArcExpander stores them) and solves several points
+// per instruction with vector types, without any branch or library call: atan2 is the rational approximation of
+// Cephes, the square root a refined reciprocal estimate. Out of reach points only clear a lane of the result mask.
+class ArmKinematics
+{
+public:
+    ArmKinematics();
+    explicit ArmKinematics(const ArmConfiguration &configuration);
+
+    const ArmConfiguration &configuration() const;
+    void setConfiguration(const ArmConfiguration &configuration);
+
+    // Reads the [Arm] group of an ini file, missing keys keep their current value
+    bool loadConfiguration(const QString &fileName);
+    QString errorString() const;
+
+    // Joint angles for a position, false if it is out of reach or beyond a joint limit
+    bool inverse(const double position[3], double angles[3]) const;
+    void forward(const double angles[3], double position[3]) const;
+
+    bool toSteps(const double position[3], qint32 steps[3]) const;
+    void fromSteps(const qint32 steps[3], double position[3]) const;
+    void anglesToSteps(const double angles[3], qint32 steps[3]) const;
+
+    // Batch conversions of count positions given per axis. Both return the number of points converted before the
+    // first one out of reach, count if all are fine.
+    int inverse(const double *x, const double *y, const double *z, int count, double *angles[3]) const;
+    int toSteps(const double *x, const double *y, const double *z, int count, qint32 *steps) const;
+
+private:
+    ArmConfiguration m_configuration;
+    QString m_errorString;
+
+};
+
+#endif // ARMKINEMATICS_H
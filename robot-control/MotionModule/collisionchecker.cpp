@@ -0,0 +1,648 @@
+#include "collisionchecker.h"
+
+#include <QFile>
+#include <QThread>
+#include <QtEndian>
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QtConcurrent>
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+Q_LOGGING_CATEGORY(dcCollision, "Collision")
+
+// Smallest number of motions worth a task of their own
+static const int minimumChunkMotions = 256;
+
+static const double pi = 3.14159265358979323846;
+static const double degreesPerRadian = 180.0 / pi;
+
+struct Capsule
+{
+    double a[3];
+    double b[3];
+    double radius = 0;
+    int link = 0;
+};
+
+// The base column, the shoulder offset, the upper arm and the forearm
+static const int capsuleCount = 4;
+static const int columnCapsule = 0;
+static const int forearmCapsule = 3;
+
+struct CollisionChunk
+{
+    int first = 0; // Motions towards the poses [first, last)
+    int last = 0;
+
+    int pose = -1;
+    CollisionContact contact;
+};
+
+static inline double dot(const double a[3], const double b[3])
+{
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+static inline void subtract(const double a[3], const double b[3], double result[3])
+{
+    for (int i = 0; i < 3; i++)
+        result[i] = a[i] - b[i];
+}
+
+static inline void cross(const double a[3], const double b[3], double result[3])
+{
+    result[0] = a[1] * b[2] - a[2] * b[1];
+    result[1] = a[2] * b[0] - a[0] * b[2];
+    result[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+static inline double distanceSqr(const double a[3], const double b[3])
+{
+    double d[3];
+    subtract(a, b, d);
+    return dot(d, d);
+}
+
+// Closest point of the triangle to p, from Ericson: Real-Time Collision Detection, 5.1.5
+static void closestPointOnTriangle(const double p[3], const double a[3], const double b[3], const double c[3], double result[3])
+{
+    double ab[3], ac[3], ap[3];
+    subtract(b, a, ab);
+    subtract(c, a, ac);
+    subtract(p, a, ap);
+    double d1 = dot(ab, ap);
+    double d2 = dot(ac, ap);
+    if (d1 <= 0 && d2 <= 0) {
+        std::copy(a, a + 3, result);
+        return;
+    }
+
+    double bp[3];
+    subtract(p, b, bp);
+    double d3 = dot(ab, bp);
+    double d4 = dot(ac, bp);
+    if (d3 >= 0 && d4 <= d3) {
+        std::copy(b, b + 3, result);
+        return;
+    }
+
+    double vc = d1 * d4 - d3 * d2;
+    if (vc <= 0 && d1 >= 0 && d3 <= 0) {
+        double v = d1 / (d1 - d3);
+        for (int i = 0; i < 3; i++)
+            result[i] = a[i] + v * ab[i];
+        return;
+    }
+
+    double cp[3];
+    subtract(p, c, cp);
+    double d5 = dot(ab, cp);
+    double d6 = dot(ac, cp);
+    if (d6 >= 0 && d5 <= d6) {
+        std::copy(c, c + 3, result);
+        return;
+    }
+
+    double vb = d5 * d2 - d1 * d6;
+    if (vb <= 0 && d2 >= 0 && d6 <= 0) {
+        double w = d2 / (d2 - d6);
+        for (int i = 0; i < 3; i++)
+            result[i] = a[i] + w * ac[i];
+        return;
+    }
+
+    double va = d3 * d6 - d5 * d4;
+    if (va <= 0 && d4 - d3 >= 0 && d5 - d6 >= 0) {
+        double w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+        for (int i = 0; i < 3; i++)
+            result[i] = b[i] + w * (c[i] - b[i]);
+        return;
+    }
+
+    double denominator = 1 / (va + vb + vc);
+    double v = vb * denominator;
+    double w = vc * denominator;
+    for (int i = 0; i < 3; i++)
+        result[i] = a[i] + ab[i] * v + ac[i] * w;
+}
+
+// Squared distance between the segments p1-q1 and p2-q2, from Ericson: Real-Time Collision Detection, 5.1.9
+static double segmentDistanceSqr(const double p1[3], const double q1[3], const double p2[3], const double q2[3])
+{
+    double d1[3], d2[3], r[3];
+    subtract(q1, p1, d1);
+    subtract(q2, p2, d2);
+    subtract(p1, p2, r);
+    double a = dot(d1, d1);
+    double e = dot(d2, d2);
+    double f = dot(d2, r);
+
+    double s = 0;
+    double t = 0;
+    if (a <= 1e-12 && e <= 1e-12)
+        return dot(r, r);
+
+    if (a <= 1e-12) {
+        t = qBound(0.0, f / e, 1.0);
+    } else {
+        double c = dot(d1, r);
+        if (e <= 1e-12) {
+            s = qBound(0.0, -c / a, 1.0);
+        } else {
+            double b = dot(d1, d2);
+            double denominator = a * e - b * b;
+            if (denominator > 0)
+                s = qBound(0.0, (b * f - c * e) / denominator, 1.0);
+
+            t = (b * s + f) / e;
+            if (t < 0) {
+                t = 0;
+                s = qBound(0.0, -c / a, 1.0);
+            } else if (t > 1) {
+                t = 1;
+                s = qBound(0.0, (b - c) / a, 1.0);
+            }
+        }
+    }
+
+    double c1[3], c2[3];
+    for (int i = 0; i < 3; i++) {
+        c1[i] = p1[i] + d1[i] * s;
+        c2[i] = p2[i] + d2[i] * t;
+    }
+    return distanceSqr(c1, c2);
+}
+
+// Möller-Trumbore, limited to the segment
+static bool segmentIntersectsTriangle(const double p[3], const double q[3], const double a[3], const double b[3], const double c[3])
+{
+    double direction[3], edge1[3], edge2[3], h[3];
+    subtract(q, p, direction);
+    subtract(b, a, edge1);
+    subtract(c, a, edge2);
+    cross(direction, edge2, h);
+    double determinant = dot(edge1, h);
+    if (std::fabs(determinant) < 1e-12)
+        return false;
+
+    double inverse = 1 / determinant;
+    double s[3];
+    subtract(p, a, s);
+    double u = inverse * dot(s, h);
+    if (u < 0 || u > 1)
+        return false;
+
+    double qv[3];
+    cross(s, edge1, qv);
+    double v = inverse * dot(direction, qv);
+    if (v < 0 || u + v > 1)
+        return false;
+
+    double t = inverse * dot(edge2, qv);
+    return t >= 0 && t <= 1;
+}
+
+static bool capsuleHitsTriangle(const Capsule &capsule, const CollisionTriangle &triangle)
+{
+    const double *a = triangle.vertices[0];
+    const double *b = triangle.vertices[1];
+    const double *c = triangle.vertices[2];
+    double radiusSqr = capsule.radius * capsule.radius;
+
+    if (segmentIntersectsTriangle(capsule.a, capsule.b, a, b, c))
+        return true;
+
+    double closest[3];
+    closestPointOnTriangle(capsule.a, a, b, c, closest);
+    if (distanceSqr(capsule.a, closest) <= radiusSqr)
+        return true;
+
+    closestPointOnTriangle(capsule.b, a, b, c, closest);
+    if (distanceSqr(capsule.b, closest) <= radiusSqr)
+        return true;
+
+    return segmentDistanceSqr(capsule.a, capsule.b, a, b) <= radiusSqr
+            || segmentDistanceSqr(capsule.a, capsule.b, b, c) <= radiusSqr
+            || segmentDistanceSqr(capsule.a, capsule.b, c, a) <= radiusSqr;
+}
+
+static void poseCapsules(const ArmConfiguration &arm, const double radius[3], const double angles[3], double inflation, Capsule capsules[capsuleCount])
+{
+    double base = angles[0] / degreesPerRadian;
+    double shoulder = angles[1] / degreesPerRadian;
+    double forearm = shoulder + angles[2] / degreesPerRadian;
+    double direction[2] = { std::cos(base), std::sin(base) };
+
+    double top[3] = { 0, 0, arm.baseHeight };
+    double shoulderPoint[3] = { arm.shoulderOffset * direction[0], arm.shoulderOffset * direction[1], arm.baseHeight };
+    double upperArm = arm.upperArmLength * std::cos(shoulder);
+    double elbow[3] = { shoulderPoint[0] + upperArm * direction[0], shoulderPoint[1] + upperArm * direction[1],
+                        arm.baseHeight + arm.upperArmLength * std::sin(shoulder) };
+    double lowerArm = arm.forearmLength * std::cos(forearm);
+    double tool[3] = { elbow[0] + lowerArm * direction[0], elbow[1] + lowerArm * direction[1],
+                       elbow[2] + arm.forearmLength * std::sin(forearm) };
+
+    const double floor[3] = { 0, 0, 0 };
+    const double *ends[capsuleCount + 1] = { floor, top, shoulderPoint, elbow, tool };
+    const int links[capsuleCount] = { CollisionChecker::LinkBase, CollisionChecker::LinkBase, CollisionChecker::LinkUpperArm, CollisionChecker::LinkForearm };
+    for (int k = 0; k < capsuleCount; k++) {
+        std::copy(ends[k], ends[k] + 3, capsules[k].a);
+        std::copy(ends[k + 1], ends[k + 1] + 3, capsules[k].b);
+        capsules[k].link = links[k];
+        capsules[k].radius = radius[links[k]] + inflation;
+    }
+}
+
+CollisionChecker::CollisionChecker(const ArmKinematics *kinematics) :
+    m_kinematics(kinematics)
+{
+
+}
+
+const ArmKinematics *CollisionChecker::kinematics() const
+{
+    return m_kinematics;
+}
+
+void CollisionChecker::setKinematics(const ArmKinematics *kinematics)
+{
+    m_kinematics = kinematics;
+}
+
+double CollisionChecker::linkRadius(int link) const
+{
+    return m_linkRadius[link];
+}
+
+void CollisionChecker::setLinkRadius(int link, double radius)
+{
+    m_linkRadius[link] = radius;
+}
+
+double CollisionChecker::sweepResolution() const
+{
+    return m_sweepResolution;
+}
+
+void CollisionChecker::setSweepResolution(double sweepResolution)
+{
+    m_sweepResolution = sweepResolution;
+}
+
+int CollisionChecker::leafSize() const
+{
+    return m_leafSize;
+}
+
+void CollisionChecker::setLeafSize(int leafSize)
+{
+    m_leafSize = qMax(1, leafSize);
+}
+
+bool CollisionChecker::loadObstacles(const QString &fileName)
+{
+    m_errorString.clear();
+
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        m_errorString = QString("Could not open %1: %2").arg(fileName, file.errorString());
+        return false;
+    }
+
+    QByteArray data = file.readAll();
+    QList<CollisionTriangle> triangles = m_triangles;
+
+    // Binary files have an 80 byte header, the triangle count and 50 bytes per triangle. ASCII files start with
+    // "solid" too, but some binary files also do, so the size decides.
+    quint32 count = data.size() >= 84 ? qFromLittleEndian<quint32>(data.constData() + 80) : 0;
+    if (data.size() >= 84 && static_cast<qint64>(data.size()) == 84 + 50 * static_cast<qint64>(count)) {
+        const char *record = data.constData() + 84;
+        for (quint32 i = 0; i < count; i++, record += 50) {
+            CollisionTriangle triangle;
+            for (int k = 0; k < 3; k++) {
+                for (int axis = 0; axis < 3; axis++)
+                    triangle.vertices[k][axis] = qFromLittleEndian<float>(record + 12 + 12 * k + 4 * axis);
+            }
+            triangles.append(triangle);
+        }
+    } else if (data.startsWith("solid")) {
+        const char *p = data.constData();
+        CollisionTriangle triangle;
+        int vertex = 0;
+        while ((p = std::strstr(p, "vertex"))) {
+            p += 6;
+            char *end;
+            for (int axis = 0; axis < 3; axis++) {
+                triangle.vertices[vertex][axis] = std::strtod(p, &end);
+                if (end == p) {
+                    m_errorString = QString("%1 has an invalid vertex").arg(fileName);
+                    return false;
+                }
+                p = end;
+            }
+
+            if (++vertex == 3) {
+                triangles.append(triangle);
+                vertex = 0;
+            }
+        }
+    } else {
+        m_errorString = QString("%1 is not an STL file").arg(fileName);
+        return false;
+    }
+
+    setObstacles(triangles);
+    return true;
+}
+
+void CollisionChecker::setObstacles(const QList<CollisionTriangle> &triangles)
+{
+    m_triangles = triangles;
+    buildHierarchy();
+}
+
+const QList<CollisionTriangle> &CollisionChecker::obstacles() const
+{
+    return m_triangles;
+}
+
+QString CollisionChecker::errorString() const
+{
+    return m_errorString;
+}
+
+bool CollisionChecker::collides(const double angles[3], CollisionContact *contact) const
+{
+    return checkMotion(angles, angles, contact);
+}
+
+int CollisionChecker::check(const double *const angles[3], int count, CollisionContact *contact) const
+{
+    if (count <= 0)
+        return 0;
+
+    const double first[3] = { angles[0][0], angles[1][0], angles[2][0] };
+    CollisionContact firstContact;
+    if (collides(first, &firstContact)) {
+        firstContact.pose = 0;
+        if (contact)
+            *contact = firstContact;
+        return 0;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    int motionCount = count - 1;
+    int chunkCount = qBound(1, motionCount / minimumChunkMotions, QThread::idealThreadCount() * 4);
+    QList<CollisionChunk> chunks;
+    for (int i = 0; i < chunkCount; i++) {
+        CollisionChunk chunk;
+        chunk.first = 1 + static_cast<int>(static_cast<qint64>(motionCount) * i / chunkCount);
+        chunk.last = 1 + static_cast<int>(static_cast<qint64>(motionCount) * (i + 1) / chunkCount);
+        chunks.append(chunk);
+    }
+
+    // The earliest collision found so far, chunks stop once they get behind it
+    QAtomicInt firstCollision(count);
+    auto checkChunk = [this, angles, &firstCollision](CollisionChunk &chunk) {
+        for (int pose = chunk.first; pose < chunk.last && pose < firstCollision.loadRelaxed(); pose++) {
+            const double from[3] = { angles[0][pose - 1], angles[1][pose - 1], angles[2][pose - 1] };
+            const double to[3] = { angles[0][pose], angles[1][pose], angles[2][pose] };
+            if (checkMotion(from, to, &chunk.contact)) {
+                chunk.pose = pose;
+                chunk.contact.pose = pose;
+
+                int current = firstCollision.loadRelaxed();
+                while (pose < current && !firstCollision.testAndSetOrdered(current, pose))
+                    current = firstCollision.loadRelaxed();
+                return;
+            }
+        }
+    };
+
+    // Short trajectories are not worth a thread
+    if (chunkCount == 1) {
+        checkChunk(chunks[0]);
+    } else {
+        QtConcurrent::blockingMap(chunks, checkChunk);
+    }
+
+    int reached = count;
+    for (const CollisionChunk &chunk : chunks) {
+        if (chunk.pose >= 0) {
+            reached = chunk.pose;
+            if (contact)
+                *contact = chunk.contact;
+            break;
+        }
+    }
+
+    qCDebug(dcCollision()) << "Checked" << motionCount << "motions in" << chunkCount << "chunks against" << m_triangles.count() << "triangles in" << timer.elapsed() << "ms";
+    return reached;
+}
+
+void CollisionChecker::buildHierarchy()
+{
+    m_nodes.clear();
+    if (m_triangles.isEmpty())
+        return;
+
+    int count = static_cast<int>(m_triangles.count());
+    QList<int> order(count);
+    QList<double> centers(3 * count);
+    for (int i = 0; i < count; i++) {
+        order[i] = i;
+        for (int axis = 0; axis < 3; axis++) {
+            const double (&vertices)[3][3] = m_triangles.at(i).vertices;
+            centers[3 * i + axis] = (vertices[0][axis] + vertices[1][axis] + vertices[2][axis]) / 3;
+        }
+    }
+
+    // Nodes get split in place, the children of a node are stored next to each other
+    struct Range
+    {
+        int node;
+        int first;
+        int count;
+    };
+
+    m_nodes.reserve(2 * count / m_leafSize + 1);
+    m_nodes.append(Node());
+    QList<Range> stack;
+    stack.append({ 0, 0, count });
+    while (!stack.isEmpty()) {
+        Range range = stack.last();
+        stack.removeLast();
+
+        Node node;
+        double centerMin[3];
+        double centerMax[3];
+        for (int axis = 0; axis < 3; axis++) {
+            node.min[axis] = std::numeric_limits<double>::infinity();
+            node.max[axis] = -std::numeric_limits<double>::infinity();
+            centerMin[axis] = std::numeric_limits<double>::infinity();
+            centerMax[axis] = -std::numeric_limits<double>::infinity();
+        }
+
+        for (int i = range.first; i < range.first + range.count; i++) {
+            const CollisionTriangle &triangle = m_triangles.at(order.at(i));
+            for (int axis = 0; axis < 3; axis++) {
+                for (int k = 0; k < 3; k++) {
+                    node.min[axis] = std::min(node.min[axis], triangle.vertices[k][axis]);
+                    node.max[axis] = std::max(node.max[axis], triangle.vertices[k][axis]);
+                }
+                centerMin[axis] = std::min(centerMin[axis], centers.at(3 * order.at(i) + axis));
+                centerMax[axis] = std::max(centerMax[axis], centers.at(3 * order.at(i) + axis));
+            }
+        }
+
+        int axis = 0;
+        for (int i = 1; i < 3; i++) {
+            if (centerMax[i] - centerMin[i] > centerMax[axis] - centerMin[axis])
+                axis = i;
+        }
+
+        if (range.count <= m_leafSize || centerMax[axis] == centerMin[axis]) {
+            node.first = range.first;
+            node.count = range.count;
+            m_nodes[range.node] = node;
+            continue;
+        }
+
+        int half = range.count / 2;
+        std::nth_element(order.begin() + range.first, order.begin() + range.first + half, order.begin() + range.first + range.count,
+                         [&centers, axis](int a, int b) {
+            return centers.at(3 * a + axis) < centers.at(3 * b + axis);
+        });
+
+        node.first = static_cast<int>(m_nodes.count());
+        node.count = 0;
+        m_nodes[range.node] = node;
+        m_nodes.append(Node());
+        m_nodes.append(Node());
+        stack.append({ node.first, range.first, half });
+        stack.append({ node.first + 1, range.first + half, range.count - half });
+    }
+
+    // Leaves refer to ranges of the triangles
+    QList<CollisionTriangle> triangles;
+    triangles.reserve(count);
+    for (int i = 0; i < count; i++)
+        triangles.append(m_triangles.at(order.at(i)));
+    m_triangles.swap(triangles);
+
+    qCDebug(dcCollision()) << "Built the hierarchy of" << count << "triangles with" << m_nodes.count() << "nodes";
+}
+
+int CollisionChecker::findTriangle(const double a[3], const double b[3], double radius) const
+{
+    if (m_nodes.isEmpty())
+        return -1;
+
+    double min[3];
+    double max[3];
+    for (int i = 0; i < 3; i++) {
+        min[i] = std::min(a[i], b[i]) - radius;
+        max[i] = std::max(a[i], b[i]) + radius;
+    }
+
+    Capsule capsule;
+    std::copy(a, a + 3, capsule.a);
+    std::copy(b, b + 3, capsule.b);
+    capsule.radius = radius;
+
+    int stack[64];
+    int depth = 0;
+    stack[depth++] = 0;
+    while (depth > 0) {
+        const Node &node = m_nodes.at(stack[--depth]);
+        if (node.min[0] > max[0] || node.max[0] < min[0] || node.min[1] > max[1] || node.max[1] < min[1]
+                || node.min[2] > max[2] || node.max[2] < min[2])
+            continue;
+
+        // The box of a slanted capsule is much larger than the capsule, the sphere around the node is closer
+        double center[3];
+        double halfDiagonalSqr = 0;
+        for (int i = 0; i < 3; i++) {
+            center[i] = 0.5 * (node.min[i] + node.max[i]);
+            halfDiagonalSqr += 0.25 * (node.max[i] - node.min[i]) * (node.max[i] - node.min[i]);
+        }
+        double reach = radius + std::sqrt(halfDiagonalSqr);
+        if (segmentDistanceSqr(a, b, center, center) > reach * reach)
+            continue;
+
+        if (node.count > 0) {
+            for (int i = node.first; i < node.first + node.count; i++) {
+                if (capsuleHitsTriangle(capsule, m_triangles.at(i)))
+                    return i;
+            }
+        } else {
+            stack[depth++] = node.first;
+            stack[depth++] = node.first + 1;
+        }
+    }
+
+    return -1;
+}
+
+bool CollisionChecker::checkMotion(const double from[3], const double to[3], CollisionContact *contact) const
+{
+    if (!m_kinematics) {
+        qCWarning(dcCollision()) << "No kinematics to check the arm with";
+        return true;
+    }
+
+    const ArmConfiguration &arm = m_kinematics->configuration();
+
+    // No point of the arm moves further than the angles times the distance from the joint axes
+    double reach = arm.upperArmLength + arm.forearmLength;
+    double levers[3] = { std::fabs(arm.shoulderOffset) + reach, reach, arm.forearmLength };
+    double travel = 0;
+    for (int i = 0; i < 3; i++)
+        travel += std::fabs(to[i] - from[i]) / degreesPerRadian * levers[i];
+
+    // The poses at both ends and between them
+    int sampleCount = qMax(1, static_cast<int>(std::ceil(travel / m_sweepResolution)));
+    double inflation = travel / (2 * sampleCount);
+    if (travel == 0)
+        sampleCount = 0;
+
+    for (int k = 0; k <= sampleCount; k++) {
+        double t = sampleCount > 0 ? static_cast<double>(k) / sampleCount : 0;
+        double angles[3];
+        for (int i = 0; i < 3; i++)
+            angles[i] = from[i] + t * (to[i] - from[i]);
+
+        Capsule capsules[capsuleCount];
+        poseCapsules(arm, m_linkRadius, angles, inflation, capsules);
+
+        // The forearm may fold back onto the base column
+        const Capsule &column = capsules[columnCapsule];
+        const Capsule &forearm = capsules[forearmCapsule];
+        double radius = column.radius + forearm.radius;
+        if (segmentDistanceSqr(column.a, column.b, forearm.a, forearm.b) <= radius * radius) {
+            if (contact) {
+                contact->link = LinkForearm;
+                contact->triangle = -1;
+            }
+            return true;
+        }
+
+        for (const Capsule &capsule : capsules) {
+            int triangle = findTriangle(capsule.a, capsule.b, capsule.radius);
+            if (triangle >= 0) {
+                if (contact) {
+                    contact->link = capsule.link;
+                    contact->triangle = triangle;
+                }
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
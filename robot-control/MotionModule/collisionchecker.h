@@ -0,0 +1,99 @@
+#ifndef COLLISIONCHECKER_H
+#define COLLISIONCHECKER_H
+
+#include <QList>
+#include <QString>
+#include <QLoggingCategory>
+
+#include "armkinematics.h"
+
+Q_DECLARE_LOGGING_CATEGORY(dcCollision)
+
+struct CollisionTriangle
+{
+    double vertices[3][3];
+};
+
+// Where a trajectory collides first
+struct CollisionContact
+{
+    int pose = -1; // The motion towards this pose collides, 0 if the first pose does
+    int link = -1;
+    int triangle = -1; // Index into obstacles(), -1 for the arm hitting its own base
+};
+
+// Checks motions of the arm against static obstacles (fixtures, vise, table) and against its own base.
+//
+// The links of the arm are capsules: the base column from the floor to the shoulder together with the shoulder offset,
+// the upper arm and the forearm. The obstacle triangles are kept in a bounding volume hierarchy (axis aligned boxes,
+// split at the median of the longest axis), so a capsule only gets tested against the few triangles close to it.
+//
+// A motion between two poses moves the joints linear. It gets sampled so no point of the arm is further than half of
+// the sweep resolution from the closest sample, and the capsules get inflated by that much, so the samples cover the
+// swept volume. Trajectories get split into chunks checked in parallel, chunks behind a collision found already stop.
+class CollisionChecker
+{
+public:
+    enum Link {
+        LinkBase,
+        LinkUpperArm,
+        LinkForearm
+    };
+
+    explicit CollisionChecker(const ArmKinematics *kinematics = nullptr);
+
+    const ArmKinematics *kinematics() const;
+    void setKinematics(const ArmKinematics *kinematics);
+
+    // Radius of the capsule around each link [mm]
+    double linkRadius(int link) const;
+    void setLinkRadius(int link, double radius);
+
+    // Largest gap between the samples of a motion [mm]
+    double sweepResolution() const;
+    void setSweepResolution(double sweepResolution);
+
+    // Triangles per leaf of the hierarchy, takes effect when the obstacles are set
+    int leafSize() const;
+    void setLeafSize(int leafSize);
+
+    // Adds the triangles of an STL file (binary or ASCII, in mm) to the obstacles. The hierarchy reorders the
+    // triangles.
+    bool loadObstacles(const QString &fileName);
+    void setObstacles(const QList<CollisionTriangle> &triangles);
+    const QList<CollisionTriangle> &obstacles() const;
+
+    QString errorString() const;
+
+    // Angles in degrees. Without kinematics every pose counts as colliding.
+    bool collides(const double angles[3], CollisionContact *contact = nullptr) const;
+
+    // Checks the motions between count poses given per joint [deg]. Returns the number of poses reached before the
+    // first collision, count if there is none.
+    int check(const double *const angles[3], int count, CollisionContact *contact = nullptr) const;
+
+private:
+    struct Node
+    {
+        double min[3];
+        double max[3];
+        int first = 0; // Leaves: triangles [first, first + count), inner nodes: children first and first + 1
+        int count = 0;
+    };
+
+    const ArmKinematics *m_kinematics = nullptr;
+    double m_linkRadius[3] = { 40, 25, 20 };
+    double m_sweepResolution = 1;
+    int m_leafSize = 4;
+    QString m_errorString;
+
+    QList<CollisionTriangle> m_triangles;
+    QList<Node> m_nodes;
+
+    void buildHierarchy();
+    int findTriangle(const double a[3], const double b[3], double radius) const;
+    bool checkMotion(const double from[3], const double to[3], CollisionContact *contact) const;
+
+};
+
+#endif // COLLISIONCHECKER_H
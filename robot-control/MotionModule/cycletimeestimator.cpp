@@ -0,0 +1,413 @@
+#include "cycletimeestimator.h"
+#include "gcodeinterpreter.h"
+
+#include <QThread>
+#include <QElapsedTimer>
+#include <QtConcurrent>
+
+#include <algorithm>
+
+Q_LOGGING_CATEGORY(dcCycleTime, "CycleTime")
+
+// Smallest chunk worth a task of its own, in checkpoints. The warm-up of one checkpoint interval stays below 5 %.
+static const int minimumChunkCheckpoints = 20;
+
+struct CycleTimeChunk
+{
+    qint64 warmupLine = 1; // Planning starts here
+    qint64 beginLine = 1; // Blocks of the lines [begin, end) count
+    qint64 endLine = 1;
+
+    // The first section continues the one running at the chunk start, the others start within the chunk
+    QList<CycleTimeSection> sections;
+    QList<CycleTimeBottleneck> bottlenecks;
+    double duration = 0;
+    qint64 blockCount = 0;
+
+    QString errorString;
+};
+
+// Lines holding nothing but a comment start a section named by the comment
+static bool readSectionName(const char *begin, const char *end, QString *name)
+{
+    while (begin < end && (*begin == ' ' || *begin == '\t'))
+        begin++;
+
+    if (begin == end)
+        return false;
+
+    if (*begin == ';') {
+        begin++;
+    } else if (*begin == '(') {
+        const char *close = std::find(begin, end, ')');
+        if (close == end)
+            return false;
+
+        for (const char *p = close + 1; p < end; p++) {
+            if (*p != ' ' && *p != '\t')
+                return false;
+        }
+
+        begin++;
+        end = close;
+    } else {
+        return false;
+    }
+
+    *name = QString::fromUtf8(begin, static_cast<int>(end - begin)).trimmed();
+    return true;
+}
+
+// Keeps the count lines with the most lost time, sorted from the worst
+static void addBottleneck(QList<CycleTimeBottleneck> *bottlenecks, const CycleTimeBottleneck &bottleneck, int count)
+{
+    if (bottleneck.blockCount == 0 || bottleneck.lostTime <= 0 || count <= 0)
+        return;
+
+    if (bottlenecks->count() >= count && bottleneck.lostTime <= bottlenecks->last().lostTime)
+        return;
+
+    auto position = std::upper_bound(bottlenecks->begin(), bottlenecks->end(), bottleneck, [](const CycleTimeBottleneck &a, const CycleTimeBottleneck &b) {
+        return a.lostTime > b.lostTime;
+    });
+    bottlenecks->insert(position, bottleneck);
+
+    if (bottlenecks->count() > count)
+        bottlenecks->removeLast();
+}
+
+static bool scanSections(const QString &fileName, const GCodeIndex &index, CycleTimeChunk *chunk)
+{
+    GCodeReader reader;
+    if (!reader.open(fileName)) {
+        chunk->errorString = reader.errorString();
+        return false;
+    }
+
+    // Consecutive comment lines belong to the same section, it is named by the first one. The scan starts
+    // at the warm-up, so a run of comment lines crossing the chunk start stays one section like in one chunk.
+    const GCodeCheckpoint &checkpoint = index.checkpoint(chunk->warmupLine);
+    reader.seek(checkpoint.offset, checkpoint.lineNumber);
+
+    bool previousComment = false;
+    const char *begin;
+    const char *end;
+    while (reader.lineNumber() < chunk->endLine) {
+        qint64 lineNumber = reader.lineNumber();
+        if (!reader.readLine(&begin, &end))
+            break;
+
+        if (begin == end)
+            continue;
+
+        QString name;
+        bool comment = readSectionName(begin, end, &name);
+        if (comment && !previousComment && lineNumber >= chunk->beginLine) {
+            CycleTimeSection section;
+            section.name = name;
+            section.lineNumber = lineNumber;
+            chunk->sections.append(section);
+        }
+        previousComment = comment;
+    }
+
+    if (reader.hasError()) {
+        chunk->errorString = reader.errorString();
+        return false;
+    }
+
+    return true;
+}
+
+static void planChunk(const CycleTimeEstimator &estimator, const QString &fileName, const GCodeIndex &index, CycleTimeChunk *chunk)
+{
+    CycleTimeSection inherited;
+    inherited.lineNumber = chunk->beginLine;
+    chunk->sections.append(inherited);
+
+    if (!scanSections(fileName, index, chunk))
+        return;
+
+    GCodeInterpreter interpreter;
+    interpreter.setKinematics(estimator.kinematics());
+    interpreter.setArcTolerance(estimator.arcTolerance());
+    interpreter.setPathTolerance(estimator.pathTolerance());
+    interpreter.setCornerTolerance(estimator.cornerTolerance());
+    for (int i = 0; i < 3; i++)
+        interpreter.setStepsPerMillimeter(i, estimator.stepsPerMillimeter(i));
+
+    if (!interpreter.open(fileName) || !interpreter.seek(index, chunk->warmupLine)) {
+        chunk->errorString = interpreter.errorString();
+        return;
+    }
+
+    qint32 position[3];
+    if (!interpreter.toSteps(interpreter.state().position, position)) {
+        const double *start = interpreter.state().position;
+        chunk->errorString = QString("Line %1: X%2 Y%3 Z%4 is out of reach of the arm").arg(chunk->warmupLine).arg(start[0]).arg(start[1]).arg(start[2]);
+        return;
+    }
+
+    MotionPlanner planner = estimator.planner();
+    planner.reset(position);
+
+    int lookAhead = estimator.lookAhead();
+    int section = 0;
+    CycleTimeBottleneck line;
+    QList<qint64> lineNumbers;
+    MotionPlannerSegment segment;
+    while (true) {
+        if (interpreter.feedPlanner(&planner, lookAhead, &lineNumbers) < 0) {
+            chunk->errorString = interpreter.errorString();
+            return;
+        }
+
+        // Like the streaming: the front block gets executed once the look-ahead is full, the rest at the end
+        bool finished = interpreter.finished();
+        int keep = finished ? 0 : lookAhead - 1;
+        while (planner.blockCount() > keep) {
+            qint64 lineNumber = lineNumbers.first();
+            if (lineNumber >= chunk->endLine) {
+                finished = true;
+                break;
+            }
+
+            if (lineNumber >= chunk->beginLine) {
+                const MotionPlannerBlock &block = planner.block(0);
+                MotionPlannerTrapezoid trapezoid = planner.trapezoid(0);
+
+                while (section + 1 < chunk->sections.count() && chunk->sections.at(section + 1).lineNumber <= lineNumber)
+                    section++;
+
+                CycleTimeSection &current = chunk->sections[section];
+                current.duration += trapezoid.duration;
+                current.blockCount++;
+                chunk->duration += trapezoid.duration;
+                chunk->blockCount++;
+
+                if (lineNumber != line.lineNumber) {
+                    addBottleneck(&chunk->bottlenecks, line, estimator.bottleneckCount());
+                    line = CycleTimeBottleneck();
+                    line.lineNumber = lineNumber;
+                }
+
+                // A dwell takes as long as the program asks for, it is no lost time
+                line.blockCount++;
+                line.duration += trapezoid.duration;
+                if (block.stepEventCount > 0) {
+                    line.lostTime += trapezoid.duration - block.length / block.nominalSpeed;
+                    line.peakSpeedRatio = qMin(line.peakSpeedRatio, trapezoid.peakSpeed / block.nominalSpeed);
+                }
+            }
+
+            planner.takeSegment(&segment);
+            lineNumbers.removeFirst();
+        }
+
+        if (finished)
+            break;
+    }
+
+    addBottleneck(&chunk->bottlenecks, line, estimator.bottleneckCount());
+}
+
+CycleTimeEstimator::CycleTimeEstimator()
+{
+
+}
+
+const MotionPlanner &CycleTimeEstimator::planner() const
+{
+    return m_planner;
+}
+
+void CycleTimeEstimator::setPlanner(const MotionPlanner &planner)
+{
+    m_planner = planner;
+    m_planner.reset(m_planner.position());
+}
+
+double CycleTimeEstimator::stepsPerMillimeter(int axis) const
+{
+    return m_stepsPerMillimeter[axis];
+}
+
+void CycleTimeEstimator::setStepsPerMillimeter(int axis, double stepsPerMillimeter)
+{
+    m_stepsPerMillimeter[axis] = stepsPerMillimeter;
+}
+
+const ArmKinematics *CycleTimeEstimator::kinematics() const
+{
+    return m_kinematics;
+}
+
+void CycleTimeEstimator::setKinematics(const ArmKinematics *kinematics)
+{
+    m_kinematics = kinematics;
+}
+
+double CycleTimeEstimator::arcTolerance() const
+{
+    return m_arcTolerance;
+}
+
+void CycleTimeEstimator::setArcTolerance(double arcTolerance)
+{
+    m_arcTolerance = arcTolerance;
+}
+
+double CycleTimeEstimator::pathTolerance() const
+{
+    return m_pathTolerance;
+}
+
+void CycleTimeEstimator::setPathTolerance(double pathTolerance)
+{
+    m_pathTolerance = pathTolerance;
+}
+
+double CycleTimeEstimator::cornerTolerance() const
+{
+    return m_cornerTolerance;
+}
+
+void CycleTimeEstimator::setCornerTolerance(double cornerTolerance)
+{
+    m_cornerTolerance = cornerTolerance;
+}
+
+int CycleTimeEstimator::lookAhead() const
+{
+    return m_lookAhead;
+}
+
+void CycleTimeEstimator::setLookAhead(int lookAhead)
+{
+    m_lookAhead = qMax(1, lookAhead);
+}
+
+int CycleTimeEstimator::bottleneckCount() const
+{
+    return m_bottleneckCount;
+}
+
+void CycleTimeEstimator::setBottleneckCount(int bottleneckCount)
+{
+    m_bottleneckCount = qMax(0, bottleneckCount);
+}
+
+bool CycleTimeEstimator::estimate(const QString &fileName)
+{
+    GCodeIndex index;
+    if (!index.load(GCodeIndex::defaultIndexFileName(fileName), fileName) && !index.build(fileName)) {
+        clear();
+        m_errorString = index.errorString();
+        return false;
+    }
+
+    return estimate(fileName, index);
+}
+
+bool CycleTimeEstimator::estimate(const QString &fileName, const GCodeIndex &index)
+{
+    clear();
+
+    QElapsedTimer timer;
+    timer.start();
+
+    const QList<GCodeCheckpoint> &checkpoints = index.checkpoints();
+    int chunkCount = qBound(1, static_cast<int>(checkpoints.count()) / minimumChunkCheckpoints, QThread::idealThreadCount() * 4);
+    QList<CycleTimeChunk> chunks;
+    for (int i = 0; i < chunkCount; i++) {
+        int first = static_cast<int>(checkpoints.count() * i / chunkCount);
+        int last = static_cast<int>(checkpoints.count() * (i + 1) / chunkCount);
+
+        CycleTimeChunk chunk;
+        chunk.warmupLine = checkpoints.at(qMax(0, first - 1)).lineNumber;
+        chunk.beginLine = checkpoints.at(first).lineNumber;
+        chunk.endLine = last < checkpoints.count() ? checkpoints.at(last).lineNumber : index.lineCount() + 1;
+        chunks.append(chunk);
+    }
+
+    QtConcurrent::blockingMap(chunks, [this, fileName, &index](CycleTimeChunk &chunk) {
+        planChunk(*this, fileName, index, &chunk);
+    });
+
+    CycleTimeSection section;
+    for (const CycleTimeChunk &chunk : chunks) {
+        if (!chunk.errorString.isEmpty()) {
+            clear();
+            m_errorString = chunk.errorString;
+            return false;
+        }
+
+        for (int i = 0; i < chunk.sections.count(); i++) {
+            const CycleTimeSection &part = chunk.sections.at(i);
+            if (i > 0) {
+                if (section.blockCount > 0)
+                    m_sections.append(section);
+
+                section = part;
+                continue;
+            }
+
+            section.duration += part.duration;
+            section.blockCount += part.blockCount;
+        }
+
+        for (const CycleTimeBottleneck &bottleneck : chunk.bottlenecks)
+            addBottleneck(&m_bottlenecks, bottleneck, m_bottleneckCount);
+
+        m_duration += chunk.duration;
+        m_blockCount += chunk.blockCount;
+    }
+
+    if (section.blockCount > 0)
+        m_sections.append(section);
+
+    m_lineCount = index.lineCount();
+
+    qCDebug(dcCycleTime()) << "Estimated" << m_lineCount << "lines in" << chunkCount << "chunks:" << m_duration << "s in" << timer.elapsed() << "ms";
+    return true;
+}
+
+QString CycleTimeEstimator::errorString() const
+{
+    return m_errorString;
+}
+
+double CycleTimeEstimator::duration() const
+{
+    return m_duration;
+}
+
+qint64 CycleTimeEstimator::blockCount() const
+{
+    return m_blockCount;
+}
+
+qint64 CycleTimeEstimator::lineCount() const
+{
+    return m_lineCount;
+}
+
+const QList<CycleTimeSection> &CycleTimeEstimator::sections() const
+{
+    return m_sections;
+}
+
+const QList<CycleTimeBottleneck> &CycleTimeEstimator::bottlenecks() const
+{
+    return m_bottlenecks;
+}
+
+void CycleTimeEstimator::clear()
+{
+    m_errorString.clear();
+    m_duration = 0;
+    m_blockCount = 0;
+    m_lineCount = 0;
+    m_sections.clear();
+    m_bottlenecks.clear();
+}
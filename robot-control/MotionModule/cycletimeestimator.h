@@ -0,0 +1,104 @@
+#ifndef CYCLETIMEESTIMATOR_H
+#define CYCLETIMEESTIMATOR_H
+
+#include <QList>
+#include <QString>
+#include <QLoggingCategory>
+
+#include "gcodeindex.h"
+#include "armkinematics.h"
+#include "motionplanner.h"
+
+Q_DECLARE_LOGGING_CATEGORY(dcCycleTime)
+
+// Part of a program starting at a comment line, e.g. "(Pocket 1)" from the CAM
+struct CycleTimeSection
+{
+    QString name; // Empty for the part before the first comment
+    qint64 lineNumber = 1;
+    qint64 blockCount = 0;
+    double duration = 0; // s
+};
+
+// Line which takes the longest compared to running all of its blocks at their nominal speed
+struct CycleTimeBottleneck
+{
+    qint64 lineNumber = 0;
+    qint64 blockCount = 0;
+    double duration = 0; // s
+    double lostTime = 0; // duration - time at the nominal speed
+    double peakSpeedRatio = 1; // Lowest peak speed / nominal speed of the blocks
+};
+
+// Estimates how long a program runs on the robot without the robot: the program goes through the interpreter
+// and the planner exactly like when streaming, the planner takes the front block whenever lookAhead blocks are
+// queued and the durations of the trapezoids get summed.
+//
+// The program is split at checkpoints of its index and the chunks get planned in parallel. Each chunk starts
+// planning one checkpoint interval early from standstill, so the speeds are settled by the time its own lines
+// come, and continues until its last block got planned with the full look-ahead behind it.
+class CycleTimeEstimator
+{
+public:
+    CycleTimeEstimator();
+
+    // Limits and junction deviation are taken from this planner, in steps like the planner works
+    const MotionPlanner &planner() const;
+    void setPlanner(const MotionPlanner &planner);
+
+    double stepsPerMillimeter(int axis) const;
+    void setStepsPerMillimeter(int axis, double stepsPerMillimeter);
+
+    // Plans in joint steps of the arm, see GCodeInterpreter::setKinematics()
+    const ArmKinematics *kinematics() const;
+    void setKinematics(const ArmKinematics *kinematics);
+
+    double arcTolerance() const;
+    void setArcTolerance(double arcTolerance);
+
+    double pathTolerance() const;
+    void setPathTolerance(double pathTolerance);
+
+    double cornerTolerance() const;
+    void setCornerTolerance(double cornerTolerance);
+
+    int lookAhead() const;
+    void setLookAhead(int lookAhead);
+
+    int bottleneckCount() const;
+    void setBottleneckCount(int bottleneckCount);
+
+    // Uses the index stored next to the program if it is up to date, otherwise builds one
+    bool estimate(const QString &fileName);
+    bool estimate(const QString &fileName, const GCodeIndex &index);
+
+    QString errorString() const;
+
+    double duration() const;
+    qint64 blockCount() const;
+    qint64 lineCount() const;
+    const QList<CycleTimeSection> &sections() const;
+    const QList<CycleTimeBottleneck> &bottlenecks() const;
+
+private:
+    MotionPlanner m_planner;
+    double m_stepsPerMillimeter[3] = { 100, 100, 100 };
+    const ArmKinematics *m_kinematics = nullptr;
+    double m_arcTolerance = 0.002;
+    double m_pathTolerance = 0;
+    double m_cornerTolerance = 0;
+    int m_lookAhead = 32;
+    int m_bottleneckCount = 10;
+
+    QString m_errorString;
+    double m_duration = 0;
+    qint64 m_blockCount = 0;
+    qint64 m_lineCount = 0;
+    QList<CycleTimeSection> m_sections;
+    QList<CycleTimeBottleneck> m_bottlenecks;
+
+    void clear();
+
+};
+
+#endif // CYCLETIMEESTIMATOR_H
@@ -0,0 +1,353 @@
+#include "gcodeindex.h"
+
+#include <QFile>
+#include <QThread>
+#include <QFileInfo>
+#include <QDataStream>
+#include <QElapsedTimer>
+#include <QtConcurrent>
+
+#include <algorithm>
+
+Q_LOGGING_CATEGORY(dcGCodeIndex, "GCodeIndex")
+
+static const quint32 indexMagic = 0x58494347; // "GCIX"
+static const quint16 indexVersion = 1;
+
+// Smallest chunk worth a task of its own
+static const qint64 minimumChunkSize = 1024 * 1024;
+
+struct GCodeChunk
+{
+    qint64 begin = 0; // Lines starting in [begin, end)
+    qint64 end = 0;
+
+    // Units and distance mode assumed at the start
+    bool inches = false;
+    bool absolute = true;
+
+    // Line numbers relative to the first line of the chunk, states relative to the state at its start
+    qint64 lineCount = 0;
+    QList<GCodeCheckpoint> checkpoints;
+    GCodeState state;
+
+    qint64 errorLine = -1;
+    QString errorString;
+};
+
+static void scanChunk(const QString &fileName, int checkpointInterval, GCodeChunk *chunk)
+{
+    chunk->lineCount = 0;
+    chunk->checkpoints.clear();
+    chunk->errorLine = -1;
+    chunk->errorString.clear();
+
+    GCodeReader reader;
+    if (!reader.open(fileName)) {
+        chunk->errorString = reader.errorString();
+        return;
+    }
+
+    const char *begin;
+    const char *end;
+    if (chunk->begin > 0) {
+        // Skip the rest of the line started in the previous chunk
+        reader.seek(chunk->begin - 1, 0);
+        reader.readLine(&begin, &end);
+    }
+
+    // Fields not assigned within the chunk keep the state of the previous chunk. Feed rate and motion get
+    // valid placeholders, so lines relying on them parse fine, positions start at 0 to become relative.
+    GCodeState state;
+    state.inches = chunk->inches;
+    state.absolute = chunk->absolute;
+    state.motion = GCodeState::MotionLinear;
+    state.feedRate = 1;
+
+    GCodeMove move;
+    while (reader.offset() < chunk->end) {
+        if (chunk->lineCount % checkpointInterval == 0) {
+            GCodeCheckpoint checkpoint;
+            checkpoint.lineNumber = chunk->lineCount;
+            checkpoint.offset = reader.offset();
+            checkpoint.state = state;
+            chunk->checkpoints.append(checkpoint);
+        }
+
+        if (!reader.readLine(&begin, &end))
+            break;
+
+        QString errorString;
+        if (GCodeInterpreter::parseLine(begin, end, &state, &move, &errorString) == GCodeInterpreter::LineError) {
+            chunk->errorLine = chunk->lineCount;
+            chunk->errorString = errorString;
+            return;
+        }
+        chunk->lineCount++;
+    }
+
+    if (reader.hasError())
+        chunk->errorString = reader.errorString();
+
+    chunk->state = state;
+}
+
+static GCodeState resolveState(const GCodeState &start, const GCodeState &relative)
+{
+    GCodeState state = relative;
+    if (!(relative.assigned & GCodeState::FieldMotion))
+        state.motion = start.motion;
+    if (!(relative.assigned & GCodeState::FieldPlane))
+        state.plane = start.plane;
+    if (!(relative.assigned & GCodeState::FieldFeedRate))
+        state.feedRate = start.feedRate;
+
+    for (int i = 0; i < 3; i++) {
+        if (!(relative.assigned & (GCodeState::FieldPositionX << i)))
+            state.position[i] = start.position[i] + relative.position[i];
+    }
+
+    state.assigned = 0;
+    return state;
+}
+
+GCodeIndex::GCodeIndex()
+{
+
+}
+
+int GCodeIndex::checkpointInterval() const
+{
+    return m_checkpointInterval;
+}
+
+void GCodeIndex::setCheckpointInterval(int checkpointInterval)
+{
+    m_checkpointInterval = qMax(1, checkpointInterval);
+}
+
+bool GCodeIndex::build(const QString &fileName)
+{
+    clear();
+    m_errorString.clear();
+
+    QFileInfo fileInfo(fileName);
+    if (!fileInfo.exists()) {
+        m_errorString = QString("%1 does not exist").arg(fileName);
+        return false;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    m_programSize = fileInfo.size();
+    m_programModified = fileInfo.lastModified().toMSecsSinceEpoch();
+
+    int chunkCount = static_cast<int>(qBound<qint64>(1, m_programSize / minimumChunkSize, QThread::idealThreadCount() * 4));
+    QList<GCodeChunk> chunks;
+    for (int i = 0; i < chunkCount; i++) {
+        GCodeChunk chunk;
+        chunk.begin = m_programSize * i / chunkCount;
+        chunk.end = m_programSize * (i + 1) / chunkCount;
+        chunks.append(chunk);
+    }
+
+    int checkpointInterval = m_checkpointInterval;
+    QtConcurrent::blockingMap(chunks, [fileName, checkpointInterval](GCodeChunk &chunk) {
+        scanChunk(fileName, checkpointInterval, &chunk);
+    });
+
+    // Units and distance mode only change on G20/G21 and G90/G91, so the right ones at each chunk start are known
+    // now. Chunks which assumed the wrong ones get scanned again.
+    QList<GCodeChunk> rescan;
+    QList<int> rescanIndices;
+    bool inches = false;
+    bool absolute = true;
+    for (int i = 0; i < chunks.count(); i++) {
+        GCodeChunk &chunk = chunks[i];
+        if (chunk.inches != inches || chunk.absolute != absolute) {
+            chunk.inches = inches;
+            chunk.absolute = absolute;
+            rescan.append(chunk);
+            rescanIndices.append(i);
+        }
+
+        if (chunk.state.assigned & GCodeState::FieldUnits)
+            inches = chunk.state.inches;
+        if (chunk.state.assigned & GCodeState::FieldDistance)
+            absolute = chunk.state.absolute;
+    }
+
+    if (!rescan.isEmpty()) {
+        qCDebug(dcGCodeIndex()) << "Scanning" << rescan.count() << "chunks again with other units or distance mode";
+        QtConcurrent::blockingMap(rescan, [fileName, checkpointInterval](GCodeChunk &chunk) {
+            scanChunk(fileName, checkpointInterval, &chunk);
+        });
+
+        for (int i = 0; i < rescan.count(); i++) {
+            chunks[rescanIndices.at(i)] = rescan.at(i);
+        }
+    }
+
+    // Resolve the states from the program start on
+    GCodeState state;
+    qint64 lineNumber = 1;
+    for (const GCodeChunk &chunk : chunks) {
+        if (!chunk.errorString.isEmpty()) {
+            if (chunk.errorLine >= 0) {
+                m_errorString = QString("Line %1: %2").arg(lineNumber + chunk.errorLine).arg(chunk.errorString);
+            } else {
+                m_errorString = chunk.errorString;
+            }
+            clear();
+            return false;
+        }
+
+        for (const GCodeCheckpoint &relative : chunk.checkpoints) {
+            GCodeCheckpoint checkpoint;
+            checkpoint.lineNumber = lineNumber + relative.lineNumber;
+            checkpoint.offset = relative.offset;
+            checkpoint.state = resolveState(state, relative.state);
+            m_checkpoints.append(checkpoint);
+        }
+
+        state = resolveState(state, chunk.state);
+        lineNumber += chunk.lineCount;
+    }
+
+    m_lineCount = lineNumber - 1;
+    if (m_checkpoints.isEmpty())
+        m_checkpoints.append(GCodeCheckpoint());
+
+    qCDebug(dcGCodeIndex()) << "Indexed" << m_lineCount << "lines in" << chunkCount << "chunks," << m_checkpoints.count() << "checkpoints in" << timer.elapsed() << "ms";
+    return true;
+}
+
+bool GCodeIndex::save(const QString &indexFileName) const
+{
+    QFile file(indexFileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qCWarning(dcGCodeIndex()) << "Could not write" << indexFileName << file.errorString();
+        return false;
+    }
+
+    QDataStream stream(&file);
+    stream.setByteOrder(QDataStream::LittleEndian);
+    stream << indexMagic << indexVersion << m_programSize << m_programModified << m_lineCount;
+    stream << static_cast<qint32>(m_checkpointInterval) << static_cast<qint32>(m_checkpoints.count());
+    for (const GCodeCheckpoint &checkpoint : m_checkpoints) {
+        const GCodeState &state = checkpoint.state;
+        stream << checkpoint.lineNumber << checkpoint.offset;
+        stream << static_cast<quint8>(state.motion) << static_cast<quint8>(state.plane);
+        stream << static_cast<quint8>(state.inches) << static_cast<quint8>(state.absolute);
+        stream << state.feedRate << state.position[0] << state.position[1] << state.position[2];
+    }
+
+    return stream.status() == QDataStream::Ok;
+}
+
+bool GCodeIndex::load(const QString &indexFileName, const QString &fileName)
+{
+    clear();
+    m_errorString.clear();
+
+    QFile file(indexFileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        m_errorString = QString("Could not open %1: %2").arg(indexFileName, file.errorString());
+        return false;
+    }
+
+    QDataStream stream(&file);
+    stream.setByteOrder(QDataStream::LittleEndian);
+
+    quint32 magic = 0;
+    quint16 version = 0;
+    stream >> magic >> version;
+    if (magic != indexMagic || version != indexVersion) {
+        m_errorString = QString("%1 is not a G-code index of version %2").arg(indexFileName).arg(indexVersion);
+        return false;
+    }
+
+    qint32 checkpointInterval = 0;
+    qint32 checkpointCount = 0;
+    stream >> m_programSize >> m_programModified >> m_lineCount >> checkpointInterval >> checkpointCount;
+
+    QFileInfo fileInfo(fileName);
+    if (fileInfo.size() != m_programSize || fileInfo.lastModified().toMSecsSinceEpoch() != m_programModified) {
+        m_errorString = QString("%1 changed since the index has been built").arg(fileName);
+        clear();
+        return false;
+    }
+
+    // build() continues every checkpointInterval lines from here, 0 would divide by zero
+    if (checkpointInterval < 1 || checkpointCount < 0) {
+        m_errorString = QString("%1 is corrupt").arg(indexFileName);
+        clear();
+        return false;
+    }
+
+    m_checkpointInterval = checkpointInterval;
+    m_checkpoints.reserve(checkpointCount);
+    for (int i = 0; i < checkpointCount && stream.status() == QDataStream::Ok; i++) {
+        GCodeCheckpoint checkpoint;
+        GCodeState &state = checkpoint.state;
+        quint8 motion, plane, inches, absolute;
+        stream >> checkpoint.lineNumber >> checkpoint.offset >> motion >> plane >> inches >> absolute;
+        stream >> state.feedRate >> state.position[0] >> state.position[1] >> state.position[2];
+        state.motion = static_cast<GCodeState::Motion>(motion);
+        state.plane = static_cast<GCodeState::Plane>(plane);
+        state.inches = inches;
+        state.absolute = absolute;
+        m_checkpoints.append(checkpoint);
+    }
+
+    if (stream.status() != QDataStream::Ok || m_checkpoints.isEmpty()) {
+        m_errorString = QString("%1 is truncated").arg(indexFileName);
+        clear();
+        return false;
+    }
+
+    return true;
+}
+
+QString GCodeIndex::defaultIndexFileName(const QString &fileName)
+{
+    return fileName + ".index";
+}
+
+QString GCodeIndex::errorString() const
+{
+    return m_errorString;
+}
+
+qint64 GCodeIndex::programSize() const
+{
+    return m_programSize;
+}
+
+qint64 GCodeIndex::lineCount() const
+{
+    return m_lineCount;
+}
+
+const QList<GCodeCheckpoint> &GCodeIndex::checkpoints() const
+{
+    return m_checkpoints;
+}
+
+const GCodeCheckpoint &GCodeIndex::checkpoint(qint64 lineNumber) const
+{
+    auto it = std::upper_bound(m_checkpoints.constBegin(), m_checkpoints.constEnd(), lineNumber, [](qint64 lineNumber, const GCodeCheckpoint &checkpoint) {
+        return lineNumber < checkpoint.lineNumber;
+    });
+
+    return it == m_checkpoints.constBegin() ? m_checkpoints.first() : *(it - 1);
+}
+
+void GCodeIndex::clear()
+{
+    m_programSize = 0;
+    m_programModified = 0;
+    m_lineCount = 0;
+    m_checkpoints.clear();
+}
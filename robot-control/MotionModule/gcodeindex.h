@@ -0,0 +1,68 @@
+#ifndef GCODEINDEX_H
+#define GCODEINDEX_H
+
+#include <QList>
+#include <QString>
+#include <QLoggingCategory>
+
+#include "gcodeinterpreter.h"
+
+Q_DECLARE_LOGGING_CATEGORY(dcGCodeIndex)
+
+// Modal state of the program before the line at the offset gets executed
+struct GCodeCheckpoint
+{
+    qint64 lineNumber = 1;
+    qint64 offset = 0;
+    GCodeState state;
+};
+
+// Index of a program with a checkpoint at least every checkpointInterval lines, so the interpreter can
+// continue at any line after parsing no more than that many lines (see GCodeInterpreter::seek()).
+//
+// The pre-scan splits the program into chunks and parses them in parallel. The modal state at the start of a
+// chunk is unknown while scanning, so each chunk starts from a state without assigned fields and keeps the
+// positions relative to its start where no absolute move happened yet. Once all chunks are done their states
+// get resolved from the first chunk on. Only units and distance mode change how the values of a line are read,
+// a chunk which was scanned with the wrong ones gets scanned again, also in parallel.
+// Errors which depend on the state at the start of a chunk (undefined feed rate, no motion mode) are left to
+// the interpreter.
+class GCodeIndex
+{
+public:
+    GCodeIndex();
+
+    int checkpointInterval() const;
+    void setCheckpointInterval(int checkpointInterval);
+
+    // Pre-scans the program on all cores
+    bool build(const QString &fileName);
+
+    // The index is stored next to the program by default and only loads if the program did not change since
+    bool save(const QString &indexFileName) const;
+    bool load(const QString &indexFileName, const QString &fileName);
+    static QString defaultIndexFileName(const QString &fileName);
+
+    QString errorString() const;
+
+    qint64 programSize() const;
+    qint64 lineCount() const;
+    const QList<GCodeCheckpoint> &checkpoints() const;
+
+    // Last checkpoint at or before the line
+    const GCodeCheckpoint &checkpoint(qint64 lineNumber) const;
+
+private:
+    int m_checkpointInterval = 1000;
+    QString m_errorString;
+
+    qint64 m_programSize = 0;
+    qint64 m_programModified = 0;
+    qint64 m_lineCount = 0;
+    QList<GCodeCheckpoint> m_checkpoints;
+
+    void clear();
+
+};
+
+#endif // GCODEINDEX_H
@@ -0,0 +1,616 @@
+#include "gcodeinterpreter.h"
+#include "gcodeindex.h"
+
+#include <cmath>
+#include <charconv>
+#include <limits>
+
+Q_LOGGING_CATEGORY(dcGCode, "GCode")
+
+static const double millimetersPerInch = 25.4;
+
+static inline const char *skipSpaces(const char *p, const char *end)
+{
+    while (p < end && (*p == ' ' || *p == '\t'))
+        p++;
+
+    return p;
+}
+
+// read_float() of GRBL: decimal number without exponent, optional sign and spaces after the letter
+static inline bool readNumber(const char **p, const char *end, double *value)
+{
+    const char *begin = skipSpaces(*p, end);
+    if (begin < end && *begin == '+')
+        begin++;
+
+    std::from_chars_result result = std::from_chars(begin, end, *value, std::chars_format::fixed);
+    if (result.ec != std::errc())
+        return false;
+
+    *p = result.ptr;
+    return true;
+}
+
+GCodeInterpreter::GCodeInterpreter()
+{
+
+}
+
+double GCodeInterpreter::stepsPerMillimeter(int axis) const
+{
+    return m_stepsPerMillimeter[axis];
+}
+
+void GCodeInterpreter::setStepsPerMillimeter(int axis, double stepsPerMillimeter)
+{
+    m_stepsPerMillimeter[axis] = stepsPerMillimeter;
+}
+
+const ArmKinematics *GCodeInterpreter::kinematics() const
+{
+    return m_kinematics;
+}
+
+void GCodeInterpreter::setKinematics(const ArmKinematics *kinematics)
+{
+    m_kinematics = kinematics;
+}
+
+bool GCodeInterpreter::open(const QString &fileName)
+{
+    m_state = GCodeState();
+    m_errorString.clear();
+    m_finished = false;
+    m_arcPoint = 0;
+    m_arcPointCount = 0;
+    m_pathSimplifier.reset();
+    m_pathBlender.reset();
+
+    if (!m_reader.open(fileName))
+        return fail(m_reader.errorString());
+
+    qCDebug(dcGCode()) << "Opened" << fileName << m_reader.size() << "bytes";
+    return true;
+}
+
+void GCodeInterpreter::close()
+{
+    m_reader.close();
+    m_finished = true;
+}
+
+QString GCodeInterpreter::errorString() const
+{
+    return m_errorString;
+}
+
+bool GCodeInterpreter::hasError() const
+{
+    return !m_errorString.isEmpty();
+}
+
+bool GCodeInterpreter::finished() const
+{
+    return m_finished;
+}
+
+const GCodeState &GCodeInterpreter::state() const
+{
+    return m_state;
+}
+
+void GCodeInterpreter::setState(const GCodeState &state)
+{
+    m_state = state;
+}
+
+GCodeReader *GCodeInterpreter::reader()
+{
+    return &m_reader;
+}
+
+bool GCodeInterpreter::next(GCodeMove *move)
+{
+    if (m_finished || hasError())
+        return false;
+
+    const char *begin;
+    const char *end;
+    while (true) {
+        qint64 lineNumber = m_reader.lineNumber();
+        if (!m_reader.readLine(&begin, &end)) {
+            if (m_reader.hasError())
+                return fail(m_reader.errorString());
+
+            m_finished = true;
+            return false;
+        }
+
+        QString errorString;
+        switch (parseLine(begin, end, &m_state, move, &errorString)) {
+        case LineEmpty:
+            break;
+        case LineMove:
+            move->lineNumber = lineNumber;
+            if (move->type == GCodeMove::TypeProgramEnd) {
+                m_finished = true;
+                return false;
+            }
+            return true;
+        case LineError:
+            return fail(QString("Line %1: %2").arg(lineNumber).arg(errorString));
+        }
+    }
+}
+
+bool GCodeInterpreter::nextSegment(GCodeMove *segment)
+{
+    if (m_arcPoint < m_arcPointCount) {
+        *segment = m_arcMove;
+        segment->type = GCodeMove::TypeLinear;
+        if (m_arcPoint > 0)
+            m_arcExpander.point(m_arcPoint - 1, segment->start);
+
+        m_arcExpander.point(m_arcPoint, segment->target);
+        m_arcPoint++;
+        return true;
+    }
+
+    if (!next(segment))
+        return false;
+
+    if (segment->type == GCodeMove::TypeArcClockwise || segment->type == GCodeMove::TypeArcCounterClockwise) {
+        if (!m_arcExpander.expand(*segment))
+            return fail(QString("Line %1: %2").arg(segment->lineNumber).arg(m_arcExpander.errorString()));
+
+        m_arcMove = *segment;
+        m_arcPoint = 0;
+        m_arcPointCount = m_arcExpander.pointCount();
+        return nextSegment(segment);
+    }
+
+    return true;
+}
+
+double GCodeInterpreter::arcTolerance() const
+{
+    return m_arcExpander.tolerance();
+}
+
+void GCodeInterpreter::setArcTolerance(double arcTolerance)
+{
+    m_arcExpander.setTolerance(arcTolerance);
+}
+
+double GCodeInterpreter::pathTolerance() const
+{
+    return m_pathSimplifier.tolerance();
+}
+
+void GCodeInterpreter::setPathTolerance(double pathTolerance)
+{
+    m_pathSimplifier.setTolerance(pathTolerance);
+}
+
+const PathSimplifier &GCodeInterpreter::pathSimplifier() const
+{
+    return m_pathSimplifier;
+}
+
+double GCodeInterpreter::cornerTolerance() const
+{
+    return m_pathBlender.tolerance();
+}
+
+void GCodeInterpreter::setCornerTolerance(double cornerTolerance)
+{
+    m_pathBlender.setTolerance(cornerTolerance);
+}
+
+const PathBlender &GCodeInterpreter::pathBlender() const
+{
+    return m_pathBlender;
+}
+
+bool GCodeInterpreter::seek(const GCodeIndex &index, qint64 lineNumber)
+{
+    if (!m_reader.isOpen() || index.programSize() != m_reader.size())
+        return fail(QString("The index does not belong to the program"));
+
+    if (lineNumber < 1 || lineNumber > index.lineCount() + 1)
+        return fail(QString("Line %1 is not within the program").arg(lineNumber));
+
+    const GCodeCheckpoint &checkpoint = index.checkpoint(lineNumber);
+    m_reader.seek(checkpoint.offset, checkpoint.lineNumber);
+    m_state = checkpoint.state;
+    m_errorString.clear();
+    m_finished = false;
+    m_arcPoint = 0;
+    m_arcPointCount = 0;
+    m_pathSimplifier.reset();
+    m_pathBlender.reset();
+
+    const char *begin;
+    const char *end;
+    GCodeMove move;
+    while (m_reader.lineNumber() < lineNumber) {
+        qint64 currentLine = m_reader.lineNumber();
+        if (!m_reader.readLine(&begin, &end))
+            return fail(m_reader.hasError() ? m_reader.errorString() : QString("Line %1 is not within the program").arg(lineNumber));
+
+        QString errorString;
+        if (parseLine(begin, end, &m_state, &move, &errorString) == LineError)
+            return fail(QString("Line %1: %2").arg(currentLine).arg(errorString));
+    }
+
+    qCDebug(dcGCode()) << "Continuing at line" << lineNumber << "from checkpoint at line" << checkpoint.lineNumber;
+    return true;
+}
+
+int GCodeInterpreter::feedPlanner(MotionPlanner *planner, int maxBlocks, QList<qint64> *lineNumbers)
+{
+    int queued = 0;
+    GCodeMove segment;
+    GCodeMove simplified;
+    GCodeMove blended;
+    while (planner->blockCount() < maxBlocks) {
+        bool hasSegment = nextSegment(&segment);
+        if (hasError())
+            return -1;
+
+        bool completed = hasSegment ? m_pathSimplifier.push(segment, &simplified) : m_pathSimplifier.flush(&simplified);
+        if (completed)
+            m_pathBlender.push(simplified);
+        if (!hasSegment)
+            m_pathBlender.flush();
+
+        while (m_pathBlender.takeSegment(&blended)) {
+            int blocks = queueSegment(planner, blended, lineNumbers);
+            if (blocks < 0)
+                return -1;
+
+            queued += blocks;
+        }
+
+        if (!hasSegment)
+            break;
+    }
+
+    return queued;
+}
+
+bool GCodeInterpreter::toSteps(const double position[3], qint32 steps[3]) const
+{
+    if (m_kinematics)
+        return m_kinematics->toSteps(position, steps);
+
+    for (int i = 0; i < 3; i++) {
+        steps[i] = static_cast<qint32>(std::lround(position[i] * m_stepsPerMillimeter[i]));
+    }
+    return true;
+}
+
+GCodeInterpreter::LineResult GCodeInterpreter::parseLine(const char *begin, const char *end, GCodeState *state, GCodeMove *move, QString *errorString)
+{
+    // Pass 1: collect the words, the modal commands apply after the whole line is known like in GRBL
+    int motion = -1;
+    int plane = -1;
+    int inches = -1;
+    int absolute = -1;
+    bool dwell = false;
+    bool programEnd = false;
+
+    double axisValues[3] = { 0, 0, 0 };
+    double offsetValues[3] = { 0, 0, 0 };
+    double radius = 0;
+    double feedRate = 0;
+    double dwellTime = 0;
+    quint8 axisWords = 0;
+    quint8 offsetWords = 0;
+    bool hasRadius = false;
+    bool hasFeedRate = false;
+    bool hasDwellTime = false;
+
+    const char *p = begin;
+    while (p < end) {
+        char letter = *p++;
+        switch (letter) {
+        case ' ':
+        case '\t':
+        case '/': // Block delete is not supported, the line gets executed
+            continue;
+        case '(':
+            while (p < end && *p != ')')
+                p++;
+
+            if (p == end) {
+                *errorString = QString("Unterminated comment");
+                return LineError;
+            }
+            p++;
+            continue;
+        case ';':
+        case '%':
+            p = end;
+            continue;
+        }
+
+        if (letter >= 'a' && letter <= 'z')
+            letter -= 'a' - 'A';
+
+        double value;
+        if (!readNumber(&p, end, &value)) {
+            *errorString = QString("Bad number format after %1").arg(QChar(letter));
+            return LineError;
+        }
+
+        switch (letter) {
+        case 'G': {
+            int code = static_cast<int>(std::lround(value * 10));
+            int *group = nullptr;
+            int groupValue = 0;
+            switch (code) {
+            case 0: group = &motion; groupValue = GCodeState::MotionSeek; break;
+            case 10: group = &motion; groupValue = GCodeState::MotionLinear; break;
+            case 20: group = &motion; groupValue = GCodeState::MotionArcClockwise; break;
+            case 30: group = &motion; groupValue = GCodeState::MotionArcCounterClockwise; break;
+            case 800: group = &motion; groupValue = GCodeState::MotionNone; break;
+            case 170: group = &plane; groupValue = GCodeState::PlaneXY; break;
+            case 180: group = &plane; groupValue = GCodeState::PlaneZX; break;
+            case 190: group = &plane; groupValue = GCodeState::PlaneYZ; break;
+            case 200: group = &inches; groupValue = 1; break;
+            case 210: group = &inches; groupValue = 0; break;
+            case 900: group = &absolute; groupValue = 1; break;
+            case 910: group = &absolute; groupValue = 0; break;
+            case 40: dwell = true; continue;
+            case 940: continue; // Units per minute feed rate mode, the only one supported
+            default:
+                *errorString = QString("Unsupported command G%1").arg(value);
+                return LineError;
+            }
+
+            if (*group >= 0) {
+                *errorString = QString("Modal group violation at G%1").arg(value);
+                return LineError;
+            }
+            *group = groupValue;
+            break;
+        }
+        case 'M':
+            switch (static_cast<int>(std::lround(value))) {
+            case 0: case 1: break; // Program pause, the host decides when to stream
+            case 2: case 30: programEnd = true; break;
+            case 3: case 4: case 5: case 7: case 8: case 9: break; // No spindle or coolant
+            default:
+                *errorString = QString("Unsupported command M%1").arg(value);
+                return LineError;
+            }
+            break;
+        case 'X': case 'Y': case 'Z':
+            axisValues[letter - 'X'] = value;
+            axisWords |= 1 << (letter - 'X');
+            break;
+        case 'I': case 'J': case 'K':
+            offsetValues[letter - 'I'] = value;
+            offsetWords |= 1 << (letter - 'I');
+            break;
+        case 'R':
+            radius = value;
+            hasRadius = true;
+            break;
+        case 'F':
+            if (value <= 0) {
+                *errorString = QString("Feed rate must be positive");
+                return LineError;
+            }
+            feedRate = value;
+            hasFeedRate = true;
+            break;
+        case 'P':
+            dwellTime = value;
+            hasDwellTime = true;
+            break;
+        case 'N': case 'S': case 'T':
+            break; // Line numbers, spindle speed and tool are ignored
+        default:
+            *errorString = QString("Unsupported word %1").arg(QChar(letter));
+            return LineError;
+        }
+    }
+
+    // Pass 2: units first, they apply to all values of the line. The state only changes if the line is valid.
+    GCodeState lineState = *state;
+    if (inches >= 0) {
+        lineState.inches = inches;
+        lineState.assigned |= GCodeState::FieldUnits;
+    }
+    if (plane >= 0) {
+        lineState.plane = static_cast<GCodeState::Plane>(plane);
+        lineState.assigned |= GCodeState::FieldPlane;
+    }
+    if (absolute >= 0) {
+        lineState.absolute = absolute;
+        lineState.assigned |= GCodeState::FieldDistance;
+    }
+    if (motion >= 0) {
+        lineState.motion = static_cast<GCodeState::Motion>(motion);
+        lineState.assigned |= GCodeState::FieldMotion;
+    }
+
+    double scale = lineState.inches ? millimetersPerInch : 1.0;
+    if (hasFeedRate) {
+        lineState.feedRate = feedRate * scale;
+        lineState.assigned |= GCodeState::FieldFeedRate;
+    }
+
+    if (dwell) {
+        if (axisWords) {
+            *errorString = QString("Axis words are not allowed with G4");
+            return LineError;
+        }
+        if (!hasDwellTime || dwellTime < 0) {
+            *errorString = QString("G4 needs a dwell time P");
+            return LineError;
+        }
+
+        move->type = GCodeMove::TypeDwell;
+        move->dwell = dwellTime;
+        for (int i = 0; i < 3; i++) {
+            move->start[i] = lineState.position[i];
+            move->target[i] = lineState.position[i];
+        }
+        *state = lineState;
+        return LineMove;
+    }
+
+    if (!axisWords) {
+        *state = lineState;
+        if (programEnd) {
+            move->type = GCodeMove::TypeProgramEnd;
+            return LineMove;
+        }
+        return LineEmpty;
+    }
+
+    if (programEnd) {
+        *errorString = QString("Axis words are not allowed with a program end");
+        return LineError;
+    }
+
+    move->plane = lineState.plane;
+    move->feedRate = lineState.feedRate;
+    move->hasRadius = false;
+    move->radius = 0;
+    for (int i = 0; i < 3; i++) {
+        move->start[i] = lineState.position[i];
+        move->offset[i] = 0;
+        if (axisWords & (1 << i)) {
+            double axisValue = axisValues[i] * scale;
+            move->target[i] = lineState.absolute ? axisValue : lineState.position[i] + axisValue;
+        } else {
+            move->target[i] = lineState.position[i];
+        }
+    }
+
+    switch (lineState.motion) {
+    case GCodeState::MotionSeek:
+        move->type = GCodeMove::TypeSeek;
+        break;
+    case GCodeState::MotionLinear:
+        move->type = GCodeMove::TypeLinear;
+        break;
+    case GCodeState::MotionArcClockwise:
+    case GCodeState::MotionArcCounterClockwise:
+        move->type = lineState.motion == GCodeState::MotionArcClockwise ? GCodeMove::TypeArcClockwise : GCodeMove::TypeArcCounterClockwise;
+        if (hasRadius) {
+            move->hasRadius = true;
+            move->radius = radius * scale;
+        } else if (offsetWords) {
+            for (int i = 0; i < 3; i++) {
+                move->offset[i] = offsetValues[i] * scale;
+            }
+        } else {
+            *errorString = QString("Arc without radius or center offset");
+            return LineError;
+        }
+        break;
+    case GCodeState::MotionNone:
+        *errorString = QString("Axis words without a motion mode");
+        return LineError;
+    }
+
+    if (move->type != GCodeMove::TypeSeek && lineState.feedRate <= 0) {
+        *errorString = QString("Undefined feed rate");
+        return LineError;
+    }
+
+    for (int i = 0; i < 3; i++) {
+        lineState.position[i] = move->target[i];
+        if (lineState.absolute && (axisWords & (1 << i)))
+            lineState.assigned |= GCodeState::FieldPositionX << i;
+    }
+
+    *state = lineState;
+    return LineMove;
+}
+
+int GCodeInterpreter::queueSegment(MotionPlanner *planner, const GCodeMove &segment, QList<qint64> *lineNumbers)
+{
+    switch (segment.type) {
+    case GCodeMove::TypeSeek:
+    case GCodeMove::TypeLinear:
+        break;
+    case GCodeMove::TypeArcClockwise:
+    case GCodeMove::TypeArcCounterClockwise:
+        // Linearized by nextSegment()
+        return 0;
+    case GCodeMove::TypeDwell:
+        planner->bufferDwell(segment.dwell);
+        if (lineNumbers)
+            lineNumbers->append(segment.lineNumber);
+        return 1;
+    case GCodeMove::TypeProgramEnd:
+        return 0;
+    }
+
+    // The joints of the arm move linear from one piece end to the next, the pieces keep the tool close to the line
+    int pieceCount = 1;
+    const qint32 *targets;
+    qint32 target[3];
+    if (m_kinematics) {
+        m_pathResampler.setKinematics(m_kinematics);
+        m_pathResampler.setTolerance(m_kinematics->configuration().lineTolerance);
+        if (!m_pathResampler.resample(segment.start, segment.target)) {
+            fail(QString("Line %1: %2").arg(segment.lineNumber).arg(m_pathResampler.errorString()));
+            return -1;
+        }
+
+        pieceCount = m_pathResampler.pointCount();
+        m_pieceSteps.resize(pieceCount * 3);
+        for (int k = 0; k < pieceCount; k++) {
+            double angles[3] = { m_pathResampler.angles(0)[k], m_pathResampler.angles(1)[k], m_pathResampler.angles(2)[k] };
+            m_kinematics->anglesToSteps(angles, &m_pieceSteps[3 * k]);
+        }
+        targets = m_pieceSteps.constData();
+    } else {
+        toSteps(segment.target, target);
+        targets = target;
+    }
+
+    int queued = 0;
+    double pieceStart[3] = { segment.start[0], segment.start[1], segment.start[2] };
+    for (int k = 0; k < pieceCount; k++) {
+        const qint32 *pieceTarget = targets + 3 * k;
+        double lengthSqr = 0;
+        double stepsSqr = 0;
+        for (int i = 0; i < 3; i++) {
+            double pieceEnd = m_kinematics ? m_pathResampler.points(i)[k] : segment.target[i];
+            double distance = pieceEnd - pieceStart[i];
+            double steps = static_cast<double>(pieceTarget[i]) - planner->position()[i];
+            lengthSqr += distance * distance;
+            stepsSqr += steps * steps;
+            pieceStart[i] = pieceEnd;
+        }
+
+        // The feed rate applies to the path in mm, the planner measures the path in steps
+        double feedRate = std::numeric_limits<double>::infinity();
+        if (segment.type == GCodeMove::TypeLinear && lengthSqr > 0)
+            feedRate = segment.feedRate / 60.0 * std::sqrt(stepsSqr / lengthSqr);
+
+        if (planner->bufferLine(pieceTarget, feedRate)) {
+            queued++;
+            if (lineNumbers)
+                lineNumbers->append(segment.lineNumber);
+        }
+    }
+
+    return queued;
+}
+
+bool GCodeInterpreter::fail(const QString &errorString)
+{
+    m_errorString = errorString;
+    qCWarning(dcGCode()) << errorString;
+    return false;
+}
@@ -0,0 +1,120 @@
+#ifndef GCODEINTERPRETER_H
+#define GCODEINTERPRETER_H
+
+#include <QString>
+#include <QLoggingCategory>
+
+#include "gcodemove.h"
+#include "gcodereader.h"
+#include "arcexpander.h"
+#include "pathsimplifier.h"
+#include "pathblender.h"
+#include "armkinematics.h"
+#include "pathresampler.h"
+#include "motionplanner.h"
+
+Q_DECLARE_LOGGING_CATEGORY(dcGCode)
+
+class GCodeIndex;
+
+// Streaming G-code interpreter for the GRBL subset of RS274/NGC: G0-G3, G4, G17-G19, G20/G21, G80, G90/G91, G94,
+// M0-M2 and M30. Reads the program through a memory mapped GCodeReader and parses one line at a time whenever the
+// next motion is needed, numbers are parsed with std::from_chars. Nothing gets buffered besides the modal state,
+// so a program starts right away and the memory needed does not grow with its size.
+//
+// Positions are in mm, the machine position in steps is derived with the steps per mm of each axis.
+class GCodeInterpreter
+{
+public:
+    enum LineResult {
+        LineEmpty,
+        LineMove,
+        LineError
+    };
+
+    GCodeInterpreter();
+
+    double stepsPerMillimeter(int axis) const;
+    void setStepsPerMillimeter(int axis, double stepsPerMillimeter);
+
+    // Machine positions are joint steps of the arm instead of steps per mm, nullptr for a Cartesian machine.
+    // Lines get resampled within the line tolerance of the arm configuration.
+    const ArmKinematics *kinematics() const;
+    void setKinematics(const ArmKinematics *kinematics);
+
+    bool open(const QString &fileName);
+    void close();
+
+    QString errorString() const;
+    bool hasError() const;
+
+    // True once the end of the file or a program end (M2, M30) has been reached
+    bool finished() const;
+
+    const GCodeState &state() const;
+    void setState(const GCodeState &state);
+
+    GCodeReader *reader();
+
+    // Parses lines up to the next motion, returns false at the end of the program or on an error
+    bool next(GCodeMove *move);
+
+    // Like next(), but arcs get linearized within the arc tolerance and come as linear moves one by one
+    bool nextSegment(GCodeMove *segment);
+
+    double arcTolerance() const;
+    void setArcTolerance(double arcTolerance);
+
+    // Segments for the planner get merged within this tolerance [mm], 0 disables the simplification
+    double pathTolerance() const;
+    void setPathTolerance(double pathTolerance);
+    const PathSimplifier &pathSimplifier() const;
+
+    // Corners between the segments get blended within this tolerance [mm], 0 disables the blending
+    double cornerTolerance() const;
+    void setCornerTolerance(double cornerTolerance);
+    const PathBlender &pathBlender() const;
+
+    // Continues at the line with the modal state the program has before it, e.g. to resume after a fault.
+    // Starts at the closest checkpoint of the index and parses the lines in between.
+    bool seek(const GCodeIndex &index, qint64 lineNumber);
+
+    // Pipeline stage feeding the planner: queues segments until the planner holds maxBlocks blocks or the program ends.
+    // Returns the number of blocks queued, -1 on an error. The line number of each queued block gets appended to
+    // lineNumbers if given.
+    int feedPlanner(MotionPlanner *planner, int maxBlocks, QList<qint64> *lineNumbers = nullptr);
+
+    // False if the position is out of reach of the arm
+    bool toSteps(const double position[3], qint32 steps[3]) const;
+
+    // Parses one line without the line ending and updates the state, the move is only valid for LineMove
+    static LineResult parseLine(const char *begin, const char *end, GCodeState *state, GCodeMove *move, QString *errorString);
+
+private:
+    GCodeReader m_reader;
+    GCodeState m_state;
+    QString m_errorString;
+    bool m_finished = false;
+
+    // Arc being linearized by nextSegment()
+    ArcExpander m_arcExpander;
+    GCodeMove m_arcMove;
+    int m_arcPoint = 0;
+    int m_arcPointCount = 0;
+
+    PathSimplifier m_pathSimplifier = PathSimplifier(0);
+    PathBlender m_pathBlender = PathBlender(0);
+
+    double m_stepsPerMillimeter[3] = { 100, 100, 100 };
+
+    // Pieces of the current line for the arm
+    const ArmKinematics *m_kinematics = nullptr;
+    PathResampler m_pathResampler;
+    QList<qint32> m_pieceSteps;
+
+    bool fail(const QString &errorString);
+    int queueSegment(MotionPlanner *planner, const GCodeMove &segment, QList<qint64> *lineNumbers);
+
+};
+
+#endif // GCODEINTERPRETER_H
@@ -0,0 +1,71 @@
+#ifndef GCODEMOVE_H
+#define GCODEMOVE_H
+
+#include <QtGlobal>
+
+// Modal state carried from one line to the next, positions and lengths in mm, feed rate in mm/min
+struct GCodeState
+{
+    enum Motion {
+        MotionSeek, // G0
+        MotionLinear, // G1
+        MotionArcClockwise, // G2
+        MotionArcCounterClockwise, // G3
+        MotionNone // G80
+    };
+
+    enum Plane {
+        PlaneXY, // G17
+        PlaneZX, // G18
+        PlaneYZ // G19
+    };
+
+    // Fields set by the program since the state was created, independent of any earlier line
+    enum Field {
+        FieldMotion = 0x01,
+        FieldPlane = 0x02,
+        FieldUnits = 0x04,
+        FieldDistance = 0x08,
+        FieldFeedRate = 0x10,
+        FieldPositionX = 0x20, // Absolute move, Y and Z follow
+        FieldPositionY = 0x40,
+        FieldPositionZ = 0x80
+    };
+
+    Motion motion = MotionSeek;
+    Plane plane = PlaneXY;
+    bool inches = false; // G20 / G21
+    bool absolute = true; // G90 / G91
+    double feedRate = 0;
+    double position[3] = { 0, 0, 0 };
+    quint8 assigned = 0;
+};
+
+// One motion of the program in absolute mm
+struct GCodeMove
+{
+    enum Type {
+        TypeSeek,
+        TypeLinear,
+        TypeArcClockwise,
+        TypeArcCounterClockwise,
+        TypeDwell,
+        TypeProgramEnd
+    };
+
+    Type type = TypeSeek;
+    qint64 lineNumber = 0;
+    double start[3] = { 0, 0, 0 };
+    double target[3] = { 0, 0, 0 };
+    double feedRate = 0; // mm/min
+
+    // Arcs: center offset from the start (I, J, K) or the radius (R), in the plane of the state
+    GCodeState::Plane plane = GCodeState::PlaneXY;
+    double offset[3] = { 0, 0, 0 };
+    double radius = 0;
+    bool hasRadius = false;
+
+    double dwell = 0; // s
+};
+
+#endif // GCODEMOVE_H
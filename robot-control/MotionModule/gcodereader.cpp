@@ -0,0 +1,163 @@
+#include "gcodereader.h"
+
+#include <cstring>
+
+GCodeReader::GCodeReader()
+{
+
+}
+
+GCodeReader::~GCodeReader()
+{
+    close();
+}
+
+bool GCodeReader::open(const QString &fileName)
+{
+    close();
+
+    m_file.setFileName(fileName);
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        m_errorString = QString("Could not open %1: %2").arg(fileName, m_file.errorString());
+        return false;
+    }
+
+    m_errorString.clear();
+    m_size = m_file.size();
+    m_offset = 0;
+    m_lineNumber = 1;
+    m_open = true;
+    return true;
+}
+
+void GCodeReader::close()
+{
+    unmapWindow();
+
+    if (m_file.isOpen())
+        m_file.close();
+
+    m_size = 0;
+    m_offset = 0;
+    m_lineNumber = 1;
+    m_open = false;
+}
+
+bool GCodeReader::isOpen() const
+{
+    return m_open;
+}
+
+QString GCodeReader::fileName() const
+{
+    return m_file.fileName();
+}
+
+QString GCodeReader::errorString() const
+{
+    return m_errorString;
+}
+
+bool GCodeReader::hasError() const
+{
+    return !m_errorString.isEmpty();
+}
+
+qint64 GCodeReader::size() const
+{
+    return m_size;
+}
+
+qint64 GCodeReader::offset() const
+{
+    return m_offset;
+}
+
+qint64 GCodeReader::lineNumber() const
+{
+    return m_lineNumber;
+}
+
+bool GCodeReader::atEnd() const
+{
+    return m_offset >= m_size;
+}
+
+void GCodeReader::seek(qint64 offset, qint64 lineNumber)
+{
+    m_offset = qBound<qint64>(0, offset, m_size);
+    m_lineNumber = lineNumber;
+}
+
+bool GCodeReader::readLine(const char **begin, const char **end)
+{
+    if (m_offset >= m_size || hasError())
+        return false;
+
+    qint64 windowEnd = m_windowOffset + m_windowLength;
+    if (!m_window || m_offset < m_windowOffset || m_offset >= windowEnd) {
+        if (!mapWindow(m_offset))
+            return false;
+
+        windowEnd = m_windowOffset + m_windowLength;
+    }
+
+    const char *lineBegin = m_window + (m_offset - m_windowOffset);
+    const char *newLine = static_cast<const char *>(memchr(lineBegin, '\n', windowEnd - m_offset));
+    if (!newLine && windowEnd < m_size) {
+        // The line continues behind the window, move the window to the start of the line
+        if (m_offset == m_windowOffset) {
+            m_errorString = QString("Line %1 is longer than %2 bytes").arg(m_lineNumber).arg(windowSize);
+            return false;
+        }
+
+        if (!mapWindow(m_offset))
+            return false;
+
+        windowEnd = m_windowOffset + m_windowLength;
+        lineBegin = m_window;
+        newLine = static_cast<const char *>(memchr(lineBegin, '\n', m_windowLength));
+        if (!newLine && windowEnd < m_size) {
+            m_errorString = QString("Line %1 is longer than %2 bytes").arg(m_lineNumber).arg(windowSize);
+            return false;
+        }
+    }
+
+    const char *lineEnd = newLine ? newLine : m_window + m_windowLength;
+    m_offset = newLine ? m_windowOffset + (newLine - m_window) + 1 : m_size;
+    m_lineNumber++;
+
+    if (lineEnd > lineBegin && lineEnd[-1] == '\r')
+        lineEnd--;
+
+    *begin = lineBegin;
+    *end = lineEnd;
+    return true;
+}
+
+bool GCodeReader::mapWindow(qint64 offset)
+{
+    unmapWindow();
+
+    qint64 length = qMin(windowSize, m_size - offset);
+    uchar *window = m_file.map(offset, length);
+    if (!window) {
+        m_errorString = QString("Could not map %1: %2").arg(m_file.fileName(), m_file.errorString());
+        return false;
+    }
+
+    m_window = reinterpret_cast<const char *>(window);
+    m_windowOffset = offset;
+    m_windowLength = length;
+    return true;
+}
+
+void GCodeReader::unmapWindow()
+{
+    if (m_window)
+        m_file.unmap(reinterpret_cast<uchar *>(const_cast<char *>(m_window)));
+
+    m_window = nullptr;
+    m_windowOffset = 0;
+    m_windowLength = 0;
+}
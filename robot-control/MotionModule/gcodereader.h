@@ -0,0 +1,58 @@
+#ifndef GCODEREADER_H
+#define GCODEREADER_H
+
+#include <QFile>
+#include <QString>
+
+// Line reader on top of a memory mapped program file. Only a window of the file is mapped at a time and moved
+// along while the lines are consumed, so opening does not read anything and the memory needed does not depend
+// on the program size. Lines point directly into the mapping and stay valid until the next readLine() or seek().
+class GCodeReader
+{
+public:
+    // Size of the mapped window, also the longest line supported
+    static constexpr qint64 windowSize = 16 * 1024 * 1024;
+
+    GCodeReader();
+    ~GCodeReader();
+
+    bool open(const QString &fileName);
+    void close();
+    bool isOpen() const;
+
+    QString fileName() const;
+    QString errorString() const;
+    bool hasError() const;
+
+    qint64 size() const;
+
+    // Position of the next line, line numbers start at 1
+    qint64 offset() const;
+    qint64 lineNumber() const;
+    bool atEnd() const;
+
+    // Continues reading at the start of a line, the line number is the one of that line
+    void seek(qint64 offset, qint64 lineNumber);
+
+    // The next line without the line ending, returns false at the end of the file or on an error
+    bool readLine(const char **begin, const char **end);
+
+private:
+    QFile m_file;
+    QString m_errorString;
+    bool m_open = false;
+    qint64 m_size = 0;
+
+    const char *m_window = nullptr;
+    qint64 m_windowOffset = 0;
+    qint64 m_windowLength = 0;
+
+    qint64 m_offset = 0;
+    qint64 m_lineNumber = 1;
+
+    bool mapWindow(qint64 offset);
+    void unmapWindow();
+
+};
+
+#endif // GCODEREADER_H
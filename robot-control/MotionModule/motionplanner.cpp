@@ -0,0 +1,350 @@
+#include "motionplanner.h"
+
+#include <cmath>
+
+Q_LOGGING_CATEGORY(dcMotionPlanner, "MotionPlanner")
+
+// Junction speed used for straight continuations, large enough to never be the limiting factor
+static const double junctionSpeedUnlimited = 1.0e38;
+
+MotionPlanner::MotionPlanner()
+{
+
+}
+
+double MotionPlanner::maxSpeed(int axis) const
+{
+    return m_maxSpeed[axis];
+}
+
+void MotionPlanner::setMaxSpeed(int axis, double maxSpeed)
+{
+    m_maxSpeed[axis] = maxSpeed;
+}
+
+double MotionPlanner::acceleration(int axis) const
+{
+    return m_acceleration[axis];
+}
+
+void MotionPlanner::setAcceleration(int axis, double acceleration)
+{
+    m_acceleration[axis] = acceleration;
+}
+
+double MotionPlanner::junctionDeviation() const
+{
+    return m_junctionDeviation;
+}
+
+void MotionPlanner::setJunctionDeviation(double junctionDeviation)
+{
+    m_junctionDeviation = junctionDeviation;
+}
+
+double MotionPlanner::minimumJunctionSpeed() const
+{
+    return m_minimumJunctionSpeed;
+}
+
+void MotionPlanner::setMinimumJunctionSpeed(double minimumJunctionSpeed)
+{
+    m_minimumJunctionSpeed = minimumJunctionSpeed;
+}
+
+void MotionPlanner::reset(const qint32 position[3])
+{
+    m_blocks.clear();
+    m_plannedIndex = 0;
+    for (int i = 0; i < 3; i++) {
+        m_position[i] = position[i];
+        m_previousUnitVector[i] = 0;
+    }
+    m_previousNominalSpeed = 0;
+}
+
+const qint32 *MotionPlanner::position() const
+{
+    return m_position;
+}
+
+bool MotionPlanner::bufferLine(const qint32 target[3], double feedRate)
+{
+    MotionPlannerBlock block;
+
+    double lengthSqr = 0;
+    for (int i = 0; i < 3; i++) {
+        block.target[i] = target[i];
+        block.steps[i] = target[i] - m_position[i];
+        quint32 steps = static_cast<quint32>(std::abs(block.steps[i]));
+        if (steps > block.stepEventCount)
+            block.stepEventCount = steps;
+
+        lengthSqr += static_cast<double>(block.steps[i]) * block.steps[i];
+    }
+
+    if (block.stepEventCount == 0)
+        return false;
+
+    block.length = std::sqrt(lengthSqr);
+    for (int i = 0; i < 3; i++) {
+        block.unitVector[i] = block.steps[i] / block.length;
+    }
+
+    block.acceleration = limitByAxisMaximum(m_acceleration, block.unitVector);
+    block.nominalSpeed = std::min(feedRate, limitByAxisMaximum(m_maxSpeed, block.unitVector));
+
+    if (m_blocks.isEmpty()) {
+        // Nothing queued to continue from, start from standstill
+        block.maxJunctionSpeedSqr = 0;
+    } else {
+        // Junction deviation: the speed through the corner is limited by the centripetal acceleration on
+        // a circle which touches both lines and stays within the junction deviation of the corner.
+        double junctionCosTheta = 0;
+        for (int i = 0; i < 3; i++) {
+            junctionCosTheta -= m_previousUnitVector[i] * block.unitVector[i];
+        }
+
+        if (junctionCosTheta > 0.999999) {
+            // Reversal
+            block.maxJunctionSpeedSqr = m_minimumJunctionSpeed * m_minimumJunctionSpeed;
+        } else if (junctionCosTheta < -0.999999) {
+            // Straight line
+            block.maxJunctionSpeedSqr = junctionSpeedUnlimited;
+        } else {
+            double junctionUnitVector[3];
+            double junctionLength = 0;
+            for (int i = 0; i < 3; i++) {
+                junctionUnitVector[i] = block.unitVector[i] - m_previousUnitVector[i];
+                junctionLength += junctionUnitVector[i] * junctionUnitVector[i];
+            }
+            junctionLength = std::sqrt(junctionLength);
+            for (int i = 0; i < 3; i++) {
+                junctionUnitVector[i] /= junctionLength;
+            }
+
+            double junctionAcceleration = limitByAxisMaximum(m_acceleration, junctionUnitVector);
+            double sinThetaD2 = std::sqrt(0.5 * (1.0 - junctionCosTheta));
+            block.maxJunctionSpeedSqr = std::max(m_minimumJunctionSpeed * m_minimumJunctionSpeed,
+                                                 (junctionAcceleration * m_junctionDeviation * sinThetaD2) / (1.0 - sinThetaD2));
+        }
+    }
+
+    double nominalSpeedSqr = std::min(block.nominalSpeed, m_previousNominalSpeed);
+    nominalSpeedSqr *= nominalSpeedSqr;
+    block.maxEntrySpeedSqr = std::min(block.maxJunctionSpeedSqr, nominalSpeedSqr);
+
+    m_blocks.append(block);
+
+    for (int i = 0; i < 3; i++) {
+        m_position[i] = target[i];
+        m_previousUnitVector[i] = block.unitVector[i];
+    }
+    m_previousNominalSpeed = block.nominalSpeed;
+
+    recalculate();
+    return true;
+}
+
+void MotionPlanner::bufferDwell(double seconds)
+{
+    MotionPlannerBlock block;
+    for (int i = 0; i < 3; i++) {
+        block.target[i] = m_position[i];
+        m_previousUnitVector[i] = 0;
+    }
+    block.dwell = seconds;
+
+    // Entry speeds stay 0 around it: nothing can be entered faster than the nominal speed of the block before
+    m_blocks.append(block);
+    m_previousNominalSpeed = 0;
+
+    recalculate();
+}
+
+int MotionPlanner::blockCount() const
+{
+    return m_blocks.size();
+}
+
+int MotionPlanner::plannedIndex() const
+{
+    return m_plannedIndex;
+}
+
+bool MotionPlanner::isEmpty() const
+{
+    return m_blocks.isEmpty();
+}
+
+const MotionPlannerBlock &MotionPlanner::block(int index) const
+{
+    return m_blocks.at(index);
+}
+
+double MotionPlanner::exitSpeedSqr(int index) const
+{
+    // The last block always has to stop, nobody knows what comes next
+    if (index + 1 >= m_blocks.size())
+        return 0;
+
+    return m_blocks.at(index + 1).entrySpeedSqr;
+}
+
+MotionPlannerTrapezoid MotionPlanner::trapezoid(int index) const
+{
+    const MotionPlannerBlock &block = m_blocks.at(index);
+    double exitSpeedSqr = this->exitSpeedSqr(index);
+    double nominalSpeedSqr = block.nominalSpeed * block.nominalSpeed;
+    double twoAcceleration = 2.0 * block.acceleration;
+
+    MotionPlannerTrapezoid trapezoid;
+    if (block.stepEventCount == 0) {
+        trapezoid.duration = block.dwell;
+        return trapezoid;
+    }
+
+    trapezoid.entrySpeed = std::sqrt(block.entrySpeedSqr);
+    trapezoid.exitSpeed = std::sqrt(exitSpeedSqr);
+    trapezoid.accelerateDistance = (nominalSpeedSqr - block.entrySpeedSqr) / twoAcceleration;
+    trapezoid.decelerateDistance = (nominalSpeedSqr - exitSpeedSqr) / twoAcceleration;
+    trapezoid.plateauDistance = block.length - trapezoid.accelerateDistance - trapezoid.decelerateDistance;
+
+    if (trapezoid.plateauDistance < 0) {
+        // Nominal speed can not be reached, the ramps meet in between
+        trapezoid.accelerateDistance = (twoAcceleration * block.length + exitSpeedSqr - block.entrySpeedSqr) / (2.0 * twoAcceleration);
+        trapezoid.accelerateDistance = std::max(0.0, std::min(block.length, trapezoid.accelerateDistance));
+        trapezoid.decelerateDistance = block.length - trapezoid.accelerateDistance;
+        trapezoid.plateauDistance = 0;
+        trapezoid.peakSpeed = std::sqrt(block.entrySpeedSqr + twoAcceleration * trapezoid.accelerateDistance);
+    } else {
+        trapezoid.peakSpeed = block.nominalSpeed;
+    }
+
+    trapezoid.duration = (trapezoid.peakSpeed - trapezoid.entrySpeed) / block.acceleration
+            + (trapezoid.peakSpeed - trapezoid.exitSpeed) / block.acceleration;
+    if (trapezoid.plateauDistance > 0)
+        trapezoid.duration += trapezoid.plateauDistance / trapezoid.peakSpeed;
+
+    return trapezoid;
+}
+
+bool MotionPlanner::takeSegment(MotionPlannerSegment *segment)
+{
+    if (m_blocks.isEmpty())
+        return false;
+
+    *segment = segmentForBlock(m_blocks.first(), exitSpeedSqr(0));
+    m_blocks.removeFirst();
+    if (m_plannedIndex > 0)
+        m_plannedIndex--;
+
+    return true;
+}
+
+MotionPlannerSegment MotionPlanner::segmentForBlock(const MotionPlannerBlock &block, double exitSpeedSqr)
+{
+    MotionPlannerSegment segment;
+    for (int i = 0; i < 3; i++) {
+        segment.target[i] = block.target[i];
+    }
+
+    if (block.stepEventCount == 0) {
+        segment.dwell = true;
+        segment.dwellTime = block.dwell;
+        return segment;
+    }
+
+    // The firmware ramps the dominant axis, scale the path values down to it
+    double scale = block.stepEventCount / block.length;
+
+    double acceleration = block.acceleration * scale;
+    segment.acceleration = static_cast<quint16>(std::max(1.0, std::min(65535.0, std::floor(acceleration))));
+    segment.maxSpeed = static_cast<quint16>(std::max(1.0, std::min(65535.0, std::round(block.nominalSpeed * scale))));
+
+    // n = v^2 / (2 * a) of the dominant axis, rounded down so the firmware never enters too fast
+    double indexScale = scale * scale / (2.0 * segment.acceleration);
+    segment.entryIndex = static_cast<quint16>(std::min(65535.0, std::floor(block.entrySpeedSqr * indexScale)));
+    segment.exitIndex = static_cast<quint16>(std::min(65535.0, std::floor(exitSpeedSqr * indexScale)));
+    return segment;
+}
+
+double MotionPlanner::distanceAt(const MotionPlannerTrapezoid &trapezoid, double acceleration, double time)
+{
+    double accelerateTime = (trapezoid.peakSpeed - trapezoid.entrySpeed) / acceleration;
+    if (time <= accelerateTime)
+        return trapezoid.entrySpeed * time + 0.5 * acceleration * time * time;
+
+    double distance = trapezoid.accelerateDistance;
+    time -= accelerateTime;
+
+    double plateauTime = trapezoid.plateauDistance > 0 ? trapezoid.plateauDistance / trapezoid.peakSpeed : 0;
+    if (time <= plateauTime)
+        return distance + trapezoid.peakSpeed * time;
+
+    distance += trapezoid.plateauDistance;
+    time -= plateauTime;
+
+    double decelerateTime = (trapezoid.peakSpeed - trapezoid.exitSpeed) / acceleration;
+    time = std::min(time, decelerateTime);
+    return distance + trapezoid.peakSpeed * time - 0.5 * acceleration * time * time;
+}
+
+void MotionPlanner::recalculate()
+{
+    // planner_recalculate(): walk back from the last block, which has to be able to stop, and raise
+    // every entry speed as far as the block after it allows. Nothing before the planned block can change.
+    int last = m_blocks.size() - 1;
+    if (last <= m_plannedIndex)
+        return;
+
+    MotionPlannerBlock *current = &m_blocks[last];
+    current->entrySpeedSqr = std::min(current->maxEntrySpeedSqr, 2.0 * current->acceleration * current->length);
+
+    int index = last - 1;
+    for (; index > m_plannedIndex; index--) {
+        MotionPlannerBlock *next = current;
+        current = &m_blocks[index];
+        if (current->entrySpeedSqr == current->maxEntrySpeedSqr)
+            continue;
+
+        double entrySpeedSqr = std::min(current->maxEntrySpeedSqr, next->entrySpeedSqr + 2.0 * current->acceleration * current->length);
+
+        // Unchanged entry speed: the ones in front of it were planned against exactly this value
+        if (entrySpeedSqr == current->entrySpeedSqr)
+            break;
+
+        current->entrySpeedSqr = entrySpeedSqr;
+    }
+
+    // Forward pass: a block can not be entered faster than the one before can accelerate to. Blocks at
+    // their maximum entry speed or limited by accelerating out of a planned block are done for good.
+    for (; index < last; index++) {
+        const MotionPlannerBlock &current = m_blocks.at(index);
+        MotionPlannerBlock &next = m_blocks[index + 1];
+        if (current.entrySpeedSqr < next.entrySpeedSqr) {
+            double reachableSpeedSqr = current.entrySpeedSqr + 2.0 * current.acceleration * current.length;
+            if (reachableSpeedSqr < next.entrySpeedSqr) {
+                next.entrySpeedSqr = reachableSpeedSqr;
+                m_plannedIndex = index + 1;
+            }
+        }
+
+        if (next.entrySpeedSqr == next.maxEntrySpeedSqr) {
+            m_plannedIndex = index + 1;
+        }
+    }
+}
+
+double MotionPlanner::limitByAxisMaximum(const double maxValues[3], const double unitVector[3])
+{
+    // Largest value along the direction which keeps every axis within its own maximum
+    double limit = junctionSpeedUnlimited;
+    for (int i = 0; i < 3; i++) {
+        if (unitVector[i] != 0) {
+            limit = std::min(limit, std::fabs(maxValues[i] / unitVector[i]));
+        }
+    }
+
+    return limit;
+}
@@ -0,0 +1,132 @@
+#ifndef MOTIONPLANNER_H
+#define MOTIONPLANNER_H
+
+#include <QList>
+#include <QLoggingCategory>
+
+Q_DECLARE_LOGGING_CATEGORY(dcMotionPlanner)
+
+// Motion is planned in machine space: positions in steps, speeds in steps/s and accelerations in steps/s^2.
+// Lengths and speeds are measured along the path (euclidean over all axes).
+struct MotionPlannerBlock
+{
+    qint32 target[3] = { 0, 0, 0 };
+    qint32 steps[3] = { 0, 0, 0 }; // Relative, signed
+    quint32 stepEventCount = 0; // Steps of the dominant axis
+
+    double unitVector[3] = { 0, 0, 0 };
+    double length = 0; // steps
+    double acceleration = 0; // steps/s^2
+    double nominalSpeed = 0; // steps/s
+
+    // Squared speeds at the start of the block
+    double entrySpeedSqr = 0;
+    double maxEntrySpeedSqr = 0; // Limited by the junction, this and the previous nominal speed
+    double maxJunctionSpeedSqr = 0;
+
+    double dwell = 0; // s, a dwell block stands still at the previous target and has no steps
+};
+
+// Speed profile of one block, derived from its entry and exit speed
+struct MotionPlannerTrapezoid
+{
+    double accelerateDistance = 0; // steps
+    double plateauDistance = 0;
+    double decelerateDistance = 0;
+    double entrySpeed = 0; // steps/s
+    double peakSpeed = 0;
+    double exitSpeed = 0;
+    double duration = 0; // s
+};
+
+// Block converted for CommandMoveSegment: speeds and accelerations refer to the dominant axis,
+// entry and exit speeds are given as ramp index n = v^2 / (2 * a)
+struct MotionPlannerSegment
+{
+    qint32 target[3] = { 0, 0, 0 };
+    quint16 acceleration = 0;
+    quint16 maxSpeed = 0;
+    quint16 entryIndex = 0;
+    quint16 exitIndex = 0;
+
+    // A dwell is not sent: wait until the firmware queue ran empty, then for the dwell time
+    bool dwell = false;
+    double dwellTime = 0; // s
+};
+
+// Look-ahead planner following the GRBL planner: every new line limits the speed through the junction
+// with the previous one (junction deviation), a reverse and a forward pass over the queued blocks
+// then find the highest entry speeds which still allow stopping at the end of the queue.
+// The queue has no size limit, the first block is the next one to be executed and its entry speed is fixed.
+//
+// Replanning is incremental: blocks up to the planned index can not get faster any more no matter what gets
+// appended (they run at their maximum entry speed or are limited by accelerating from a fixed block), so only
+// the tail behind it is walked, and the reverse pass stops at the first block whose entry speed does not change.
+class MotionPlanner
+{
+public:
+    MotionPlanner();
+
+    // Per axis limits, the limit along a line is the tightest one of the axes involved
+    double maxSpeed(int axis) const;
+    void setMaxSpeed(int axis, double maxSpeed);
+
+    double acceleration(int axis) const;
+    void setAcceleration(int axis, double acceleration);
+
+    // Distance [steps] the path may deviate from a sharp corner while passing it without stopping
+    double junctionDeviation() const;
+    void setJunctionDeviation(double junctionDeviation);
+
+    double minimumJunctionSpeed() const;
+    void setMinimumJunctionSpeed(double minimumJunctionSpeed);
+
+    // Drops all blocks and continues planning from the given position
+    void reset(const qint32 position[3]);
+    const qint32 *position() const;
+
+    // plan_buffer_line(): queue a line to the absolute target with the feed rate [steps/s] and replan.
+    // Returns false if the line has no length.
+    bool bufferLine(const qint32 target[3], double feedRate);
+
+    // G4: queue a block standing still for the given time, the block before it has to come to a stop
+    void bufferDwell(double seconds);
+
+    int blockCount() const;
+    int plannedIndex() const;
+    bool isEmpty() const;
+    const MotionPlannerBlock &block(int index) const;
+
+    double exitSpeedSqr(int index) const;
+    MotionPlannerTrapezoid trapezoid(int index) const;
+
+    // Removes the first block and converts it for the firmware, the next block entry speed is fixed from now on.
+    // The firmware can not wait, a dwell block becomes a segment flagged as dwell for the streamer.
+    bool takeSegment(MotionPlannerSegment *segment);
+
+    static MotionPlannerSegment segmentForBlock(const MotionPlannerBlock &block, double exitSpeedSqr);
+
+    // Distance [steps] along a block after the given time [s] since its start
+    static double distanceAt(const MotionPlannerTrapezoid &trapezoid, double acceleration, double time);
+
+private:
+    double m_maxSpeed[3] = { 1000, 1000, 1000 };
+    double m_acceleration[3] = { 2000, 2000, 2000 };
+    double m_junctionDeviation = 2;
+    double m_minimumJunctionSpeed = 0;
+
+    QList<MotionPlannerBlock> m_blocks;
+    int m_plannedIndex = 0; // Last block with an optimal plan, GRBL's block_buffer_planned
+
+    // Planner position, the end of the last queued line
+    qint32 m_position[3] = { 0, 0, 0 };
+    double m_previousUnitVector[3] = { 0, 0, 0 };
+    double m_previousNominalSpeed = 0;
+
+    void recalculate();
+
+    static double limitByAxisMaximum(const double maxValues[3], const double unitVector[3]);
+
+};
+
+#endif // MOTIONPLANNER_H
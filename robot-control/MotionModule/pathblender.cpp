@@ -0,0 +1,237 @@
+#include "pathblender.h"
+#include "pathsimplifier.h"
+
+#include <cmath>
+#include <algorithm>
+
+static const double degreesToRadians = M_PI / 180.0;
+
+static double moveLength(const GCodeMove &move)
+{
+    double lengthSqr = 0;
+    for (int i = 0; i < 3; i++)
+        lengthSqr += (move.target[i] - move.start[i]) * (move.target[i] - move.start[i]);
+
+    return std::sqrt(lengthSqr);
+}
+
+// Angle between two directions of any length [rad]
+static double angleBetween(const double a[3], const double b[3])
+{
+    double dot = 0;
+    double aSqr = 0;
+    double bSqr = 0;
+    for (int i = 0; i < 3; i++) {
+        dot += a[i] * b[i];
+        aSqr += a[i] * a[i];
+        bSqr += b[i] * b[i];
+    }
+
+    if (aSqr <= 0 || bSqr <= 0)
+        return M_PI;
+
+    return std::acos(qBound(-1.0, dot / std::sqrt(aSqr * bSqr), 1.0));
+}
+
+PathBlender::PathBlender(double tolerance) :
+    m_tolerance(tolerance)
+{
+
+}
+
+double PathBlender::tolerance() const
+{
+    return m_tolerance;
+}
+
+void PathBlender::setTolerance(double tolerance)
+{
+    m_tolerance = tolerance;
+}
+
+double PathBlender::chordTolerance() const
+{
+    return m_chordTolerance;
+}
+
+void PathBlender::setChordTolerance(double chordTolerance)
+{
+    m_chordTolerance = chordTolerance;
+}
+
+void PathBlender::push(const GCodeMove &move)
+{
+    // Nothing to wait for without blending
+    if (m_tolerance <= 0 && !m_hasPending) {
+        append(move);
+        return;
+    }
+
+    GCodeMove next = move;
+    double length = moveLength(move);
+    if (m_hasPending && !blend(&next, length))
+        append(m_pending);
+
+    m_pending = next;
+    m_pendingLength = length;
+    m_hasPending = true;
+}
+
+void PathBlender::flush()
+{
+    if (!m_hasPending)
+        return;
+
+    append(m_pending);
+    m_hasPending = false;
+}
+
+bool PathBlender::takeSegment(GCodeMove *segment)
+{
+    if (m_segments.isEmpty())
+        return false;
+
+    *segment = m_segments.takeFirst();
+    return true;
+}
+
+void PathBlender::reset()
+{
+    m_hasPending = false;
+    m_pendingLength = 0;
+    m_segments.clear();
+    m_cornerCount = 0;
+    m_outputCount = 0;
+}
+
+qint64 PathBlender::cornerCount() const
+{
+    return m_cornerCount;
+}
+
+qint64 PathBlender::outputCount() const
+{
+    return m_outputCount;
+}
+
+bool PathBlender::blend(GCodeMove *next, double length)
+{
+    if (m_tolerance <= 0 || next->type != m_pending.type)
+        return false;
+
+    if (next->type != GCodeMove::TypeLinear && next->type != GCodeMove::TypeSeek)
+        return false;
+
+    // The pending line is at least half of its original length
+    double pendingLength = moveLength(m_pending);
+    if (pendingLength <= 0 || length <= 0)
+        return false;
+
+    const double *corner = m_pending.target;
+    double incoming[3];
+    double outgoing[3];
+    double differenceSqr = 0;
+    for (int i = 0; i < 3; i++) {
+        incoming[i] = (m_pending.target[i] - m_pending.start[i]) / pendingLength;
+        outgoing[i] = (next->target[i] - next->start[i]) / length;
+        differenceSqr += (outgoing[i] - incoming[i]) * (outgoing[i] - incoming[i]);
+    }
+
+    double angle = angleBetween(incoming, outgoing);
+    if (angle < minCornerAngle * degreesToRadians || angle > maxCornerAngle * degreesToRadians)
+        return false;
+
+    // The middle of the curve gets the tolerance without the error of the chords
+    double chordTolerance = std::min(m_chordTolerance, m_tolerance / 2);
+    double distance = 64.0 / 7.0 * (m_tolerance - chordTolerance) / std::sqrt(differenceSqr);
+    distance = std::min({ distance, m_pendingLength / 2, length / 2 });
+
+    double controlPoints[6][3];
+    for (int i = 0; i < 3; i++) {
+        controlPoints[0][i] = corner[i] - distance * incoming[i];
+        controlPoints[1][i] = corner[i] - distance / 2 * incoming[i];
+        controlPoints[2][i] = corner[i];
+        controlPoints[3][i] = corner[i];
+        controlPoints[4][i] = corner[i] + distance / 2 * outgoing[i];
+        controlPoints[5][i] = corner[i] + distance * outgoing[i];
+    }
+
+    // Adaptive subdivision: a piece gets split as long as the middle of its curve is too far from its chord, so the
+    // straight ends of the blend take few pieces and its tight middle many
+    m_points.resize(3);
+    std::copy(controlPoints[0], controlPoints[0] + 3, m_points.begin());
+    double intervals[maxSubdivisionDepth + 1][2];
+    intervals[0][0] = 0;
+    intervals[0][1] = 1;
+    int intervalCount = 1;
+    double start[3];
+    std::copy(controlPoints[0], controlPoints[0] + 3, start);
+    while (intervalCount > 0) {
+        intervalCount--;
+        double from = intervals[intervalCount][0];
+        double to = intervals[intervalCount][1];
+        double middle[3];
+        double end[3];
+        bezierPoint(controlPoints, (from + to) / 2, middle);
+        bezierPoint(controlPoints, to, end);
+
+        if (to - from > 1.0 / (1 << maxSubdivisionDepth) && PathSimplifier::distanceToSegment(middle, start, end) > chordTolerance) {
+            // The first half gets handled first
+            intervals[intervalCount][0] = (from + to) / 2;
+            intervals[intervalCount][1] = to;
+            intervals[intervalCount + 1][0] = from;
+            intervals[intervalCount + 1][1] = (from + to) / 2;
+            intervalCount += 2;
+            continue;
+        }
+
+        m_points.append(end[0]);
+        m_points.append(end[1]);
+        m_points.append(end[2]);
+        std::copy(end, end + 3, start);
+    }
+    int pieces = static_cast<int>(m_points.count()) / 3 - 1;
+
+    // The rest of the pending line, nothing is left if both blends took half of it
+    GCodeMove segment = m_pending;
+    std::copy(controlPoints[0], controlPoints[0] + 3, segment.target);
+    if (pendingLength - distance > 1e-9)
+        append(segment);
+
+    segment.feedRate = std::min(m_pending.feedRate, next->feedRate);
+    const double *points = m_points.constData();
+    for (int k = 1; k <= pieces; k++) {
+        std::copy(points + 3 * (k - 1), points + 3 * k, segment.start);
+        std::copy(points + 3 * k, points + 3 * (k + 1), segment.target);
+        append(segment);
+    }
+
+    std::copy(controlPoints[5], controlPoints[5] + 3, next->start);
+    m_cornerCount++;
+    return true;
+}
+
+void PathBlender::append(const GCodeMove &segment)
+{
+    m_segments.append(segment);
+    m_outputCount++;
+}
+
+void PathBlender::bezierPoint(const double controlPoints[6][3], double t, double point[3])
+{
+    double s = 1 - t;
+    double weights[6] = {
+        s * s * s * s * s,
+        5 * t * s * s * s * s,
+        10 * t * t * s * s * s,
+        10 * t * t * t * s * s,
+        5 * t * t * t * t * s,
+        t * t * t * t * t
+    };
+
+    for (int i = 0; i < 3; i++) {
+        point[i] = 0;
+        for (int k = 0; k < 6; k++)
+            point[i] += weights[k] * controlPoints[k][i];
+    }
+}
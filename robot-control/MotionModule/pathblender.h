@@ -0,0 +1,76 @@
+#ifndef PATHBLENDER_H
+#define PATHBLENDER_H
+
+#include <QList>
+
+#include "gcodemove.h"
+
+// Streaming corner blending between the G-code interpreter and the planner. The corner between two linear moves of
+// the same kind gets replaced by a quintic Bezier curve within the corner tolerance, so the planner carries speed
+// through it instead of slowing down to the junction speed of a sharp corner.
+//
+// The control points of the blend lie on the two lines, three on each: P0, P1 = C - d * u1 / 2, P2 = P3 = C, P4 and
+// P5 = C + d * u2 for the corner C and the directions u1, u2 of the lines. The curve leaves and enters the lines
+// tangentially and with zero curvature, and its closest point to the corner is its middle at a distance of
+// 7 / 64 * d * |u2 - u1|, which sets d for the tolerance less the chord tolerance. A blend takes at most half of
+// each line. The curve gets linearized into pieces within the chord tolerance, like arcs. The junction deviation of
+// the planner models a corner as a circle, so it passes the joint between two pieces at about the speed the curvature
+// allows if their sagitta is about the junction deviation: the default of 0.01 mm goes with 2 steps at 100 steps/mm.
+//
+// Corners turning by less than minCornerAngle are left alone, the planner passes them at speed anyway, and reversals
+// turning by more than maxCornerAngle as well, like the pick and place of a part where the move has to stop.
+//
+// Moves are pushed one by one and the segments taken out afterwards, a line is only complete once the next one is
+// known. The blend keeps the line number of the line leading into the corner, so resuming at that line repeats it.
+class PathBlender
+{
+public:
+    static constexpr double minCornerAngle = 2.0; // degrees
+    static constexpr double maxCornerAngle = 170.0;
+    static constexpr int maxSubdivisionDepth = 8; // At most 256 pieces per blend
+
+    explicit PathBlender(double tolerance = 0.05);
+
+    // Largest distance between a corner and its blend [mm], 0 disables blending
+    double tolerance() const;
+    void setTolerance(double tolerance);
+
+    // Largest distance between the curve and the pieces, at most half the tolerance [mm]
+    double chordTolerance() const;
+    void setChordTolerance(double chordTolerance);
+
+    void push(const GCodeMove &move);
+
+    // Completes the last move at the end of the program
+    void flush();
+
+    bool takeSegment(GCodeMove *segment);
+
+    void reset();
+
+    qint64 cornerCount() const;
+    qint64 outputCount() const;
+
+private:
+    double m_tolerance = 0.05;
+    double m_chordTolerance = 0.01;
+
+    // The line waiting for the next one, its start is already moved behind the previous blend
+    bool m_hasPending = false;
+    GCodeMove m_pending;
+    double m_pendingLength = 0;
+
+    QList<GCodeMove> m_segments;
+    QList<double> m_points; // x, y, z of the pieces of the blend
+
+    qint64 m_cornerCount = 0;
+    qint64 m_outputCount = 0;
+
+    bool blend(GCodeMove *next, double length);
+    void append(const GCodeMove &segment);
+
+    static void bezierPoint(const double controlPoints[6][3], double t, double point[3]);
+
+};
+
+#endif // PATHBLENDER_H
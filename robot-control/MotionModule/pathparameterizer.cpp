@@ -0,0 +1,370 @@
+#include "pathparameterizer.h"
+
+#include <QElapsedTimer>
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+Q_LOGGING_CATEGORY(dcPathParameterizer, "PathParameterizer")
+
+// Samples closer than this along the path get dropped [steps]
+static const double minimumSampleDistance = 1.0;
+
+// Largest speed [steps/s] and acceleration [steps/s^2] of a segment
+static const double maxSegmentValue = 65535;
+
+// Largest ramp index of a segment, half of 16 bits so rounding the acceleration down to whole steps/s^2 can not
+// overflow it
+static const double maxRampIndex = 32767;
+
+// a * x + b * u <= c
+struct LinearConstraint
+{
+    double a = 0;
+    double b = 0;
+    double c = 0;
+};
+
+// The joint limits at one sample, 2 per joint, and the 2 of the next controllable set
+struct SampleConstraints
+{
+    LinearConstraint constraints[8];
+    int count = 0;
+    double maxSpeedSqr = 0;
+
+    void add(double a, double b, double c)
+    {
+        constraints[count].a = a;
+        constraints[count].b = b;
+        constraints[count].c = c;
+        count++;
+    }
+};
+
+// Range of u allowed at x, empty if the lower end is above the upper one
+static void accelerationRange(const SampleConstraints &sample, double x, double *lower, double *upper)
+{
+    *lower = -std::numeric_limits<double>::infinity();
+    *upper = std::numeric_limits<double>::infinity();
+    for (int k = 0; k < sample.count; k++) {
+        const LinearConstraint &constraint = sample.constraints[k];
+        double bound = constraint.c - constraint.a * x;
+        if (constraint.b > 0) {
+            *upper = std::min(*upper, bound / constraint.b);
+        } else if (constraint.b < 0) {
+            *lower = std::max(*lower, bound / constraint.b);
+        } else if (bound < 0) {
+            *lower = std::numeric_limits<double>::infinity();
+            *upper = -std::numeric_limits<double>::infinity();
+            return;
+        }
+    }
+}
+
+static bool isFeasible(const SampleConstraints &sample, double x)
+{
+    double lower, upper;
+    accelerationRange(sample, x, &lower, &upper);
+    return lower <= upper + 1e-9 * (std::fabs(lower) + std::fabs(upper) + 1);
+}
+
+// The LP max x subject to the constraints and 0 <= x <= maxSpeedSqr. The feasible x form an interval whose ends lie
+// where a lower and an upper bound of u cross, or at a bound of x itself, so those are the only candidates.
+static double maxFeasibleSpeedSqr(const SampleConstraints &sample)
+{
+    double upperX = sample.maxSpeedSqr;
+    for (int k = 0; k < sample.count; k++) {
+        const LinearConstraint &constraint = sample.constraints[k];
+        if (constraint.b == 0 && constraint.a > 0)
+            upperX = std::min(upperX, constraint.c / constraint.a);
+    }
+
+    if (upperX < 0)
+        return -1;
+
+    if (isFeasible(sample, upperX))
+        return upperX;
+
+    double best = isFeasible(sample, 0) ? 0 : -1;
+    for (int p = 0; p < sample.count; p++) {
+        const LinearConstraint &lower = sample.constraints[p];
+        if (lower.b >= 0)
+            continue;
+
+        for (int q = 0; q < sample.count; q++) {
+            const LinearConstraint &upper = sample.constraints[q];
+            if (upper.b <= 0)
+                continue;
+
+            double slope = upper.a / upper.b - lower.a / lower.b;
+            if (slope == 0)
+                continue;
+
+            double x = (upper.c / upper.b - lower.c / lower.b) / slope;
+            if (x > best && x <= upperX && isFeasible(sample, x))
+                best = x;
+        }
+    }
+
+    return best;
+}
+
+PathParameterizer::PathParameterizer()
+{
+
+}
+
+double PathParameterizer::maxSpeed(int axis) const
+{
+    return m_maxSpeed[axis];
+}
+
+void PathParameterizer::setMaxSpeed(int axis, double maxSpeed)
+{
+    m_maxSpeed[axis] = maxSpeed;
+}
+
+double PathParameterizer::acceleration(int axis) const
+{
+    return m_acceleration[axis];
+}
+
+void PathParameterizer::setAcceleration(int axis, double acceleration)
+{
+    m_acceleration[axis] = acceleration;
+}
+
+void PathParameterizer::setLimits(const MotionPlanner &planner)
+{
+    for (int i = 0; i < 3; i++) {
+        m_maxSpeed[i] = planner.maxSpeed(i);
+        m_acceleration[i] = planner.acceleration(i);
+    }
+}
+
+bool PathParameterizer::parameterize(const double *const positions[3], int count, const double *speedLimits)
+{
+    clear();
+
+    QElapsedTimer timer;
+    timer.start();
+
+    QList<double> limits;
+    for (int k = 0; k < count; k++) {
+        if (k > 0) {
+            int last = static_cast<int>(m_pathPositions.count()) - 1;
+            double distanceSqr = 0;
+            for (int i = 0; i < 3; i++) {
+                double distance = positions[i][k] - m_positions[i].at(last);
+                distanceSqr += distance * distance;
+            }
+
+            // The last sample is the end of the path, it replaces the one before if they are too close
+            double distance = std::sqrt(distanceSqr);
+            if (distance < minimumSampleDistance) {
+                if (k < count - 1 || last == 0)
+                    continue;
+
+                for (int i = 0; i < 3; i++)
+                    m_positions[i].removeLast();
+                m_pathPositions.removeLast();
+                limits.removeLast();
+                last--;
+
+                distanceSqr = 0;
+                for (int i = 0; i < 3; i++) {
+                    double distance = positions[i][k] - m_positions[i].at(last);
+                    distanceSqr += distance * distance;
+                }
+                distance = std::sqrt(distanceSqr);
+            }
+
+            m_pathPositions.append(m_pathPositions.at(last) + distance);
+        } else {
+            m_pathPositions.append(0);
+        }
+
+        for (int i = 0; i < 3; i++)
+            m_positions[i].append(positions[i][k]);
+        limits.append(speedLimits ? speedLimits[k] : std::numeric_limits<double>::infinity());
+    }
+
+    int samples = static_cast<int>(m_pathPositions.count());
+    if (samples < 2) {
+        clear();
+        m_errorString = QString("The path needs at least two samples a step apart");
+        return false;
+    }
+
+    // Both end samples stand still, a straight move needs a sample in between to get moving
+    if (samples == 2) {
+        for (int i = 0; i < 3; i++)
+            m_positions[i].insert(1, (m_positions[i].at(0) + m_positions[i].at(1)) / 2);
+        m_pathPositions.insert(1, m_pathPositions.at(1) / 2);
+        limits.insert(1, std::min(limits.at(0), limits.at(1)));
+        samples = 3;
+    }
+
+    // Derivatives along the path: central differences inside, one sided at the ends
+    QList<SampleConstraints> constraints(samples);
+    for (int k = 0; k < samples; k++) {
+        int previous = std::max(0, k - 1);
+        int next = std::min(samples - 1, k + 1);
+        SampleConstraints &sample = constraints[k];
+        sample.maxSpeedSqr = limits.at(k) * limits.at(k);
+
+        for (int i = 0; i < 3; i++) {
+            const QList<double> &q = m_positions[i];
+            double first = (q.at(next) - q.at(previous)) / (m_pathPositions.at(next) - m_pathPositions.at(previous));
+            double second = 0;
+            if (k > 0 && k < samples - 1) {
+                double before = m_pathPositions.at(k) - m_pathPositions.at(k - 1);
+                double after = m_pathPositions.at(k + 1) - m_pathPositions.at(k);
+                second = 2 * ((q.at(k + 1) - q.at(k)) / after - (q.at(k) - q.at(k - 1)) / before) / (before + after);
+            }
+
+            // The segments carry speeds and accelerations of the dominant axis in 16 bits
+            double maxSpeed = std::min(m_maxSpeed[i], maxSegmentValue);
+            double acceleration = std::min(m_acceleration[i], maxSegmentValue);
+            if (first != 0)
+                sample.maxSpeedSqr = std::min(sample.maxSpeedSqr, maxSpeed * maxSpeed / (first * first));
+
+            // |q' u + q'' x| <= acceleration
+            sample.add(second, first, acceleration);
+            sample.add(-second, -first, acceleration);
+        }
+    }
+
+    // Backward pass: the controllable sets [0, max] from the end, where the path stops
+    QList<double> controllable(samples);
+    controllable[samples - 1] = 0;
+    for (int k = samples - 2; k >= 0; k--) {
+        SampleConstraints sample = constraints.at(k);
+        double twoDistance = 2 * (m_pathPositions.at(k + 1) - m_pathPositions.at(k));
+        sample.add(1, twoDistance, controllable.at(k + 1));
+        sample.add(-1, -twoDistance, 0);
+
+        // Standing still is always possible, so the set never gets empty
+        controllable[k] = std::max(0.0, maxFeasibleSpeedSqr(sample));
+    }
+
+    // Forward pass: the greatest acceleration keeping the next sample controllable
+    m_speedsSqr.resize(samples);
+    m_speedsSqr[0] = 0;
+    for (int k = 0; k < samples - 1; k++) {
+        double x = m_speedsSqr.at(k);
+        double twoDistance = 2 * (m_pathPositions.at(k + 1) - m_pathPositions.at(k));
+        double lower, upper;
+        accelerationRange(constraints.at(k), x, &lower, &upper);
+
+        double u = std::min(upper, (controllable.at(k + 1) - x) / twoDistance);
+        double next = qBound(0.0, x + twoDistance * u, controllable.at(k + 1));
+        m_speedsSqr[k + 1] = next;
+
+        double speeds = std::sqrt(x) + std::sqrt(next);
+        if (speeds <= 0) {
+            clear();
+            m_errorString = QString("The path can not get moving at sample %1").arg(k);
+            return false;
+        }
+
+        // Uniform acceleration: the distance at the mean speed
+        m_duration += twoDistance / speeds;
+    }
+
+    qCDebug(dcPathParameterizer()) << "Parameterized" << samples << "samples in" << timer.elapsed() << "ms, duration" << m_duration << "s";
+    return true;
+}
+
+QString PathParameterizer::errorString() const
+{
+    return m_errorString;
+}
+
+int PathParameterizer::sampleCount() const
+{
+    return static_cast<int>(m_pathPositions.count());
+}
+
+const double *PathParameterizer::positions(int axis) const
+{
+    return m_positions[axis].constData();
+}
+
+const double *PathParameterizer::pathPositions() const
+{
+    return m_pathPositions.constData();
+}
+
+const double *PathParameterizer::speedsSqr() const
+{
+    return m_speedsSqr.constData();
+}
+
+double PathParameterizer::duration() const
+{
+    return m_duration;
+}
+
+QList<MotionPlannerSegment> PathParameterizer::segments() const
+{
+    QList<MotionPlannerSegment> segments;
+    if (m_speedsSqr.isEmpty())
+        return segments;
+
+    int from = 0;
+    qint32 position[3];
+    for (int i = 0; i < 3; i++)
+        position[i] = static_cast<qint32>(std::lround(m_positions[i].at(0)));
+
+    for (int k = 1; k < m_speedsSqr.count(); k++) {
+        MotionPlannerBlock block;
+        double lengthSqr = 0;
+        for (int i = 0; i < 3; i++) {
+            block.target[i] = static_cast<qint32>(std::lround(m_positions[i].at(k)));
+            block.steps[i] = block.target[i] - position[i];
+            block.stepEventCount = std::max(block.stepEventCount, static_cast<quint32>(std::abs(block.steps[i])));
+            lengthSqr += static_cast<double>(block.steps[i]) * block.steps[i];
+        }
+
+        if (block.stepEventCount == 0)
+            continue;
+
+        // The firmware ramps with the joint limited acceleration along the segment, it reaches the speed of the next
+        // sample at least as early as the profile and holds it. The speeds go as ramp indices at that acceleration,
+        // which have to fit 16 bits: the acceleration is raised for speeds too high for the joint limit.
+        double entrySpeedSqr = m_speedsSqr.at(from);
+        double exitSpeedSqr = m_speedsSqr.at(k);
+        block.length = std::sqrt(lengthSqr);
+        block.entrySpeedSqr = entrySpeedSqr;
+        block.nominalSpeed = std::sqrt(std::max(entrySpeedSqr, exitSpeedSqr));
+        block.acceleration = std::numeric_limits<double>::infinity();
+        for (int i = 0; i < 3; i++) {
+            if (block.steps[i] != 0)
+                block.acceleration = std::min(block.acceleration, std::min(m_acceleration[i], maxSegmentValue) * block.length / std::abs(block.steps[i]));
+        }
+
+        double scale = block.stepEventCount / block.length;
+        double profileAcceleration = std::fabs(exitSpeedSqr - entrySpeedSqr) / (2 * (m_pathPositions.at(k) - m_pathPositions.at(from)));
+        double indexAcceleration = block.nominalSpeed * block.nominalSpeed * scale / (2.0 * maxRampIndex);
+        block.acceleration = std::max({ block.acceleration, profileAcceleration, indexAcceleration });
+        segments.append(MotionPlanner::segmentForBlock(block, exitSpeedSqr));
+
+        for (int i = 0; i < 3; i++)
+            position[i] = block.target[i];
+        from = k;
+    }
+
+    return segments;
+}
+
+void PathParameterizer::clear()
+{
+    m_errorString.clear();
+    for (int i = 0; i < 3; i++)
+        m_positions[i].clear();
+    m_pathPositions.clear();
+    m_speedsSqr.clear();
+    m_duration = 0;
+}
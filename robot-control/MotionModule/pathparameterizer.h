@@ -0,0 +1,70 @@
+#ifndef PATHPARAMETERIZER_H
+#define PATHPARAMETERIZER_H
+
+#include <QList>
+#include <QString>
+#include <QLoggingCategory>
+
+#include "motionplanner.h"
+
+Q_DECLARE_LOGGING_CATEGORY(dcPathParameterizer)
+
+// Time optimal parameterization of a sampled path by reachability analysis (TOPP-RA, Pham and Pham 2018), an
+// alternative to the trapezoids of the MotionPlanner for curved paths.
+//
+// The path runs through the samples in machine space (steps), its parameter s is the length along them. Its first
+// and second derivative at each sample come from finite differences, so every joint gets its velocity and acceleration
+// limit at each sample as linear constraints on the squared path speed x = ds/dt^2 and the path acceleration
+// u = d2s/dt2. Between two samples u is constant, so x changes by 2 * u * ds.
+//
+// A backward pass finds the controllable set of each sample, the range of x from which the path can still come to a
+// stop at its end. A forward pass then starts from standstill and takes the largest u at each sample which keeps x
+// within the next controllable set. Both passes solve a two variable LP per sample, so the runtime is linear in
+// the number of samples.
+class PathParameterizer
+{
+public:
+    PathParameterizer();
+
+    // Per joint limits in steps/s and steps/s^2, like the planner has them
+    double maxSpeed(int axis) const;
+    void setMaxSpeed(int axis, double maxSpeed);
+
+    double acceleration(int axis) const;
+    void setAcceleration(int axis, double acceleration);
+
+    void setLimits(const MotionPlanner &planner);
+
+    // Parameterizes the path through count samples given per axis [steps]. The speed limits along the path [steps/s]
+    // per sample are optional, e.g. from the feed rate. Samples closer than a step to the previous one get dropped, a
+    // path left with two samples gets their midpoint inserted.
+    bool parameterize(const double *const positions[3], int count, const double *speedLimits = nullptr);
+
+    QString errorString() const;
+
+    int sampleCount() const;
+    const double *positions(int axis) const;
+    const double *pathPositions() const; // s [steps]
+    const double *speedsSqr() const; // x at each sample [steps^2/s^2]
+    double duration() const; // s
+
+    // The profile for the firmware queue: each segment enters with the speed of one sample and leaves with the speed
+    // of the next, ramping with the joint limited acceleration of its direction. Samples which round to the same step
+    // position get merged.
+    QList<MotionPlannerSegment> segments() const;
+
+private:
+    double m_maxSpeed[3] = { 1000, 1000, 1000 };
+    double m_acceleration[3] = { 2000, 2000, 2000 };
+    QString m_errorString;
+
+    QList<double> m_positions[3];
+    QList<double> m_pathPositions;
+    QList<double> m_speedsSqr;
+    double m_duration = 0;
+
+    void clear();
+
+};
+
+#endif // PATHPARAMETERIZER_H
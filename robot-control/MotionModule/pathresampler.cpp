@@ -0,0 +1,304 @@
+#include "pathresampler.h"
+
+#include <QThread>
+#include <QtConcurrent>
+
+#include <cmath>
+#include <algorithm>
+
+static const double radiansPerDegree = 3.14159265358979323846 / 180.0;
+
+// Smallest number of lines worth a task of their own
+static const int minimumChunkLines = 256;
+
+struct ResamplePiece
+{
+    int line = 0; // Index of the start point of the line
+    int depth = 0;
+    double t0 = 0;
+    double t1 = 1;
+    double angles0[3] = { 0, 0, 0 };
+    double angles1[3] = { 0, 0, 0 };
+};
+
+struct ResampleEnd
+{
+    int line = 0;
+    double t = 1;
+    double angles[3] = { 0, 0, 0 };
+};
+
+struct ResampleChunk
+{
+    int first = 0; // Lines between the points [first, last]
+    int last = 0;
+
+    QList<double> points[3];
+    QList<double> angles[3];
+    QList<int> lineEnds;
+    QString errorString;
+};
+
+static QString positionString(const double *x, const double *y, const double *z, int index)
+{
+    return QString("X%1 Y%2 Z%3").arg(x[index]).arg(y[index]).arg(z[index]);
+}
+
+static void resampleChunk(const ArmKinematics &kinematics, double tolerance, const double *x, const double *y, const double *z, ResampleChunk *chunk)
+{
+    const ArmConfiguration &arm = kinematics.configuration();
+    const double *vertices[3] = { x, y, z };
+
+    int vertexCount = chunk->last - chunk->first + 1;
+    QList<double> vertexAngles[3];
+    double *vertexAngleData[3];
+    for (int i = 0; i < 3; i++) {
+        vertexAngles[i].resize(vertexCount);
+        vertexAngleData[i] = vertexAngles[i].data();
+    }
+
+    int solved = kinematics.inverse(x + chunk->first, y + chunk->first, z + chunk->first, vertexCount, vertexAngleData);
+    if (solved < vertexCount) {
+        chunk->errorString = QString("%1 is out of reach of the arm").arg(positionString(x, y, z, chunk->first + solved));
+        return;
+    }
+
+    QList<ResamplePiece> pieces;
+    for (int line = chunk->first; line < chunk->last; line++) {
+        ResamplePiece piece;
+        piece.line = line;
+        for (int i = 0; i < 3; i++) {
+            piece.angles0[i] = vertexAngles[i].at(line - chunk->first);
+            piece.angles1[i] = vertexAngles[i].at(line + 1 - chunk->first);
+        }
+        pieces.append(piece);
+    }
+
+    QList<ResamplePiece> nextPieces;
+    QList<ResampleEnd> ends;
+    QList<double> middles[3];
+    QList<double> middleAngles[3];
+    while (!pieces.isEmpty()) {
+        int count = static_cast<int>(pieces.count());
+        double *middleData[3];
+        double *middleAngleData[3];
+        for (int i = 0; i < 3; i++) {
+            middles[i].resize(count);
+            middleAngles[i].resize(count);
+            middleData[i] = middles[i].data();
+            middleAngleData[i] = middleAngles[i].data();
+        }
+
+        for (int k = 0; k < count; k++) {
+            const ResamplePiece &piece = pieces.at(k);
+            double t = 0.5 * (piece.t0 + piece.t1);
+            for (int i = 0; i < 3; i++)
+                middleData[i][k] = vertices[i][piece.line] + t * (vertices[i][piece.line + 1] - vertices[i][piece.line]);
+        }
+
+        solved = kinematics.inverse(middleData[0], middleData[1], middleData[2], count, middleAngleData);
+        if (solved < count) {
+            chunk->errorString = QString("The line to %1 leaves the reach of the arm at X%2 Y%3 Z%4")
+                    .arg(positionString(x, y, z, pieces.at(solved).line + 1)).arg(middleData[0][solved])
+                    .arg(middleData[1][solved]).arg(middleData[2][solved]);
+            return;
+        }
+
+        nextPieces.clear();
+        for (int k = 0; k < count; k++) {
+            const ResamplePiece &piece = pieces.at(k);
+            double reach = std::hypot(middleData[0][k], middleData[1][k]);
+            double shoulderDistance = std::hypot(reach - arm.shoulderOffset, middleData[2][k] - arm.baseHeight);
+            double levers[3] = { reach, shoulderDistance, arm.forearmLength };
+
+            double deviation = 0;
+            for (int i = 0; i < 3; i++) {
+                double linear = 0.5 * (piece.angles0[i] + piece.angles1[i]);
+                deviation += std::fabs(middleAngleData[i][k] - linear) * radiansPerDegree * levers[i];
+            }
+
+            if (deviation <= tolerance) {
+                ResampleEnd end;
+                end.line = piece.line;
+                end.t = piece.t1;
+                std::copy(piece.angles1, piece.angles1 + 3, end.angles);
+                ends.append(end);
+                continue;
+            }
+
+            if (piece.depth >= PathResampler::maxDepth) {
+                chunk->errorString = QString("The line to %1 can not be followed within %2 mm near X%3 Y%4 Z%5")
+                        .arg(positionString(x, y, z, piece.line + 1)).arg(tolerance).arg(middleData[0][k])
+                        .arg(middleData[1][k]).arg(middleData[2][k]);
+                return;
+            }
+
+            double t = 0.5 * (piece.t0 + piece.t1);
+            ResamplePiece first = piece;
+            ResamplePiece second = piece;
+            first.t1 = t;
+            second.t0 = t;
+            for (int i = 0; i < 3; i++) {
+                first.angles1[i] = middleAngleData[i][k];
+                second.angles0[i] = middleAngleData[i][k];
+            }
+            first.depth++;
+            second.depth++;
+            nextPieces.append(first);
+            nextPieces.append(second);
+        }
+
+        pieces.swap(nextPieces);
+    }
+
+    // Pieces finish in the order of their level, the path needs them along the lines
+    std::sort(ends.begin(), ends.end(), [](const ResampleEnd &a, const ResampleEnd &b) {
+        return a.line < b.line || (a.line == b.line && a.t < b.t);
+    });
+
+    for (int i = 0; i < 3; i++) {
+        chunk->points[i].resize(ends.count());
+        chunk->angles[i].resize(ends.count());
+    }
+
+    for (int k = 0; k < ends.count(); k++) {
+        const ResampleEnd &end = ends.at(k);
+        for (int i = 0; i < 3; i++) {
+            const double *axis = vertices[i];
+            chunk->points[i][k] = end.t == 1 ? axis[end.line + 1] : axis[end.line] + end.t * (axis[end.line + 1] - axis[end.line]);
+            chunk->angles[i][k] = end.angles[i];
+        }
+
+        if (end.t == 1)
+            chunk->lineEnds.append(k);
+    }
+}
+
+PathResampler::PathResampler(const ArmKinematics *kinematics, double tolerance) :
+    m_kinematics(kinematics),
+    m_tolerance(tolerance)
+{
+
+}
+
+const ArmKinematics *PathResampler::kinematics() const
+{
+    return m_kinematics;
+}
+
+void PathResampler::setKinematics(const ArmKinematics *kinematics)
+{
+    m_kinematics = kinematics;
+}
+
+double PathResampler::tolerance() const
+{
+    return m_tolerance;
+}
+
+void PathResampler::setTolerance(double tolerance)
+{
+    m_tolerance = tolerance;
+}
+
+bool PathResampler::resample(const double start[3], const double end[3])
+{
+    const double x[2] = { start[0], end[0] };
+    const double y[2] = { start[1], end[1] };
+    const double z[2] = { start[2], end[2] };
+    return resample(x, y, z, 2);
+}
+
+bool PathResampler::resample(const double *x, const double *y, const double *z, int count)
+{
+    clear();
+
+    if (!m_kinematics) {
+        m_errorString = QString("No kinematics to resample for");
+        return false;
+    }
+
+    if (m_tolerance <= 0) {
+        m_errorString = QString("The line tolerance must be positive");
+        return false;
+    }
+
+    if (count < 2)
+        return true;
+
+    int lineCount = count - 1;
+    int chunkCount = qBound(1, lineCount / minimumChunkLines, QThread::idealThreadCount() * 4);
+    QList<ResampleChunk> chunks;
+    for (int i = 0; i < chunkCount; i++) {
+        ResampleChunk chunk;
+        chunk.first = static_cast<int>(static_cast<qint64>(lineCount) * i / chunkCount);
+        chunk.last = static_cast<int>(static_cast<qint64>(lineCount) * (i + 1) / chunkCount);
+        chunks.append(chunk);
+    }
+
+    const ArmKinematics &kinematics = *m_kinematics;
+    double tolerance = m_tolerance;
+
+    // Short paths, like the single lines of the interpreter, are not worth a thread
+    if (chunkCount == 1) {
+        resampleChunk(kinematics, tolerance, x, y, z, &chunks[0]);
+    } else {
+        QtConcurrent::blockingMap(chunks, [&kinematics, tolerance, x, y, z](ResampleChunk &chunk) {
+            resampleChunk(kinematics, tolerance, x, y, z, &chunk);
+        });
+    }
+
+    for (const ResampleChunk &chunk : chunks) {
+        if (!chunk.errorString.isEmpty()) {
+            clear();
+            m_errorString = chunk.errorString;
+            return false;
+        }
+
+        int offset = static_cast<int>(m_points[0].count());
+        for (int i = 0; i < 3; i++) {
+            m_points[i].append(chunk.points[i]);
+            m_angles[i].append(chunk.angles[i]);
+        }
+
+        for (int lineEnd : chunk.lineEnds)
+            m_lineEnds.append(offset + lineEnd);
+    }
+
+    return true;
+}
+
+QString PathResampler::errorString() const
+{
+    return m_errorString;
+}
+
+int PathResampler::pointCount() const
+{
+    return static_cast<int>(m_points[0].count());
+}
+
+const double *PathResampler::points(int axis) const
+{
+    return m_points[axis].constData();
+}
+
+const double *PathResampler::angles(int joint) const
+{
+    return m_angles[joint].constData();
+}
+
+const QList<int> &PathResampler::lineEnds() const
+{
+    return m_lineEnds;
+}
+
+void PathResampler::clear()
+{
+    m_errorString.clear();
+    for (int i = 0; i < 3; i++) {
+        m_points[i].clear();
+        m_angles[i].clear();
+    }
+    m_lineEnds.clear();
+}
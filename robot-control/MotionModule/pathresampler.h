@@ -0,0 +1,60 @@
+#ifndef PATHRESAMPLER_H
+#define PATHRESAMPLER_H
+
+#include <QList>
+#include <QString>
+
+#include "armkinematics.h"
+
+// Splits straight Cartesian lines for the arm until moving the joints linear between the pieces keeps the tool
+// point within the tolerance of the line. A piece gets halved as long as the joint angles at its middle differ too
+// much from the middle of its end angles. The difference is weighted with the lever of each joint (the horizontal
+// reach for the base, the distance from the shoulder for the shoulder, the forearm for the elbow), which bounds the
+// deviation of the tool point to first order.
+//
+// The pieces get split level by level: the middles of all pieces of a level are solved with one batch call of the
+// kinematics, so the vectorized inverse kinematics runs on long arrays even though every line splits differently.
+// Polylines get split into chunks of lines which are resampled in parallel.
+class PathResampler
+{
+public:
+    // Halving a line more than this often is not going to meet the tolerance, e.g. around a singularity
+    static constexpr int maxDepth = 16;
+
+    explicit PathResampler(const ArmKinematics *kinematics = nullptr, double tolerance = 0.01);
+
+    const ArmKinematics *kinematics() const;
+    void setKinematics(const ArmKinematics *kinematics);
+
+    // Largest deviation of the tool point from the line [mm]
+    double tolerance() const;
+    void setTolerance(double tolerance);
+
+    // Resamples the line, the points are the piece ends up to the end of the line
+    bool resample(const double start[3], const double end[3]);
+
+    // Resamples the lines between count points given per axis. The points are the piece ends of all lines, the
+    // line ends give the index of the last point of each line.
+    bool resample(const double *x, const double *y, const double *z, int count);
+
+    QString errorString() const;
+
+    int pointCount() const;
+    const double *points(int axis) const;
+    const double *angles(int joint) const; // [deg]
+    const QList<int> &lineEnds() const;
+
+private:
+    const ArmKinematics *m_kinematics = nullptr;
+    double m_tolerance = 0.01;
+    QString m_errorString;
+
+    QList<double> m_points[3];
+    QList<double> m_angles[3];
+    QList<int> m_lineEnds;
+
+    void clear();
+
+};
+
+#endif // PATHRESAMPLER_H
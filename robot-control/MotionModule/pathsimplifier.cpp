@@ -0,0 +1,120 @@
+#include "pathsimplifier.h"
+
+#include <cmath>
+
+PathSimplifier::PathSimplifier(double tolerance) :
+    m_tolerance(tolerance)
+{
+
+}
+
+double PathSimplifier::tolerance() const
+{
+    return m_tolerance;
+}
+
+void PathSimplifier::setTolerance(double tolerance)
+{
+    m_tolerance = tolerance;
+}
+
+bool PathSimplifier::push(const GCodeMove &move, GCodeMove *simplified)
+{
+    m_inputCount++;
+
+    if (m_hasRun && extendRun(move))
+        return false;
+
+    bool completed = m_hasRun;
+    if (completed) {
+        *simplified = m_run;
+        m_outputCount++;
+    }
+
+    m_run = move;
+    m_vertices.clear();
+    m_hasRun = true;
+    return completed;
+}
+
+bool PathSimplifier::flush(GCodeMove *simplified)
+{
+    if (!m_hasRun)
+        return false;
+
+    *simplified = m_run;
+    m_outputCount++;
+    m_vertices.clear();
+    m_hasRun = false;
+    return true;
+}
+
+void PathSimplifier::reset()
+{
+    m_hasRun = false;
+    m_vertices.clear();
+    m_inputCount = 0;
+    m_outputCount = 0;
+}
+
+qint64 PathSimplifier::inputCount() const
+{
+    return m_inputCount;
+}
+
+qint64 PathSimplifier::outputCount() const
+{
+    return m_outputCount;
+}
+
+bool PathSimplifier::extendRun(const GCodeMove &move)
+{
+    if (m_tolerance <= 0 || move.type != m_run.type || move.feedRate != m_run.feedRate)
+        return false;
+
+    if (move.type != GCodeMove::TypeLinear && move.type != GCodeMove::TypeSeek)
+        return false;
+
+    if (m_vertices.size() / 3 >= maxRunLength - 1)
+        return false;
+
+    // The current end of the run becomes a vertex of the merged segment
+    if (distanceToSegment(m_run.target, m_run.start, move.target) > m_tolerance)
+        return false;
+
+    const double *vertices = m_vertices.constData();
+    for (int i = 0; i < m_vertices.size(); i += 3) {
+        if (distanceToSegment(vertices + i, m_run.start, move.target) > m_tolerance)
+            return false;
+    }
+
+    for (int i = 0; i < 3; i++) {
+        m_vertices.append(m_run.target[i]);
+        m_run.target[i] = move.target[i];
+    }
+
+    return true;
+}
+
+double PathSimplifier::distanceToSegment(const double point[3], const double start[3], const double end[3])
+{
+    double direction[3];
+    double relative[3];
+    double lengthSqr = 0;
+    double projection = 0;
+    for (int i = 0; i < 3; i++) {
+        direction[i] = end[i] - start[i];
+        relative[i] = point[i] - start[i];
+        lengthSqr += direction[i] * direction[i];
+        projection += direction[i] * relative[i];
+    }
+
+    double t = lengthSqr > 0 ? std::fmin(1.0, std::fmax(0.0, projection / lengthSqr)) : 0.0;
+    double distanceSqr = 0;
+    for (int i = 0; i < 3; i++) {
+        double delta = relative[i] - t * direction[i];
+        distanceSqr += delta * delta;
+    }
+
+    return std::sqrt(distanceSqr);
+}
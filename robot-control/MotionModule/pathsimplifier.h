@@ -0,0 +1,55 @@
+#ifndef PATHSIMPLIFIER_H
+#define PATHSIMPLIFIER_H
+
+#include <QList>
+
+#include "gcodemove.h"
+
+// Streaming simplification between the G-code interpreter and the planner. Consecutive linear moves of the
+// same kind and feed rate get merged into one as long as every vertex in between stays within the tolerance
+// of the merged segment, the streaming counterpart of Ramer-Douglas-Peucker: instead of splitting a finished
+// polyline at its farthest vertex, a run grows until the next vertex would break the tolerance and ends there.
+// Runs are limited to maxRunLength moves, so memory and latency stay bounded.
+//
+// Moves are pushed one by one, each push completes at most one simplified move. A merged move keeps the line
+// number of its first move, so resuming at that line repeats the whole merged move.
+class PathSimplifier
+{
+public:
+    static constexpr int maxRunLength = 256;
+
+    explicit PathSimplifier(double tolerance = 0.005);
+
+    // Largest distance between a vertex of the original path and the simplified one [mm], 0 disables merging
+    double tolerance() const;
+    void setTolerance(double tolerance);
+
+    // Returns true if the move completed a simplified move
+    bool push(const GCodeMove &move, GCodeMove *simplified);
+
+    // Returns the last simplified move at the end of the program, if any
+    bool flush(GCodeMove *simplified);
+
+    void reset();
+
+    qint64 inputCount() const;
+    qint64 outputCount() const;
+
+    // Distance between a point and the segment from start to end
+    static double distanceToSegment(const double point[3], const double start[3], const double end[3]);
+
+private:
+    double m_tolerance = 0.005;
+
+    bool m_hasRun = false;
+    GCodeMove m_run;
+    QList<double> m_vertices; // x, y, z of the vertices inside the run
+
+    qint64 m_inputCount = 0;
+    qint64 m_outputCount = 0;
+
+    bool extendRun(const GCodeMove &move);
+
+};
+
+#endif // PATHSIMPLIFIER_H
@@ -0,0 +1,156 @@
+#include "steptablecompiler.h"
+
+#include <cmath>
+
+StepTableCompiler::StepTableCompiler(quint32 period) :
+    m_period(period)
+{
+
+}
+
+quint32 StepTableCompiler::period() const
+{
+    return m_period;
+}
+
+bool StepTableCompiler::compile(const MotionPlanner &planner, const qint32 start[3])
+{
+    m_entries.clear();
+    m_samples.clear();
+    m_errorString.clear();
+
+    if (m_period == 0 || m_period > 0xffff) {
+        m_errorString = QString("The period must be between 1 and 65535 us.");
+        return false;
+    }
+
+    StepTableSample sample;
+    for (int i = 0; i < 3; i++) {
+        sample.position[i] = start[i];
+    }
+    m_samples.append(sample);
+
+    // Trajectory time [us] of the start of the current block
+    double blockStartTime = 0;
+    qint32 blockStart[3] = { start[0], start[1], start[2] };
+    quint64 time = 0;
+
+    for (int index = 0; index < planner.blockCount(); index++) {
+        const MotionPlannerBlock &block = planner.block(index);
+        MotionPlannerTrapezoid trapezoid = planner.trapezoid(index);
+        double blockEndTime = blockStartTime + trapezoid.duration * 1000000.0;
+        bool lastBlock = index + 1 == planner.blockCount();
+
+        // Sample every period ending within this block, the last block ends with a shorter period if needed
+        while (true) {
+            quint64 sampleTime = time + m_period;
+            if (sampleTime > blockEndTime) {
+                if (!lastBlock)
+                    break;
+
+                sampleTime = static_cast<quint64>(std::ceil(blockEndTime));
+                if (sampleTime <= time)
+                    break;
+            }
+
+            StepTableSample next;
+            next.time = sampleTime;
+            // A dwell block stands still at its target
+            double fraction = 1.0;
+            if (block.stepEventCount > 0) {
+                double distance = MotionPlanner::distanceAt(trapezoid, block.acceleration, (sampleTime - blockStartTime) / 1000000.0);
+                fraction = std::min(1.0, distance / block.length);
+            }
+            for (int i = 0; i < 3; i++) {
+                next.position[i] = blockStart[i] + static_cast<qint32>(std::lround(block.steps[i] * fraction));
+            }
+
+            if (!appendEntry(sampleTime - time, m_samples.last().position, next.position))
+                return false;
+
+            m_samples.append(next);
+            time = sampleTime;
+
+            if (sampleTime >= blockEndTime)
+                break;
+        }
+
+        blockStartTime = blockEndTime;
+        for (int i = 0; i < 3; i++) {
+            blockStart[i] = block.target[i];
+        }
+    }
+
+    return true;
+}
+
+QString StepTableCompiler::errorString() const
+{
+    return m_errorString;
+}
+
+const QList<StepTableEntry> &StepTableCompiler::entries() const
+{
+    return m_entries;
+}
+
+const QList<StepTableSample> &StepTableCompiler::samples() const
+{
+    return m_samples;
+}
+
+quint64 StepTableCompiler::duration() const
+{
+    return m_samples.isEmpty() ? 0 : m_samples.last().time;
+}
+
+QByteArray StepTableCompiler::toByteArray() const
+{
+    QByteArray data;
+    data.reserve(m_entries.size() * entrySize);
+    for (const StepTableEntry &entry : m_entries) {
+        data.append(encodeEntry(entry));
+    }
+
+    return data;
+}
+
+QByteArray StepTableCompiler::encodeEntry(const StepTableEntry &entry)
+{
+    QByteArray data(entrySize, 0);
+    data[0] = static_cast<char>(entry.interval & 0xff);
+    data[1] = static_cast<char>(entry.interval >> 8);
+    data[2] = static_cast<char>(entry.remainder);
+    data[3] = static_cast<char>(entry.events);
+    for (int i = 0; i < 3; i++) {
+        data[4 + i] = static_cast<char>(entry.steps[i]);
+    }
+
+    return data;
+}
+
+bool StepTableCompiler::appendEntry(quint32 duration, const qint32 from[3], const qint32 to[3])
+{
+    StepTableEntry entry;
+    for (int i = 0; i < 3; i++) {
+        qint32 steps = to[i] - from[i];
+        if (std::abs(steps) > maxEvents) {
+            m_errorString = QString("Axis %1 moves %2 steps within %3 us, use a shorter period.").arg(i).arg(steps).arg(duration);
+            return false;
+        }
+
+        entry.steps[i] = static_cast<qint8>(steps);
+        entry.events = std::max<quint8>(entry.events, static_cast<quint8>(std::abs(steps)));
+    }
+
+    if (entry.events == 0) {
+        // Dwell, standing still or moving slower than one step per period
+        entry.interval = static_cast<quint16>(duration);
+    } else {
+        entry.interval = static_cast<quint16>(duration / entry.events);
+        entry.remainder = static_cast<quint8>(duration % entry.events);
+    }
+
+    m_entries.append(entry);
+    return true;
+}
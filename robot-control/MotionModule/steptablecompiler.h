@@ -0,0 +1,66 @@
+#ifndef STEPTABLECOMPILER_H
+#define STEPTABLECOMPILER_H
+
+#include <QList>
+#include <QString>
+#include <QByteArray>
+
+#include "motionplanner.h"
+
+// Mirrors StepTableEntry of the firmware, see StepTablePlayer.h
+struct StepTableEntry
+{
+    quint16 interval = 0; // us between step events
+    quint8 remainder = 0; // us spread over the events
+    quint8 events = 0; // Steps of the dominant axis, 0 for a dwell
+    qint8 steps[3] = { 0, 0, 0 };
+};
+
+// Position at the end of an entry, the planned position rounded to steps
+struct StepTableSample
+{
+    quint64 time = 0; // us
+    qint32 position[3] = { 0, 0, 0 };
+};
+
+// Compiles the planned trajectory into a step table for CommandStepTable: the trajectory gets sampled with a
+// fixed period and every period becomes one entry with the steps of each axis and the step event timing.
+// All the math happens here, the firmware only adds and compares while playing the table.
+class StepTableCompiler
+{
+public:
+    // Size of one entry on the wire, most entries per CommandStepTable request and most events per entry
+    static constexpr int entrySize = 7;
+    static constexpr int entriesPerRequest = 4;
+    static constexpr int maxEvents = 127;
+
+    explicit StepTableCompiler(quint32 period = 5000);
+
+    quint32 period() const;
+
+    // Compiles all blocks queued in the planner, starting at the position the first block starts from.
+    // Fails if an axis would need more steps within one period than an entry can hold.
+    bool compile(const MotionPlanner &planner, const qint32 start[3]);
+
+    QString errorString() const;
+
+    const QList<StepTableEntry> &entries() const;
+    const QList<StepTableSample> &samples() const;
+    quint64 duration() const;
+
+    // Wire format of the entries, little endian
+    QByteArray toByteArray() const;
+    static QByteArray encodeEntry(const StepTableEntry &entry);
+
+private:
+    quint32 m_period = 5000;
+    QString m_errorString;
+
+    QList<StepTableEntry> m_entries;
+    QList<StepTableSample> m_samples;
+
+    bool appendEntry(quint32 duration, const qint32 from[3], const qint32 to[3]);
+
+};
+
+#endif // STEPTABLECOMPILER_H
@@ -0,0 +1,384 @@
+#include "workspacegrid.h"
+
+#include <QThread>
+#include <QDataStream>
+#include <QElapsedTimer>
+#include <QtConcurrent>
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+Q_LOGGING_CATEGORY(dcWorkspace, "Workspace")
+
+static const quint32 gridMagic = 0x474d5241; // "ARMG"
+static const quint16 gridVersion = 1;
+
+// The cells start aligned behind the header, so the mapping can be used as an array of them
+static const qint64 cellAlignment = 64;
+
+// Smallest number of slices worth a task of their own
+static const int minimumChunkSlices = 2;
+
+static const double pi = 3.14159265358979323846;
+static const double degreesPerRadian = 180.0 / pi;
+
+struct WorkspaceSlices
+{
+    int first = 0; // Slices along Z [first, last)
+    int last = 0;
+};
+
+// Everything the cells depend on, the cache only loads if it matches
+static QList<double> cacheKey(const ArmConfiguration &arm, const MotionPlanner &planner, double cellSize)
+{
+    QList<double> key;
+    key << cellSize << arm.baseHeight << arm.shoulderOffset << arm.upperArmLength << arm.forearmLength << (arm.elbowUp ? 1 : 0);
+    for (int i = 0; i < 3; i++)
+        key << arm.stepsPerDegree[i] << arm.minAngle[i] << arm.maxAngle[i] << planner.maxSpeed(i);
+
+    return key;
+}
+
+// Values at one corner, solved with the batch inverse kinematics. Unreachable corners stay zero.
+static void solveSlice(const ArmKinematics &kinematics, const double jointSpeeds[3], const double origin[3], double cellSize,
+                       const int size[3], int slice, WorkspaceCell *corners)
+{
+    const ArmConfiguration &arm = kinematics.configuration();
+    int countX = size[0] + 1;
+    int count = countX * (size[1] + 1);
+
+    QList<double> points[3];
+    QList<double> angles[3];
+    for (int i = 0; i < 3; i++) {
+        points[i].resize(count);
+        angles[i].resize(count);
+    }
+
+    for (int k = 0; k < count; k++) {
+        points[0][k] = origin[0] + (k % countX) * cellSize;
+        points[1][k] = origin[1] + (k / countX) * cellSize;
+        points[2][k] = origin[2] + slice * cellSize;
+    }
+
+    // The batch conversion stops at points out of reach, continue behind them
+    QList<bool> reachable(count, false);
+    int done = 0;
+    while (done < count) {
+        double *angleData[3] = { angles[0].data() + done, angles[1].data() + done, angles[2].data() + done };
+        int solved = kinematics.inverse(points[0].constData() + done, points[1].constData() + done, points[2].constData() + done,
+                                        count - done, angleData);
+        std::fill(reachable.begin() + done, reachable.begin() + done + solved, true);
+        done += solved + 1;
+    }
+
+    double reach = arm.upperArmLength + arm.forearmLength;
+    double foldedReach = std::fabs(arm.upperArmLength - arm.forearmLength);
+    bool baseLimited = arm.maxAngle[0] - arm.minAngle[0] < 360;
+    for (int k = 0; k < count; k++) {
+        WorkspaceCell &corner = corners[k];
+        corner = WorkspaceCell();
+        if (!reachable.at(k))
+            continue;
+
+        double radius = std::hypot(points[0][k], points[1][k]);
+        double distance = std::hypot(radius - arm.shoulderOffset, points[2][k] - arm.baseHeight);
+        double sinElbow = std::fabs(std::sin(angles[2][k] / degreesPerRadian));
+        corner.singularityMargin = static_cast<float>(std::max(0.0, std::min({ radius, reach - distance, distance - foldedReach })));
+
+        // The tool moves by the angle times the lever of the joint
+        double levers[3] = { radius, distance, arm.forearmLength };
+        double limitMargin = std::numeric_limits<double>::infinity();
+        for (int i = baseLimited ? 0 : 1; i < 3; i++) {
+            double angle = std::min(angles[i][k] - arm.minAngle[i], arm.maxAngle[i] - angles[i][k]);
+            limitMargin = std::min(limitMargin, angle / degreesPerRadian * levers[i]);
+        }
+        corner.limitMargin = static_cast<float>(limitMargin);
+
+        // Joint rates per tool speed in the worst direction: 1 / radius for the base, 1 / (upper arm * sin(elbow)) for the
+        // shoulder and distance / (upper arm * forearm * sin(elbow)) for the elbow
+        double maxSpeed = std::min({ jointSpeeds[0] * radius, jointSpeeds[1] * arm.upperArmLength * sinElbow,
+                                     distance > 0 ? jointSpeeds[2] * arm.upperArmLength * arm.forearmLength * sinElbow / distance : 0.0 });
+        corner.maxSpeed = static_cast<float>(maxSpeed);
+        corner.reachable = 1;
+    }
+}
+
+WorkspaceGrid::WorkspaceGrid()
+{
+
+}
+
+WorkspaceGrid::~WorkspaceGrid()
+{
+    clear();
+}
+
+double WorkspaceGrid::cellSize() const
+{
+    return m_cellSize;
+}
+
+void WorkspaceGrid::setCellSize(double cellSize)
+{
+    m_cellSize = cellSize;
+}
+
+bool WorkspaceGrid::build(const ArmKinematics &kinematics, const MotionPlanner &planner)
+{
+    clear();
+    m_errorString.clear();
+
+    if (m_cellSize <= 0) {
+        m_errorString = QString("The cell size must be positive");
+        return false;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    // Joint speeds in rad/s
+    const ArmConfiguration &arm = kinematics.configuration();
+    double jointSpeeds[3];
+    for (int i = 0; i < 3; i++)
+        jointSpeeds[i] = planner.maxSpeed(i) / std::fabs(arm.stepsPerDegree[i]) / degreesPerRadian;
+
+    setGeometry(arm);
+    m_key = cacheKey(arm, planner, m_cellSize);
+
+    // The corners first, then the cells from the two slices of corners around them
+    qint64 sliceSize = static_cast<qint64>(m_size[0] + 1) * (m_size[1] + 1);
+    QList<WorkspaceCell> corners(sliceSize * (m_size[2] + 1));
+    int chunkCount = qBound(1, (m_size[2] + 1) / minimumChunkSlices, QThread::idealThreadCount() * 4);
+    QList<WorkspaceSlices> chunks;
+    for (int i = 0; i < chunkCount; i++) {
+        WorkspaceSlices chunk;
+        chunk.first = (m_size[2] + 1) * i / chunkCount;
+        chunk.last = (m_size[2] + 1) * (i + 1) / chunkCount;
+        chunks.append(chunk);
+    }
+
+    const double cellSize = m_cellSize;
+    const double *origin = m_origin;
+    const int *size = m_size;
+    WorkspaceCell *cornerData = corners.data();
+    QtConcurrent::blockingMap(chunks, [&kinematics, &jointSpeeds, origin, cellSize, size, sliceSize, cornerData](WorkspaceSlices &chunk) {
+        for (int slice = chunk.first; slice < chunk.last; slice++)
+            solveSlice(kinematics, jointSpeeds, origin, cellSize, size, slice, cornerData + slice * sliceSize);
+    });
+
+    m_builtCells.resize(static_cast<qint64>(m_size[0]) * m_size[1] * m_size[2]);
+    for (int i = 0; i < chunkCount; i++) {
+        chunks[i].first = m_size[2] * i / chunkCount;
+        chunks[i].last = m_size[2] * (i + 1) / chunkCount;
+    }
+
+    WorkspaceCell *cells = m_builtCells.data();
+    QtConcurrent::blockingMap(chunks, [size, sliceSize, cornerData, cells](WorkspaceSlices &chunk) {
+        int countX = size[0] + 1;
+        for (int k = chunk.first; k < chunk.last; k++) {
+            for (int j = 0; j < size[1]; j++) {
+                for (int i = 0; i < size[0]; i++) {
+                    WorkspaceCell cell;
+                    cell.singularityMargin = std::numeric_limits<float>::infinity();
+                    cell.limitMargin = std::numeric_limits<float>::infinity();
+                    cell.maxSpeed = std::numeric_limits<float>::infinity();
+                    cell.reachable = 1;
+                    for (int corner = 0; corner < 8; corner++) {
+                        const WorkspaceCell &value = cornerData[(k + (corner >> 2)) * sliceSize + (j + ((corner >> 1) & 1)) * countX + i + (corner & 1)];
+                        cell.singularityMargin = std::min(cell.singularityMargin, value.singularityMargin);
+                        cell.limitMargin = std::min(cell.limitMargin, value.limitMargin);
+                        cell.maxSpeed = std::min(cell.maxSpeed, value.maxSpeed);
+                        cell.reachable &= value.reachable;
+                    }
+
+                    if (!cell.reachable)
+                        cell = WorkspaceCell();
+
+                    cells[(static_cast<qint64>(k) * size[1] + j) * size[0] + i] = cell;
+                }
+            }
+        }
+    });
+
+    m_cells = m_builtCells.constData();
+    qCDebug(dcWorkspace()) << "Built" << cellCount() << "cells of" << m_cellSize << "mm in" << chunkCount << "chunks in" << timer.elapsed() << "ms";
+    return true;
+}
+
+bool WorkspaceGrid::save(const QString &fileName) const
+{
+    if (!isValid())
+        return false;
+
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qCWarning(dcWorkspace()) << "Could not write" << fileName << file.errorString();
+        return false;
+    }
+
+    QDataStream stream(&file);
+    stream.setByteOrder(QDataStream::LittleEndian);
+    stream << gridMagic << gridVersion << static_cast<qint32>(m_key.count());
+    for (double value : m_key)
+        stream << value;
+
+    while (file.pos() % cellAlignment != 0)
+        stream << static_cast<quint8>(0);
+
+    if (stream.status() != QDataStream::Ok)
+        return false;
+
+    qint64 length = cellCount() * static_cast<qint64>(sizeof(WorkspaceCell));
+    return file.write(reinterpret_cast<const char *>(m_cells), length) == length;
+}
+
+bool WorkspaceGrid::load(const QString &fileName, const ArmKinematics &kinematics, const MotionPlanner &planner)
+{
+    clear();
+    m_errorString.clear();
+
+    m_file.setFileName(fileName);
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        m_errorString = QString("Could not open %1: %2").arg(fileName, m_file.errorString());
+        return false;
+    }
+
+    QDataStream stream(&m_file);
+    stream.setByteOrder(QDataStream::LittleEndian);
+
+    quint32 magic = 0;
+    quint16 version = 0;
+    qint32 keyCount = 0;
+    stream >> magic >> version >> keyCount;
+    if (magic != gridMagic || version != gridVersion) {
+        m_errorString = QString("%1 is not a workspace grid of version %2").arg(fileName).arg(gridVersion);
+        clear();
+        return false;
+    }
+
+    QList<double> key = cacheKey(kinematics.configuration(), planner, m_cellSize);
+    bool matching = keyCount == key.count();
+    for (int i = 0; i < keyCount && matching && stream.status() == QDataStream::Ok; i++) {
+        double value = 0;
+        stream >> value;
+        matching = value == key.at(i);
+    }
+
+    if (!matching || stream.status() != QDataStream::Ok) {
+        m_errorString = QString("%1 was built for another arm or cell size").arg(fileName);
+        clear();
+        return false;
+    }
+
+    setGeometry(kinematics.configuration());
+
+    qint64 offset = (m_file.pos() + cellAlignment - 1) / cellAlignment * cellAlignment;
+    qint64 length = cellCount() * static_cast<qint64>(sizeof(WorkspaceCell));
+    if (m_file.size() != offset + length) {
+        m_errorString = QString("%1 is truncated").arg(fileName);
+        clear();
+        return false;
+    }
+
+    m_mapping = m_file.map(offset, length);
+    if (!m_mapping) {
+        m_errorString = QString("Could not map %1: %2").arg(fileName, m_file.errorString());
+        clear();
+        return false;
+    }
+
+    m_key = key;
+    m_cells = reinterpret_cast<const WorkspaceCell *>(m_mapping);
+    return true;
+}
+
+QString WorkspaceGrid::errorString() const
+{
+    return m_errorString;
+}
+
+bool WorkspaceGrid::isValid() const
+{
+    return m_cells != nullptr;
+}
+
+const double *WorkspaceGrid::origin() const
+{
+    return m_origin;
+}
+
+const int *WorkspaceGrid::size() const
+{
+    return m_size;
+}
+
+qint64 WorkspaceGrid::cellCount() const
+{
+    return static_cast<qint64>(m_size[0]) * m_size[1] * m_size[2];
+}
+
+const WorkspaceCell *WorkspaceGrid::cell(const double position[3]) const
+{
+    if (!m_cells)
+        return nullptr;
+
+    qint64 index[3];
+    for (int i = 0; i < 3; i++) {
+        double cell = std::floor((position[i] - m_origin[i]) / m_cellSize);
+        if (!(cell >= 0 && cell < m_size[i]))
+            return nullptr;
+
+        index[i] = static_cast<qint64>(cell);
+    }
+
+    return m_cells + (index[2] * m_size[1] + index[1]) * m_size[0] + index[0];
+}
+
+bool WorkspaceGrid::isSafe(const double position[3], double margin) const
+{
+    const WorkspaceCell *found = cell(position);
+    return found && found->reachable && found->singularityMargin >= margin && found->limitMargin >= margin;
+}
+
+int WorkspaceGrid::validate(const double *x, const double *y, const double *z, int count, double margin) const
+{
+    for (int k = 0; k < count; k++) {
+        const double position[3] = { x[k], y[k], z[k] };
+        if (!isSafe(position, margin))
+            return k;
+    }
+
+    return count;
+}
+
+void WorkspaceGrid::setGeometry(const ArmConfiguration &arm)
+{
+    // Everything the arm reaches: a cylinder around the base axis, as high as the arm is long around the shoulder
+    double reach = arm.upperArmLength + arm.forearmLength;
+    double radius = std::fabs(arm.shoulderOffset) + reach;
+    double extent[3] = { radius, radius, reach };
+    double center[3] = { 0, 0, arm.baseHeight };
+    for (int i = 0; i < 3; i++) {
+        m_size[i] = static_cast<int>(std::ceil(2 * extent[i] / m_cellSize));
+        m_origin[i] = center[i] - 0.5 * m_size[i] * m_cellSize;
+    }
+}
+
+void WorkspaceGrid::clear()
+{
+    if (m_mapping)
+        m_file.unmap(m_mapping);
+
+    if (m_file.isOpen())
+        m_file.close();
+
+    m_mapping = nullptr;
+    m_cells = nullptr;
+    m_builtCells.clear();
+    m_key.clear();
+    for (int i = 0; i < 3; i++) {
+        m_origin[i] = 0;
+        m_size[i] = 0;
+    }
+}
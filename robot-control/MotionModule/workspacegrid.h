@@ -0,0 +1,84 @@
+#ifndef WORKSPACEGRID_H
+#define WORKSPACEGRID_H
+
+#include <QFile>
+#include <QList>
+#include <QString>
+#include <QLoggingCategory>
+
+#include "armkinematics.h"
+#include "motionplanner.h"
+
+Q_DECLARE_LOGGING_CATEGORY(dcWorkspace)
+
+// Worst case of the arm within one cell of the grid, taken over its eight corners
+struct WorkspaceCell
+{
+    float singularityMargin = 0; // Distance from the base axis and the stretched or folded arm [mm]
+    float limitMargin = 0; // Joint angle to the closest limit, times the lever of the joint [mm]
+    float maxSpeed = 0; // Tool speed in any direction the joints can follow at their max speed [mm/s]
+    quint32 reachable = 0; // All corners are within reach and the joint limits
+};
+
+// Voxel grid over the workspace of the arm, so a program can be checked with one lookup per point instead of
+// solving the inverse kinematics for every one of them.
+//
+// The grid spans the reach of the arm. The corners of all cells get solved with the batch inverse kinematics, slice
+// by slice on all cores, and each cell keeps the worst values of its corners. Between the corners the margins change
+// by no more than the cell diagonal, so checking with at least that margin also covers the points in between.
+//
+// The grid depends on the arm configuration, the cell size and the joint speeds only, so it gets cached in a file and
+// memory mapped on the next start instead of being built again. The cells are stored in the byte order of the host.
+class WorkspaceGrid
+{
+public:
+    WorkspaceGrid();
+    ~WorkspaceGrid();
+
+    // Edge length of the cells [mm]
+    double cellSize() const;
+    void setCellSize(double cellSize);
+
+    // The joint speeds are the max speeds of the planner, in steps/s of the joints
+    bool build(const ArmKinematics &kinematics, const MotionPlanner &planner);
+
+    // Loading fails if the cache was built for another arm, cell size or joint speeds
+    bool save(const QString &fileName) const;
+    bool load(const QString &fileName, const ArmKinematics &kinematics, const MotionPlanner &planner);
+
+    QString errorString() const;
+
+    bool isValid() const;
+    const double *origin() const; // Lowest corner of the grid [mm]
+    const int *size() const; // Cells along each axis
+    qint64 cellCount() const;
+
+    // Cell holding the position, nullptr outside of the grid
+    const WorkspaceCell *cell(const double position[3]) const;
+
+    // Reachable with at least the margin [mm] from singularities and joint limits
+    bool isSafe(const double position[3], double margin = 0) const;
+
+    // Checks count positions given per axis, returns the number of positions before the first one which is not safe
+    int validate(const double *x, const double *y, const double *z, int count, double margin = 0) const;
+
+private:
+    double m_cellSize = 10;
+    QString m_errorString;
+
+    QList<double> m_key;
+    double m_origin[3] = { 0, 0, 0 };
+    int m_size[3] = { 0, 0, 0 };
+
+    // Cells of a built grid, or the mapping of the cache file
+    QList<WorkspaceCell> m_builtCells;
+    QFile m_file;
+    uchar *m_mapping = nullptr;
+    const WorkspaceCell *m_cells = nullptr;
+
+    void setGeometry(const ArmConfiguration &arm);
+    void clear();
+
+};
+
+#endif // WORKSPACEGRID_H
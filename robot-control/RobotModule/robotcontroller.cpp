@@ -1,5 +1,7 @@
 #include "robotcontroller.h"
 
+#include <QDataStream>
+
 Q_LOGGING_CATEGORY(dcRobotController, "RobotController")
 
 
@@ -37,16 +39,119 @@ QString RobotController::firmwareVersion() const
     return m_firmwareVersion;
 }
 
+RobotStatus RobotController::status() const
+{
+    return m_status;
+}
+
 RobotControllerReply *RobotController::getFirmwareVersion()
 {
     qCDebug(dcRobotController()) << "Reading firmware version from robot controller";
-    RobotControllerReply *reply = createReply(RobotControllerPacket(RobotControllerPacket::CommandGetFirmwareVersion, m_packetId++));
-    m_uartInterface->sendPacket(reply->requestPacket());
-    m_pendingReplies.insert(reply->packetId(), reply);
-    reply->startWait();
+    return sendRequest(RobotControllerPacket(RobotControllerPacket::CommandGetFirmwareVersion, nextPacketId()));
+}
+
+RobotControllerReply *RobotController::getStatus()
+{
+    qCDebug(dcRobotController()) << "Reading status from robot controller";
+    RobotControllerReply *reply = sendRequest(RobotControllerPacket(RobotControllerPacket::CommandGetStatus, nextPacketId()));
+    connect(reply, &RobotControllerReply::finished, this, [this, reply](){
+        if (reply->error() != RobotControllerReply::ErrorNoError) {
+            qCWarning(dcRobotController()) << "Could not read status. The reply finished with error" << reply->error();
+            return;
+        }
+
+        QByteArray payload = reply->responsePacket().payload();
+        RobotStatus status;
+        if (!status.parsePayload(payload.constData(), payload.length())) {
+            qCWarning(dcRobotController()) << "Could not read status. The response has an unexpected payload length" << payload.length() << payload.toHex();
+            return;
+        }
+
+        m_status = status;
+        emit statusChanged(m_status);
+    });
     return reply;
 }
 
+RobotControllerReply *RobotController::subscribeStatus(quint16 rate)
+{
+    qCDebug(dcRobotController()) << "Subscribe status with" << rate << "Hz";
+    m_statusRate = rate;
+
+    QByteArray payload;
+    QDataStream stream(&payload, QIODevice::WriteOnly);
+    stream.setByteOrder(QDataStream::LittleEndian);
+    stream << rate;
+
+    return sendRequest(RobotControllerPacket(RobotControllerPacket::CommandSubscribeStatus, nextPacketId(), payload));
+}
+
+RobotControllerReply *RobotController::moveTo(qint32 x, qint32 y, qint32 z, quint16 acceleration, quint16 maxSpeed, quint32 jerk)
+{
+    qCDebug(dcRobotController()) << "Move to" << x << y << z << "acceleration" << acceleration << "max speed" << maxSpeed << "jerk" << jerk;
+
+    QByteArray payload;
+    QDataStream stream(&payload, QIODevice::WriteOnly);
+    stream.setByteOrder(QDataStream::LittleEndian);
+    stream << x << y << z << acceleration << maxSpeed;
+    if (jerk > 0)
+        stream << jerk;
+
+    return sendRequest(RobotControllerPacket(RobotControllerPacket::CommandMoveTo, nextPacketId(), payload));
+}
+
+RobotControllerReply *RobotController::moveSegment(qint32 x, qint32 y, qint32 z, quint16 acceleration, quint16 maxSpeed, quint16 entryIndex, quint16 exitIndex)
+{
+    qCDebug(dcRobotController()) << "Move segment to" << x << y << z << "acceleration" << acceleration << "max speed" << maxSpeed << "entry" << entryIndex << "exit" << exitIndex;
+
+    QByteArray payload;
+    QDataStream stream(&payload, QIODevice::WriteOnly);
+    stream.setByteOrder(QDataStream::LittleEndian);
+    stream << x << y << z << acceleration << maxSpeed << entryIndex << exitIndex;
+
+    return sendRequest(RobotControllerPacket(RobotControllerPacket::CommandMoveSegment, nextPacketId(), payload));
+}
+
+RobotControllerReply *RobotController::queueStepTable(const QByteArray &entries)
+{
+    qCDebug(dcRobotController()) << "Queue step table entries" << entries.toHex();
+    return sendRequest(RobotControllerPacket(RobotControllerPacket::CommandStepTable, nextPacketId(), entries));
+}
+
+void RobotController::jog(qint16 x, qint16 y, qint16 z, quint16 acceleration)
+{
+    QByteArray payload;
+    QDataStream stream(&payload, QIODevice::WriteOnly);
+    stream.setByteOrder(QDataStream::LittleEndian);
+    stream << x << y << z << acceleration;
+
+    // Fire and forget, a reply object per setpoint would only add latency
+    m_uartInterface->sendPacket(RobotControllerPacket(RobotControllerPacket::CommandJog, jogPacketId, payload));
+}
+
+void RobotController::feedHold()
+{
+    qCDebug(dcRobotController()) << "Feed hold";
+    m_uartInterface->sendRealtimeCommand(UartInterface::RealtimeCommandFeedHold);
+}
+
+void RobotController::resume()
+{
+    qCDebug(dcRobotController()) << "Resume";
+    m_uartInterface->sendRealtimeCommand(UartInterface::RealtimeCommandResume);
+}
+
+void RobotController::emergencyStop()
+{
+    qCWarning(dcRobotController()) << "Emergency stop";
+    m_uartInterface->sendRealtimeCommand(UartInterface::RealtimeCommandEmergencyStop);
+}
+
+void RobotController::requestStatus()
+{
+    m_uartInterface->sendRealtimeCommand(UartInterface::RealtimeCommandStatus);
+}
+
 void RobotController::onInterfaceAvailableChanged(bool available)
 {
     if (available) {
@@ -74,7 +179,7 @@ void RobotController::onInterfaceAvailableChanged(bool available)
                 emit firmwareVersionChaged(m_firmwareVersion);
             }
 
-            // Get status
+            getStatus();
 
             setState(StateReady);
         });
@@ -88,13 +193,97 @@ void RobotController::onInterfaceAvailableChanged(bool available)
         m_packetId = 0;
         m_pendingReplies.clear();
         m_firmwareVersion.clear();
+        m_statusRate = 0;
+        m_statusStreamSynced = false;
+        m_notificationIdValid = false;
         setState(StateDisconnected);
     }
 }
 
 void RobotController::onInterfacePacketReceived(const QByteArray &packetData)
 {
+    if (packetData.length() < 2) {
+        qCWarning(dcRobotController()) << "Received packet which is too short" << packetData.toHex();
+        return;
+    }
+
+    if (static_cast<quint8>(packetData.at(0)) >= RobotControllerPacket::NotificationReady) {
+        processNotification(packetData);
+        return;
+    }
+
+    RobotControllerPacket packet(packetData);
+    if (packet.type() != RobotControllerPacket::TypeResponse)
+        return;
+
+    // Jog setpoints have no reply, the firmware only responds if one got rejected
+    if (packet.packetId() == jogPacketId) {
+        qCWarning(dcRobotController()) << "Jog setpoint rejected" << packet.status();
+        return;
+    }
+
+    RobotControllerReply *reply = m_pendingReplies.take(packet.packetId());
+    if (!reply) {
+        qCDebug(dcRobotController()) << "Received response without pending request" << packet;
+        return;
+    }
+
+    reply->m_responsePacket = packet;
+    reply->setFinished();
+}
+
+void RobotController::processNotification(const QByteArray &packetData)
+{
+    // Status notifications arrive at high rates, parse them in place instead of building a packet
+    const char *payload = packetData.constData() + 2;
+    int payloadLength = packetData.length() - 2;
 
+    // Notification ids are continuous, a gap means we lost a frame on the line
+    quint8 notificationId = static_cast<quint8>(packetData.at(1));
+    bool notificationLost = m_notificationIdValid && notificationId != static_cast<quint8>(m_lastNotificationId + 1);
+    m_lastNotificationId = notificationId;
+    m_notificationIdValid = true;
+
+    if (notificationLost && m_statusStreamSynced) {
+        qCDebug(dcRobotController()) << "Lost status notification, waiting for the next keyframe";
+        m_statusStreamSynced = false;
+
+        // Subscribing again makes the firmware start over with a keyframe
+        if (m_statusRate > 0) {
+            subscribeStatus(m_statusRate);
+        }
+    }
+
+    switch (static_cast<quint8>(packetData.at(0))) {
+    case RobotControllerPacket::NotificationStatus:
+        if (payloadLength < 1)
+            return;
+
+        if (static_cast<quint8>(payload[0]) & RobotStatus::FieldKeyframe) {
+            m_statusStreamSynced = true;
+        } else if (!m_statusStreamSynced) {
+            return;
+        }
+
+        if (!m_streamStatus.mergeNotificationPayload(payload, payloadLength)) {
+            qCWarning(dcRobotController()) << "Received invalid status notification" << packetData.toHex();
+            m_statusStreamSynced = false;
+            return;
+        }
+
+        m_status = m_streamStatus;
+        emit statusChanged(m_status);
+        break;
+    case RobotControllerPacket::NotificationDebugMessage:
+        qCDebug(dcRobotController()) << "Firmware:" << QString::fromUtf8(payload, payloadLength);
+        break;
+    case RobotControllerPacket::NotificationReady:
+        qCDebug(dcRobotController()) << "Firmware ready";
+        break;
+    default:
+        qCDebug(dcRobotController()) << "Received unhandled notification" << RobotControllerPacket(packetData);
+        break;
+    }
 }
 
 void RobotController::setState(State state)
@@ -107,6 +296,15 @@ void RobotController::setState(State state)
     emit stateChanged(m_state);
 }
 
+quint8 RobotController::nextPacketId()
+{
+    // The jog id is reserved, a reply to a request must never be taken for a rejected setpoint
+    if (m_packetId == jogPacketId)
+        m_packetId = 0;
+
+    return m_packetId++;
+}
+
 RobotControllerReply *RobotController::createReply(const RobotControllerPacket &requestPacket)
 {
     RobotControllerReply *reply = new RobotControllerReply(requestPacket, this);
@@ -118,5 +316,13 @@ RobotControllerReply *RobotController::createReply(const RobotControllerPacket &
     });
 
     return reply;
+}
 
+RobotControllerReply *RobotController::sendRequest(const RobotControllerPacket &requestPacket)
+{
+    RobotControllerReply *reply = createReply(requestPacket);
+    m_uartInterface->sendPacket(reply->requestPacket());
+    m_pendingReplies.insert(reply->packetId(), reply);
+    reply->startWait();
+    return reply;
 }
@@ -6,6 +6,7 @@
 
 #include "uartinterface.h"
 #include "robotcontrollerreply.h"
+#include "robotstatus.h"
 
 Q_DECLARE_LOGGING_CATEGORY(dcRobotController)
 
@@ -32,30 +33,80 @@ public:
 
     State state() const;
     QString firmwareVersion() const;
+    RobotStatus status() const;
 
     RobotControllerReply *getFirmwareVersion();
 
+    // Reads positions, queue depth, flags and timestamp in one round trip, updates status() once finished
+    RobotControllerReply *getStatus();
+
+    // Let the firmware push status notifications with the given rate (10 - 1000 Hz, 0 stops).
+    // Every update emits statusChanged(). The stream sends deltas between periodic keyframes,
+    // after a lost notification updates are held back until the next keyframe arrived.
+    RobotControllerReply *subscribeStatus(quint16 rate);
+
+    // Coordinated move of all axes to the absolute step positions. Acceleration, max speed and jerk
+    // apply to the axis with the most steps, the others are scaled so all of them arrive together.
+    // A jerk > 0 selects the jerk limited S-curve profile instead of the trapezoidal one.
+    RobotControllerReply *moveTo(qint32 x, qint32 y, qint32 z, quint16 acceleration, quint16 maxSpeed, quint32 jerk = 0);
+
+    // Planned segment (see MotionPlanner::takeSegment()), entered and left with the given ramp index
+    // n = v^2 / (2 * a) of the dominant axis. The firmware only leaves with speed if the next segment
+    // is queued by then, so keep a few segments ahead.
+    RobotControllerReply *moveSegment(qint32 x, qint32 y, qint32 z, quint16 acceleration, quint16 maxSpeed, quint16 entryIndex, quint16 exitIndex);
+
+    // Step table entries in the wire format (see StepTableCompiler), at most 4 per request. Playback starts once
+    // the firmware buffer is full, an empty request starts it right away. Reply status busy: buffer full, resend.
+    RobotControllerReply *queueStepTable(const QByteArray &entries);
+
+    // Velocity mode [steps/s per axis], meant to be called with 100 Hz or more. Setpoints are sent
+    // without a reply, the firmware only answers failures. Without a new setpoint within 200 ms
+    // the firmware ramps down to a stop on its own, so just stop calling it (or jog(0, 0, 0)).
+    void jog(qint16 x, qint16 y, qint16 z, quint16 acceleration);
+
+    // Real-time commands, sent ahead of all queued requests without a reply. A feed hold ramps
+    // down and keeps the queued motion, the emergency stop drops it and disables the drivers.
+    // requestStatus() makes the firmware send a complete status notification right away.
+    void feedHold();
+    void resume();
+    void emergencyStop();
+    void requestStatus();
+
 signals:
     void stateChanged(State state);
     void firmwareVersionChaged(const QString &firmwareVersion);
+    void statusChanged(const RobotStatus &status);
 
 private slots:
     void onInterfaceAvailableChanged(bool available);
     void onInterfacePacketReceived(const QByteArray &packetData);
+    void processNotification(const QByteArray &packetData);
 
 private:
     UartInterface *m_uartInterface = nullptr;
 
     State m_state = StateUnknown;
     QString m_firmwareVersion;
+    RobotStatus m_status;
+
+    // Status stream, deltas only apply to a status which saw every notification since the last keyframe.
+    // Kept apart from m_status, a status read by getStatus() in between must not become the base of the deltas.
+    RobotStatus m_streamStatus;
+    quint16 m_statusRate = 0;
+    bool m_statusStreamSynced = false;
+    bool m_notificationIdValid = false;
+    quint8 m_lastNotificationId = 0;
 
     void setState(State state);
 
-    // Protocol
+    // Protocol, jog setpoints are sent with a fixed id outside of the request ids
+    static const quint8 jogPacketId = 0xff;
     quint8 m_packetId = 0;
     QHash<quint8, RobotControllerReply *> m_pendingReplies;
 
+    quint8 nextPacketId();
     RobotControllerReply *createReply(const RobotControllerPacket &requestPacket);
+    RobotControllerReply *sendRequest(const RobotControllerPacket &requestPacket);
 
 };
 
@@ -4,14 +4,15 @@
 RobotControllerPacket::RobotControllerPacket(const QByteArray &packetData) :
     m_packetData{packetData}
 {
-    m_command = static_cast<Command>(m_packetData.at(0));
+    m_command = static_cast<Command>(static_cast<quint8>(m_packetData.at(0)));
     m_packetId = static_cast<quint8>(m_packetData.at(1));
-    if (m_command <= 0xf0 ) {
+    if (m_command < 0xf0 && m_packetData.length() >= 3) {
         m_type = TypeResponse;
-        m_status = static_cast<Status>(m_packetData.at(2));
+        m_status = static_cast<Status>(static_cast<quint8>(m_packetData.at(2)));
         m_payload = m_packetData.right(m_packetData.length() - 3);
     } else {
         m_type = TypeNotification;
+        m_notification = static_cast<Notification>(static_cast<quint8>(m_packetData.at(0)));
         m_payload = m_packetData.right(m_packetData.length() - 2);
     }
 
@@ -50,7 +51,7 @@ RobotControllerPacket::Command RobotControllerPacket::command() const
 RobotControllerPacket::Notification RobotControllerPacket::notification() const
 {
     Q_ASSERT_X(m_type == TypeNotification, "RobotControllerPacket", "reading notification() from packet which is a request or response.");
-    return notification();
+    return m_notification;
 }
 
 quint8 RobotControllerPacket::packetId() const
@@ -94,7 +95,7 @@ QDebug operator<<(QDebug debug, const RobotControllerPacket &packet)
         break;
     case RobotControllerPacket::TypeNotification:
         debug.nospace() << "Notification, ";
-        debug.nospace() << static_cast<RobotControllerPacket::Notification>(packet.command()) << ", ";
+        debug.nospace() << packet.notification() << ", ";
         debug.nospace() << "id: " << UartInterface::byteToHexString(packet.packetId())  << " (" << packet.packetId() << ")";
         if (!packet.payload().isEmpty())
             debug.nospace() << ", " << packet.payload().toHex();
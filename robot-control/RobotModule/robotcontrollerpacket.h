@@ -21,20 +21,28 @@ public:
         StatusInvalidProtocol = 0x01,
         StatusInvalidCommand = 0x02,
         StatusInvalidPlayload = 0x03,
+        StatusBusy = 0x04,
         StatusUnknown = 0xff
     };
     Q_ENUM(Status)
 
     enum Command {
-        CommandGetStatus,
-        CommandGetFirmwareVersion,
+        CommandGetFirmwareVersion = 0x00,
+        CommandGetStatus = 0x01,
+        CommandSubscribeStatus = 0x02,
+        CommandEnableSteppers = 0x10,
+        CommandMoveTo = 0x20,
+        CommandJog = 0x21,
+        CommandMoveSegment = 0x22,
+        CommandStepTable = 0x23,
         CommandUnknown = 0xff
     };
     Q_ENUM(Command)
 
     enum Notification {
-        NotificationReady,
-        NotificationUnknown = 0xff
+        NotificationReady = 0xf0,
+        NotificationStatus = 0xf1,
+        NotificationDebugMessage = 0xff
     };
     Q_ENUM(Notification)
 
@@ -57,7 +65,7 @@ public:
 private:
     Type m_type = TypeUnknown;
     Command m_command = CommandUnknown;
-    Notification m_notification = NotificationUnknown;
+    Notification m_notification = NotificationDebugMessage;
 
     quint8 m_packetId = 0;
     Status m_status = StatusUnknown;
@@ -0,0 +1,185 @@
+#include "robotstatus.h"
+#include "uartinterface.h"
+
+#include <QtEndian>
+
+bool RobotStatus::parsePayload(const char *data, int length)
+{
+    if (length != payloadSize)
+        return false;
+
+    const uchar *payload = reinterpret_cast<const uchar *>(data);
+    for (int i = 0; i < 3; i++) {
+        m_positions[i] = qFromLittleEndian<qint32>(payload + i * 4);
+    }
+    m_queueDepth = payload[12];
+    m_flags = payload[13];
+    m_timestamp = qFromLittleEndian<quint32>(payload + 14);
+    m_valid = true;
+    return true;
+}
+
+bool RobotStatus::mergeNotificationPayload(const char *data, int length)
+{
+    if (length < 1)
+        return false;
+
+    const uchar *payload = reinterpret_cast<const uchar *>(data);
+    const uchar *end = payload + length;
+    quint8 fields = *payload++;
+
+    // Decode into locals first, a truncated payload must not leave a half updated status
+    qint32 positions[3] = { m_positions[0], m_positions[1], m_positions[2] };
+    quint8 queueDepth = m_queueDepth;
+    quint8 flags = m_flags;
+    quint32 timestamp = 0;
+
+    if (fields & FieldKeyframe) {
+        // Field mask, timestamp and x, y, z as int32
+        if (end - payload < 16)
+            return false;
+
+        timestamp = qFromLittleEndian<quint32>(payload);
+        payload += 4;
+        for (int i = 0; i < 3; i++) {
+            positions[i] = qFromLittleEndian<qint32>(payload);
+            payload += 4;
+        }
+    } else {
+        // Field mask, timestamp and the changed positions as zig-zag varint deltas
+        quint32 timestampDelta = 0;
+        if (!readVarint(payload, end, &timestampDelta))
+            return false;
+
+        timestamp = m_timestamp + timestampDelta;
+        for (int i = 0; i < 3; i++) {
+            if (!(fields & (FieldPositionX << i)))
+                continue;
+
+            quint32 zigZag = 0;
+            if (!readVarint(payload, end, &zigZag))
+                return false;
+
+            qint32 delta = static_cast<qint32>(zigZag >> 1) ^ -static_cast<qint32>(zigZag & 1);
+            positions[i] = static_cast<qint32>(static_cast<quint32>(positions[i]) + static_cast<quint32>(delta));
+        }
+    }
+
+    if (fields & FieldQueueDepth) {
+        if (payload >= end)
+            return false;
+
+        queueDepth = *payload++;
+    }
+    if (fields & FieldFlags) {
+        if (payload >= end)
+            return false;
+
+        flags = *payload++;
+    }
+
+    if (payload != end)
+        return false;
+
+    for (int i = 0; i < 3; i++) {
+        m_positions[i] = positions[i];
+    }
+    m_queueDepth = queueDepth;
+    m_flags = flags;
+    m_timestamp = timestamp;
+    if (fields & FieldKeyframe)
+        m_valid = true;
+
+    return true;
+}
+
+bool RobotStatus::readVarint(const uchar *&data, const uchar *end, quint32 *value)
+{
+    // 7 bits per byte, least significant group first, at most 5 bytes for 32 bit
+    quint32 result = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        if (data >= end)
+            return false;
+
+        uchar byte = *data++;
+        result |= static_cast<quint32>(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            *value = result;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+qint32 RobotStatus::positionX() const
+{
+    return m_positions[0];
+}
+
+qint32 RobotStatus::positionY() const
+{
+    return m_positions[1];
+}
+
+qint32 RobotStatus::positionZ() const
+{
+    return m_positions[2];
+}
+
+qint32 RobotStatus::position(int axis) const
+{
+    Q_ASSERT_X(axis >= 0 && axis < 3, "RobotStatus", "axis out of range");
+    return m_positions[axis];
+}
+
+quint8 RobotStatus::queueDepth() const
+{
+    return m_queueDepth;
+}
+
+quint8 RobotStatus::flags() const
+{
+    return m_flags;
+}
+
+bool RobotStatus::steppersEnabled() const
+{
+    return m_flags & FlagSteppersEnabled;
+}
+
+bool RobotStatus::moving() const
+{
+    return m_flags & FlagMoving;
+}
+
+bool RobotStatus::queueFull() const
+{
+    return m_flags & FlagQueueFull;
+}
+
+bool RobotStatus::feedHold() const
+{
+    return m_flags & FlagFeedHold;
+}
+
+quint32 RobotStatus::timestamp() const
+{
+    return m_timestamp;
+}
+
+bool RobotStatus::isValid() const
+{
+    return m_valid;
+}
+
+QDebug operator<<(QDebug debug, const RobotStatus &status)
+{
+    QDebugStateSaver saver(debug);
+    debug.nospace() << "RobotStatus(";
+    debug.nospace() << status.positionX() << ", " << status.positionY() << ", " << status.positionZ();
+    debug.nospace() << ", queue: " << status.queueDepth();
+    debug.nospace() << ", flags: " << UartInterface::byteToHexString(status.flags());
+    debug.nospace() << ", timestamp: " << status.timestamp() << "us)";
+    return debug;
+}
@@ -0,0 +1,84 @@
+#ifndef ROBOTSTATUS_H
+#define ROBOTSTATUS_H
+
+#include <QObject>
+#include <QDebug>
+
+class RobotStatus
+{
+    Q_GADGET
+
+    Q_PROPERTY(qint32 positionX READ positionX CONSTANT FINAL)
+    Q_PROPERTY(qint32 positionY READ positionY CONSTANT FINAL)
+    Q_PROPERTY(qint32 positionZ READ positionZ CONSTANT FINAL)
+    Q_PROPERTY(quint8 queueDepth READ queueDepth CONSTANT FINAL)
+    Q_PROPERTY(bool steppersEnabled READ steppersEnabled CONSTANT FINAL)
+    Q_PROPERTY(bool moving READ moving CONSTANT FINAL)
+    Q_PROPERTY(bool queueFull READ queueFull CONSTANT FINAL)
+    Q_PROPERTY(bool feedHold READ feedHold CONSTANT FINAL)
+    Q_PROPERTY(quint32 timestamp READ timestamp CONSTANT FINAL)
+
+public:
+    enum Flag {
+        FlagSteppersEnabled = 0x01,
+        FlagMoving = 0x02,
+        FlagQueueFull = 0x04,
+        FlagFeedHold = 0x08
+    };
+    Q_ENUM(Flag)
+
+    // Size of the CommandGetStatus response payload
+    static constexpr int payloadSize = 18;
+
+    RobotStatus() = default;
+
+    enum Field {
+        FieldPositionX = 0x01,
+        FieldPositionY = 0x02,
+        FieldPositionZ = 0x04,
+        FieldQueueDepth = 0x08,
+        FieldFlags = 0x10,
+        FieldKeyframe = 0x80
+    };
+    Q_ENUM(Field)
+
+    // Parses the fixed layout status payload, returns false if the payload is invalid
+    bool parsePayload(const char *data, int length);
+
+    // Applies a status notification payload to this status. Keyframes carry absolute values,
+    // every other notification carries deltas against the previous one and only applies on top
+    // of the status built from all notifications since the last keyframe.
+    bool mergeNotificationPayload(const char *data, int length);
+
+    qint32 positionX() const;
+    qint32 positionY() const;
+    qint32 positionZ() const;
+    qint32 position(int axis) const;
+
+    quint8 queueDepth() const;
+    quint8 flags() const;
+
+    bool steppersEnabled() const;
+    bool moving() const;
+    bool queueFull() const;
+    bool feedHold() const;
+
+    // Firmware time of the snapshot in us
+    quint32 timestamp() const;
+
+    bool isValid() const;
+
+private:
+    static bool readVarint(const uchar *&data, const uchar *end, quint32 *value);
+
+    qint32 m_positions[3] = { 0, 0, 0 };
+    quint8 m_queueDepth = 0;
+    quint8 m_flags = 0;
+    quint32 m_timestamp = 0;
+    bool m_valid = false;
+
+};
+
+QDebug operator<<(QDebug debug, const RobotStatus &status);
+
+#endif // ROBOTSTATUS_H
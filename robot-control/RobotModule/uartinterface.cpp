@@ -19,6 +19,12 @@ UartInterface::UartInterface(QObject *parent)
         qCWarning(dcUartInterface()) << "Error occurred" << error << m_serialPort->errorString();
     });
 
+    connect(m_serialPort, &QSerialPort::bytesWritten, this, [this](){
+        if (m_serialPort->bytesToWrite() == 0) {
+            writeNextFrame();
+        }
+    });
+
     connect(m_serialPort, &QSerialPort::readyRead, this, [this](){
         QByteArray data = m_serialPort->readAll();
         for (int i = 0; i < data.length(); i++) {
@@ -37,11 +43,11 @@ UartInterface::UartInterface(QObject *parent)
 
                 // Data in the buffer has already been unescaped.
 
-                // Last byte is the crc
+                // Last two bytes are the crc, low byte first
                 QByteArray packetData = m_dataBuffer.left(m_dataBuffer.length() - 2);
                 /* Verify crc */
-                quint16 crcReceived = m_dataBuffer.at(m_dataBuffer.length() - 1);
-                crcReceived |= m_dataBuffer.at(m_dataBuffer.length() - 2) << 8;
+                quint16 crcReceived = static_cast<quint8>(m_dataBuffer.at(m_dataBuffer.length() - 2));
+                crcReceived |= static_cast<quint8>(m_dataBuffer.at(m_dataBuffer.length() - 1)) << 8;
 
                 quint16 crcCalculated = calculateCrc(packetData);
                 if (crcCalculated != crcReceived) {
@@ -99,6 +105,7 @@ void UartInterface::setSerialPortInfo(const QSerialPortInfo &serialPortInfo)
 
     m_serialPortInfo = serialPortInfo;
     m_serialPort->close();
+    m_txQueue.clear();
 
     m_available = false;
     emit availableChanged(m_available);
@@ -123,14 +130,29 @@ bool UartInterface::available() const
 void UartInterface::sendPacket(const RobotControllerPacket &packet)
 {
     qCDebug(dcUartInterface()) << "Sending packet" << packet.packetData().toHex();
-    streamByte(ProtocolByteEnd, true);
+
+    QByteArray frame;
+    streamByte(frame, ProtocolByteEnd, true);
     for (int i = 0; i < packet.packetData().size(); i++) {
-        streamByte(static_cast<quint8>(packet.packetData().at(i)));
+        streamByte(frame, static_cast<quint8>(packet.packetData().at(i)));
     }
     quint16 crc = calculateCrc(packet.packetData());
-    streamByte(static_cast<quint8>(crc) & 0xff);
-    streamByte(static_cast<quint8>(crc >> 8) & 0xff);
-    streamByte(ProtocolByteEnd, true);
+    streamByte(frame, static_cast<quint8>(crc) & 0xff);
+    streamByte(frame, static_cast<quint8>(crc >> 8) & 0xff);
+    streamByte(frame, ProtocolByteEnd, true);
+
+    m_txQueue.enqueue(frame);
+    if (m_serialPort->bytesToWrite() == 0) {
+        writeNextFrame();
+    }
+}
+
+void UartInterface::sendRealtimeCommand(RealtimeCommand command)
+{
+    // Skip the frame queue, the byte may even end up in the middle of a frame on the line
+    qCDebug(dcUartInterface()) << "Sending real-time command" << command;
+    m_serialPort->write(QByteArray(1, static_cast<char>(command)));
+    m_serialPort->flush();
 }
 
 void UartInterface::enable()
@@ -185,34 +207,45 @@ quint16 UartInterface::calculateCrc(const QByteArray &data)
     return crc;
 }
 
-void UartInterface::streamByte(quint8 byte, bool specialCharacter)
+void UartInterface::streamByte(QByteArray &frame, quint8 byte, bool specialCharacter)
 {
     // Special byte: write the byte as given
     if (specialCharacter) {
-        writeByte(byte);
+        frame.append(static_cast<char>(byte));
         return;
     }
 
     // Not a special character, we need to stuff the bytes we are gping to sent
     switch(byte) {
     case ProtocolByteEnd:
-        writeByte(ProtocolByteEsc);
-        writeByte(ProtocolByteTransposedEnd);
+        frame.append(static_cast<char>(ProtocolByteEsc));
+        frame.append(static_cast<char>(ProtocolByteTransposedEnd));
         break;
     case ProtocolByteEsc:
-        writeByte(ProtocolByteEsc);
-        writeByte(ProtocolByteTransposedEsc);
+        frame.append(static_cast<char>(ProtocolByteEsc));
+        frame.append(static_cast<char>(ProtocolByteTransposedEsc));
+        break;
+    case RealtimeCommandStatus:
+    case RealtimeCommandFeedHold:
+    case RealtimeCommandResume:
+    case RealtimeCommandEmergencyStop:
+        frame.append(static_cast<char>(ProtocolByteEsc));
+        frame.append(static_cast<char>(byte ^ 0x10));
         break;
     default:
-        writeByte(byte);
+        frame.append(static_cast<char>(byte));
     }
 
 }
 
-void UartInterface::writeByte(quint8 byte)
+void UartInterface::writeNextFrame()
 {
-    qCDebug(dcUartInterface()) << "-->" << UartInterface::byteToHexString(byte);
-    m_serialPort->write(QByteArray(1, byte));
+    if (m_txQueue.isEmpty() || !m_serialPort->isOpen())
+        return;
+
+    QByteArray frame = m_txQueue.dequeue();
+    qCDebug(dcUartInterface()) << "-->" << frame.toHex();
+    m_serialPort->write(frame);
 }
 
 void UartInterface::processData(const QByteArray &data)
@@ -2,6 +2,7 @@
 #define UARTINTERFACE_H
 
 #include <QObject>
+#include <QQueue>
 #include <QQmlEngine>
 #include <QSerialPort>
 #include <QSerialPortInfo>
@@ -29,6 +30,16 @@ public:
     };
     Q_ENUM(ProtocolByte)
 
+    // Single bytes outside of any frame, the firmware acts on them as soon as they arrive.
+    // Inside a frame these values get escaped: ProtocolByteEsc followed by the byte ^ 0x10.
+    enum RealtimeCommand {
+        RealtimeCommandStatus = 0xF8,
+        RealtimeCommandFeedHold = 0xF9,
+        RealtimeCommandResume = 0xFA,
+        RealtimeCommandEmergencyStop = 0xFB
+    };
+    Q_ENUM(RealtimeCommand)
+
     explicit UartInterface(QObject *parent = nullptr);
 
     QSerialPortInfo serialPortInfo() const;
@@ -37,7 +48,10 @@ public:
     bool enabled() const;
     bool available() const;
 
+    // Frames get queued and handed to the port one at a time, so a real-time command
+    // never waits for more than the frame which is on the line right now.
     void sendPacket(const RobotControllerPacket &packet);
+    void sendRealtimeCommand(RealtimeCommand command);
 
     static inline QString byteToHexString(quint8 byte) {
         return QString("0x%1").arg(byte, 2, 16, QLatin1Char('0'));
@@ -68,10 +82,12 @@ private:
     QByteArray m_dataBuffer;
     bool m_escape = false;
 
+    QQueue<QByteArray> m_txQueue;
+
     quint16 calculateCrc(const QByteArray &data);
 
-    void streamByte(quint8 byte, bool specialCharacter = false);
-    void writeByte(quint8 byte);
+    void streamByte(QByteArray &frame, quint8 byte, bool specialCharacter = false);
+    void writeNextFrame();
 
     void processData(const QByteArray &data);
     void resetBuffer();
@@ -0,0 +1,204 @@
+// Compares the chord tolerance ArcExpander with the fixed segment length arcs of GRBL's mc_arc().
+//
+// For a set of arcs, or all arcs of a program, prints the number of segments and the largest deviation of the
+// polyline from the true arc for both. GRBL runs with its defaults: 0.1 mm per segment, single precision, small
+// angle rotation with an exact correction every 25 segments.
+//
+// Build:  cmake -S .. -B ../build && cmake --build ../build --target arc-benchmark
+// Usage:  ./arc-benchmark [tolerance mm] [program]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <vector>
+
+#include <QElapsedTimer>
+
+#include "arcexpander.h"
+#include "gcodeinterpreter.h"
+
+static const float grblMillimetersPerArcSegment = 0.1f;
+static const int grblArcCorrection = 25;
+
+struct Point
+{
+    double a;
+    double b;
+};
+
+struct Result
+{
+    long segments = 0;
+    double maxError = 0;
+};
+
+// mc_arc() in the plane of the arc, returns the segment end points
+static std::vector<Point> grblArc(const ArcExpander &arc, const GCodeMove &move, int axis0, int axis1)
+{
+    float radius = static_cast<float>(arc.radius());
+    float centerAxis0 = static_cast<float>(arc.center()[axis0]);
+    float centerAxis1 = static_cast<float>(arc.center()[axis1]);
+    float offset0 = centerAxis0 - static_cast<float>(move.start[axis0]);
+    float offset1 = centerAxis1 - static_cast<float>(move.start[axis1]);
+    float rAxis0 = -offset0;
+    float rAxis1 = -offset1;
+
+    float angularTravel = static_cast<float>(arc.angularTravel());
+    float millimetersOfTravel = fabsf(angularTravel * radius);
+    int segments = static_cast<int>(floorf(millimetersOfTravel / grblMillimetersPerArcSegment));
+    if (segments < 1)
+        segments = 1;
+
+    float thetaPerSegment = angularTravel / segments;
+    float cosT = 1 - 0.5f * thetaPerSegment * thetaPerSegment;
+    float sinT = thetaPerSegment;
+
+    std::vector<Point> points;
+    int count = 0;
+    for (int i = 1; i < segments; i++) {
+        if (count < grblArcCorrection) {
+            float rAxisi = rAxis0 * sinT + rAxis1 * cosT;
+            rAxis0 = rAxis0 * cosT - rAxis1 * sinT;
+            rAxis1 = rAxisi;
+            count++;
+        } else {
+            float cosTi = cosf(i * thetaPerSegment);
+            float sinTi = sinf(i * thetaPerSegment);
+            rAxis0 = -offset0 * cosTi + offset1 * sinTi;
+            rAxis1 = -offset0 * sinTi - offset1 * cosTi;
+            count = 0;
+        }
+        points.push_back({ centerAxis0 + rAxis0, centerAxis1 + rAxis1 });
+    }
+    points.push_back({ move.target[axis0], move.target[axis1] });
+    return points;
+}
+
+// Largest distance between the polyline and the circle: radial error of the vertices and of the chord middles
+static double maxDeviation(const ArcExpander &arc, const GCodeMove &move, int axis0, int axis1, const std::vector<Point> &points)
+{
+    double center0 = arc.center()[axis0];
+    double center1 = arc.center()[axis1];
+    double radius = arc.radius();
+
+    double maxError = 0;
+    Point previous = { move.start[axis0], move.start[axis1] };
+    for (const Point &point : points) {
+        double vertexError = fabs(hypot(point.a - center0, point.b - center1) - radius);
+        double middleError = fabs(hypot(0.5 * (previous.a + point.a) - center0, 0.5 * (previous.b + point.b) - center1) - radius);
+        maxError = fmax(maxError, fmax(vertexError, middleError));
+        previous = point;
+    }
+
+    return maxError;
+}
+
+static bool compareArc(ArcExpander *expander, const GCodeMove &move, Result *grbl, Result *chord)
+{
+    if (!expander->expand(move)) {
+        fprintf(stderr, "Line %lld: %s\n", static_cast<long long>(move.lineNumber), expander->errorString().toUtf8().constData());
+        return false;
+    }
+
+    int axis0, axis1, linearAxis;
+    ArcExpander::planeAxes(move.plane, &axis0, &axis1, &linearAxis);
+
+    std::vector<Point> grblPoints = grblArc(*expander, move, axis0, axis1);
+    grbl->segments += static_cast<long>(grblPoints.size());
+    grbl->maxError = fmax(grbl->maxError, maxDeviation(*expander, move, axis0, axis1, grblPoints));
+
+    std::vector<Point> chordPoints;
+    for (int i = 0; i < expander->pointCount(); i++) {
+        chordPoints.push_back({ expander->points(axis0)[i], expander->points(axis1)[i] });
+    }
+    chord->segments += expander->pointCount();
+    chord->maxError = fmax(chord->maxError, maxDeviation(*expander, move, axis0, axis1, chordPoints));
+    return true;
+}
+
+static GCodeMove circleMove(double radius, double degrees)
+{
+    GCodeMove move;
+    move.type = GCodeMove::TypeArcCounterClockwise;
+    move.start[0] = radius;
+    move.offset[0] = -radius;
+    double angle = degrees * M_PI / 180.0;
+    move.target[0] = radius * cos(angle);
+    move.target[1] = radius * sin(angle);
+    return move;
+}
+
+static void printResult(const char *name, const Result &grbl, const Result &chord)
+{
+    printf("%-24s %10ld %12.6f %10ld %12.6f %8.1fx\n", name, grbl.segments, grbl.maxError, chord.segments, chord.maxError,
+           chord.segments > 0 ? static_cast<double>(grbl.segments) / chord.segments : 0.0);
+}
+
+int main(int argc, char *argv[])
+{
+    double tolerance = argc > 1 ? strtod(argv[1], nullptr) : 0.002;
+    ArcExpander expander(tolerance);
+
+    printf("Chord tolerance %.4f mm, GRBL %.2f mm per segment\n\n", tolerance, grblMillimetersPerArcSegment);
+    printf("%-24s %10s %12s %10s %12s %9s\n", "arc", "grbl segs", "grbl error", "chord segs", "chord error", "fewer");
+
+    if (argc > 2) {
+        GCodeInterpreter interpreter;
+        if (!interpreter.open(argv[2])) {
+            fprintf(stderr, "%s\n", interpreter.errorString().toUtf8().constData());
+            return EXIT_FAILURE;
+        }
+
+        Result grbl;
+        Result chord;
+        long arcs = 0;
+        GCodeMove move;
+        while (interpreter.next(&move)) {
+            if (move.type != GCodeMove::TypeArcClockwise && move.type != GCodeMove::TypeArcCounterClockwise)
+                continue;
+
+            if (!compareArc(&expander, move, &grbl, &chord))
+                return EXIT_FAILURE;
+
+            arcs++;
+        }
+
+        if (interpreter.hasError()) {
+            fprintf(stderr, "%s\n", interpreter.errorString().toUtf8().constData());
+            return EXIT_FAILURE;
+        }
+
+        char name[64];
+        snprintf(name, sizeof(name), "%ld arcs", arcs);
+        printResult(name, grbl, chord);
+        return EXIT_SUCCESS;
+    }
+
+    const double radii[] = { 0.5, 2, 10, 50, 200, 1000 };
+    const double angles[] = { 90, 360 };
+    for (double radius : radii) {
+        for (double degrees : angles) {
+            Result grbl;
+            Result chord;
+            if (!compareArc(&expander, circleMove(radius, degrees), &grbl, &chord))
+                return EXIT_FAILURE;
+
+            char name[64];
+            snprintf(name, sizeof(name), "r %.1f mm, %.0f deg", radius, degrees);
+            printResult(name, grbl, chord);
+        }
+    }
+
+    // Evaluation cost of the batches
+    GCodeMove move = circleMove(1000, 360);
+    long points = 0;
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < 2000; i++) {
+        expander.expand(move);
+        points += expander.pointCount();
+    }
+    printf("\n%.1f ns per point (%d points per circle)\n", static_cast<double>(timer.nsecsElapsed()) / points, expander.pointCount());
+    return EXIT_SUCCESS;
+}
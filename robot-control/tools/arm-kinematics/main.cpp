@@ -0,0 +1,100 @@
+// Checks and benchmarks the batch inverse kinematics of the arm.
+//
+// Draws random joint angles within the limits, takes their positions as targets and converts them back to steps one
+// by one (libm atan2 / sqrt) and with the batch conversion. Prints the points per millisecond of both, the number of
+// points where the two disagree and the largest distance between a target and the position of its steps.
+//
+// Build:  cmake -S .. -B ../build && cmake --build ../build --target arm-kinematics
+// Usage:  ./arm-kinematics [arm.ini] [points]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <vector>
+#include <random>
+
+#include <QElapsedTimer>
+
+#include "armkinematics.h"
+
+int main(int argc, char *argv[])
+{
+    ArmKinematics kinematics;
+    if (argc > 1 && !kinematics.loadConfiguration(argv[1])) {
+        fprintf(stderr, "%s\n", kinematics.errorString().toUtf8().constData());
+        return EXIT_FAILURE;
+    }
+    int count = argc > 2 ? atoi(argv[2]) : 1000000;
+
+    const ArmConfiguration &arm = kinematics.configuration();
+    std::mt19937 random(42);
+    std::vector<double> points[3];
+    while (static_cast<int>(points[0].size()) < count) {
+        // Keep off the limits, rounding to steps may push a point there over it
+        double angles[3];
+        for (int joint = 0; joint < 3; joint++) {
+            double margin = 0.01 * (arm.maxAngle[joint] - arm.minAngle[joint]);
+            std::uniform_real_distribution<double> distribution(arm.minAngle[joint] + margin, arm.maxAngle[joint] - margin);
+            angles[joint] = distribution(random);
+        }
+
+        // The other elbow configuration reaches the same point
+        if ((angles[2] > 0) == arm.elbowUp)
+            angles[2] = -angles[2];
+
+        // Reaching back over the base axis the arm gets there with other angles, maybe beyond a limit
+        double position[3];
+        double check[3];
+        kinematics.forward(angles, position);
+        if (!kinematics.inverse(position, check))
+            continue;
+
+        for (int axis = 0; axis < 3; axis++)
+            points[axis].push_back(position[axis]);
+    }
+
+    std::vector<qint32> scalarSteps(3 * count);
+    std::vector<qint32> batchSteps(3 * count);
+
+    QElapsedTimer timer;
+    timer.start();
+    int scalarCount = 0;
+    for (int i = 0; i < count; i++) {
+        double position[3] = { points[0][i], points[1][i], points[2][i] };
+        if (kinematics.toSteps(position, &scalarSteps[3 * i]))
+            scalarCount++;
+    }
+    double scalarTime = timer.nsecsElapsed() / 1000000.0;
+
+    timer.restart();
+    int batchCount = kinematics.toSteps(points[0].data(), points[1].data(), points[2].data(), count, batchSteps.data());
+    double batchTime = timer.nsecsElapsed() / 1000000.0;
+
+    if (scalarCount != count || batchCount != count) {
+        fprintf(stderr, "Points out of reach: %d one by one, batch stopped at %d of %d\n", count - scalarCount, batchCount, count);
+        return EXIT_FAILURE;
+    }
+
+    int mismatches = 0;
+    double maxError = 0;
+    for (int i = 0; i < count; i++) {
+        for (int joint = 0; joint < 3; joint++) {
+            if (scalarSteps[3 * i + joint] != batchSteps[3 * i + joint]) {
+                mismatches++;
+                break;
+            }
+        }
+
+        double position[3];
+        kinematics.fromSteps(&batchSteps[3 * i], position);
+        double error = sqrt(pow(position[0] - points[0][i], 2) + pow(position[1] - points[1][i], 2) + pow(position[2] - points[2][i], 2));
+        maxError = fmax(maxError, error);
+    }
+
+    printf("%d points\n", count);
+    printf("one by one  %10.1f ms %12.0f points/ms\n", scalarTime, count / scalarTime);
+    printf("batch       %10.1f ms %12.0f points/ms  (%.1fx)\n", batchTime, count / batchTime, scalarTime / batchTime);
+    printf("%d points with other steps, largest distance from the target %.4f mm\n", mismatches, maxError);
+    return EXIT_SUCCESS;
+}
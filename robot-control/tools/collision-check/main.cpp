@@ -0,0 +1,196 @@
+// Checks a program for collisions of the arm with the obstacles of an STL file.
+//
+// The moves of the program get resampled into joint motions like the interpreter does and the whole trajectory gets
+// checked with the hierarchy. Without an STL file a fixture plate of about 130k triangles below the work area and a
+// clamp on it are generated. For comparison the first poses are checked once more without a hierarchy (all triangles
+// in one leaf), both results have to agree.
+//
+// Build:  cmake -S .. -B ../build && cmake --build ../build --target collision-check
+// Usage:  ./collision-check <arm.ini> <program> [obstacles.stl] [sweep resolution mm] [poses without hierarchy]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <vector>
+#include <algorithm>
+
+#include <QElapsedTimer>
+
+#include "collisionchecker.h"
+#include "gcodeinterpreter.h"
+
+static void addQuad(QList<CollisionTriangle> *triangles, const double a[3], const double b[3], const double c[3], const double d[3])
+{
+    CollisionTriangle first;
+    CollisionTriangle second;
+    for (int axis = 0; axis < 3; axis++) {
+        first.vertices[0][axis] = a[axis];
+        first.vertices[1][axis] = b[axis];
+        first.vertices[2][axis] = c[axis];
+        second.vertices[0][axis] = a[axis];
+        second.vertices[1][axis] = c[axis];
+        second.vertices[2][axis] = d[axis];
+    }
+    triangles->append(first);
+    triangles->append(second);
+}
+
+// A slightly warped plate in front of the arm and a clamp standing on it
+static QList<CollisionTriangle> fixture()
+{
+    QList<CollisionTriangle> triangles;
+    const int cells = 256;
+    auto height = [](double x, double y) {
+        return 2 + 1.5 * sin(x * 0.05) * cos(y * 0.05);
+    };
+
+    for (int j = 0; j < cells; j++) {
+        for (int i = 0; i < cells; i++) {
+            double x0 = 100 + 250.0 * i / cells;
+            double x1 = 100 + 250.0 * (i + 1) / cells;
+            double y0 = -150 + 300.0 * j / cells;
+            double y1 = -150 + 300.0 * (j + 1) / cells;
+            double a[3] = { x0, y0, height(x0, y0) };
+            double b[3] = { x1, y0, height(x1, y0) };
+            double c[3] = { x1, y1, height(x1, y1) };
+            double d[3] = { x0, y1, height(x0, y1) };
+            addQuad(&triangles, a, b, c, d);
+        }
+    }
+
+    double min[3] = { 300, -20, 0 };
+    double max[3] = { 330, 20, 60 };
+    for (int axis = 0; axis < 3; axis++) {
+        int u = (axis + 1) % 3;
+        int v = (axis + 2) % 3;
+        for (int side = 0; side < 2; side++) {
+            double corners[4][3];
+            for (int k = 0; k < 4; k++) {
+                corners[k][axis] = side ? max[axis] : min[axis];
+                corners[k][u] = (k == 1 || k == 2) ? max[u] : min[u];
+                corners[k][v] = k >= 2 ? max[v] : min[v];
+            }
+            addQuad(&triangles, corners[0], corners[1], corners[2], corners[3]);
+        }
+    }
+
+    return triangles;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s <arm.ini> <program> [obstacles.stl] [sweep resolution mm] [poses without hierarchy]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    ArmKinematics kinematics;
+    if (!kinematics.loadConfiguration(argv[1])) {
+        fprintf(stderr, "%s\n", kinematics.errorString().toUtf8().constData());
+        return EXIT_FAILURE;
+    }
+
+    CollisionChecker checker(&kinematics);
+    if (argc > 4)
+        checker.setSweepResolution(strtod(argv[4], nullptr));
+    int bruteForceCount = argc > 5 ? atoi(argv[5]) : 200;
+
+    QElapsedTimer timer;
+    timer.start();
+    if (argc > 3 && argv[3][0]) {
+        if (!checker.loadObstacles(argv[3])) {
+            fprintf(stderr, "%s\n", checker.errorString().toUtf8().constData());
+            return EXIT_FAILURE;
+        }
+    } else {
+        checker.setObstacles(fixture());
+    }
+    printf("%d obstacle triangles, hierarchy built in %.3f ms\n", static_cast<int>(checker.obstacles().count()), timer.nsecsElapsed() / 1000000.0);
+
+    // The targets of all moves form the path, the position before the first move is not known to be reachable
+    GCodeInterpreter interpreter;
+    if (!interpreter.open(argv[2])) {
+        fprintf(stderr, "%s\n", interpreter.errorString().toUtf8().constData());
+        return EXIT_FAILURE;
+    }
+
+    std::vector<double> points[3];
+    std::vector<qint64> lineNumbers;
+    GCodeMove segment;
+    while (interpreter.nextSegment(&segment)) {
+        if (segment.type != GCodeMove::TypeSeek && segment.type != GCodeMove::TypeLinear)
+            continue;
+
+        for (int axis = 0; axis < 3; axis++)
+            points[axis].push_back(segment.target[axis]);
+        lineNumbers.push_back(segment.lineNumber);
+    }
+
+    if (interpreter.hasError()) {
+        fprintf(stderr, "%s\n", interpreter.errorString().toUtf8().constData());
+        return EXIT_FAILURE;
+    }
+
+    int pointCount = static_cast<int>(points[0].size());
+    PathResampler resampler(&kinematics, kinematics.configuration().lineTolerance);
+    timer.restart();
+    double start[3] = { points[0][0], points[1][0], points[2][0] };
+    double startAngles[3];
+    if (pointCount < 2 || !kinematics.inverse(start, startAngles)
+            || !resampler.resample(points[0].data(), points[1].data(), points[2].data(), pointCount)) {
+        fprintf(stderr, "Resampling failed: %s\n", resampler.errorString().toUtf8().constData());
+        return EXIT_FAILURE;
+    }
+    double resampleTime = timer.nsecsElapsed() / 1000000.0;
+
+    int poseCount = resampler.pointCount() + 1;
+    std::vector<double> angles[3];
+    for (int joint = 0; joint < 3; joint++) {
+        angles[joint].push_back(startAngles[joint]);
+        angles[joint].insert(angles[joint].end(), resampler.angles(joint), resampler.angles(joint) + resampler.pointCount());
+    }
+    const double *const poses[3] = { angles[0].data(), angles[1].data(), angles[2].data() };
+    printf("%d moves resampled into %d poses in %.3f ms\n", pointCount, poseCount, resampleTime);
+
+    // The line of the program moving to a pose
+    auto lineOf = [&](int pose) {
+        if (pose == 0)
+            return lineNumbers.front();
+
+        const QList<int> &lineEnds = resampler.lineEnds();
+        int line = static_cast<int>(std::lower_bound(lineEnds.begin(), lineEnds.end(), pose - 1) - lineEnds.begin());
+        return lineNumbers[line + 1];
+    };
+    const char *const links[3] = { "base", "upper arm", "forearm" };
+
+    timer.restart();
+    CollisionContact contact;
+    int reached = checker.check(poses, poseCount, &contact);
+    double checkTime = timer.nsecsElapsed() / 1000000.0;
+    printf("hierarchy           %10.3f ms %12.0f poses/ms\n", checkTime, reached / checkTime);
+    if (reached < poseCount) {
+        printf("The %s collides with %s on line %lld after %d poses\n", links[contact.link],
+               contact.triangle < 0 ? "the base" : "an obstacle", static_cast<long long>(lineOf(contact.pose)), reached);
+    } else {
+        printf("No collision\n");
+    }
+
+    int bruteForcePoses = qMin(qMin(bruteForceCount, poseCount), qMax(reached, 1));
+    CollisionChecker bruteForce(&kinematics);
+    bruteForce.setSweepResolution(checker.sweepResolution());
+    bruteForce.setLeafSize(static_cast<int>(checker.obstacles().count()));
+    bruteForce.setObstacles(checker.obstacles());
+
+    timer.restart();
+    int bruteForceReached = bruteForce.check(poses, bruteForcePoses);
+    double bruteForceTime = timer.nsecsElapsed() / 1000000.0;
+    int expected = qMin(reached, bruteForcePoses);
+    printf("one leaf            %10.3f ms %12.0f poses/ms  (first %d poses)\n", bruteForceTime, bruteForcePoses / bruteForceTime, bruteForcePoses);
+    if (bruteForceReached != expected) {
+        fprintf(stderr, "Without the hierarchy %d poses are reached, with it %d\n", bruteForceReached, expected);
+        return EXIT_FAILURE;
+    }
+
+    return reached < poseCount ? 2 : EXIT_SUCCESS;
+}
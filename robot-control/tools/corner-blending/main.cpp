@@ -0,0 +1,193 @@
+// Shows what blending the corners saves on a pick and place program.
+//
+// Without a program one gets generated: parts picked from a tray and placed on a pallet, every move a G0 lifting,
+// traversing and lowering the gripper, so each part has two 90 degree corners at the top and stops at the pick and
+// the place. The program gets planned with a look-ahead of 32 blocks like the streaming does, sharp and with a few
+// corner tolerances, and the largest distance between the blended path and the program is measured.
+//
+// Build:  cmake -S .. -B ../build && cmake --build ../build --target corner-blending
+// Usage:  ./corner-blending [program] [max speed mm/s] [acceleration mm/s^2] [steps per mm]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <vector>
+
+#include <QDir>
+#include <QElapsedTimer>
+
+#include "gcodeinterpreter.h"
+
+static const int lookAhead = 32;
+static const int partCount = 400;
+
+struct PlanResult
+{
+    qint64 blocks = 0;
+    qint64 corners = 0;
+    double duration = 0; // s
+    double elapsed = 0; // ms
+};
+
+static bool writeProgram(const QString &fileName)
+{
+    FILE *file = fopen(fileName.toUtf8().constData(), "w");
+    if (!file)
+        return false;
+
+    fprintf(file, "(Pick and place, %d parts)\nG21 G90\nG0 X0 Y0 Z30\n", partCount);
+    for (int part = 0; part < partCount; part++) {
+        // Tray of 10 x 10 pockets, pallet of 5 x 8 places
+        int pocket = part % 100;
+        int place = part % 40;
+        fprintf(file, "G0 X%.3f Y%.3f\nG0 Z0\nG0 Z30\n", 20.0 + 12 * (pocket % 10), 20.0 + 12 * (pocket / 10));
+        fprintf(file, "G0 X%.3f Y%.3f\nG0 Z5\nG0 Z30\n", 200.0 + 25 * (place % 5), -40.0 + 20 * (place / 5));
+    }
+    fprintf(file, "M2\n");
+    return fclose(file) == 0;
+}
+
+static bool planProgram(const QString &fileName, double tolerance, double maxSpeed, double acceleration, double stepsPerMillimeter, PlanResult *result)
+{
+    GCodeInterpreter interpreter;
+    interpreter.setCornerTolerance(tolerance);
+
+    MotionPlanner planner;
+    for (int axis = 0; axis < 3; axis++) {
+        interpreter.setStepsPerMillimeter(axis, stepsPerMillimeter);
+        planner.setMaxSpeed(axis, maxSpeed * stepsPerMillimeter);
+        planner.setAcceleration(axis, acceleration * stepsPerMillimeter);
+    }
+
+    const qint32 origin[3] = { 0, 0, 0 };
+    planner.reset(origin);
+
+    QElapsedTimer timer;
+    timer.start();
+
+    if (!interpreter.open(fileName)) {
+        fprintf(stderr, "%s\n", interpreter.errorString().toUtf8().constData());
+        return false;
+    }
+
+    MotionPlannerSegment segment;
+    while (true) {
+        int queued = interpreter.feedPlanner(&planner, lookAhead);
+        if (queued < 0) {
+            fprintf(stderr, "%s\n", interpreter.errorString().toUtf8().constData());
+            return false;
+        }
+
+        int keep = interpreter.finished() ? 0 : lookAhead - 1;
+        while (planner.blockCount() > keep) {
+            result->duration += planner.trapezoid(0).duration;
+            planner.takeSegment(&segment);
+            result->blocks++;
+        }
+
+        if (interpreter.finished())
+            break;
+    }
+
+    result->corners = interpreter.pathBlender().cornerCount();
+    result->elapsed = timer.nsecsElapsed() / 1000000.0;
+    return true;
+}
+
+static double distanceToMove(const double point[3], const GCodeMove &move)
+{
+    double direction[3];
+    double lengthSqr = 0;
+    double projection = 0;
+    for (int i = 0; i < 3; i++) {
+        direction[i] = move.target[i] - move.start[i];
+        lengthSqr += direction[i] * direction[i];
+        projection += direction[i] * (point[i] - move.start[i]);
+    }
+
+    double t = lengthSqr > 0 ? fmin(1.0, fmax(0.0, projection / lengthSqr)) : 0.0;
+    double distanceSqr = 0;
+    for (int i = 0; i < 3; i++) {
+        double delta = point[i] - move.start[i] - t * direction[i];
+        distanceSqr += delta * delta;
+    }
+
+    return sqrt(distanceSqr);
+}
+
+// Largest distance of the blended segments to the program, every segment belongs to its move or the corner after it
+static double largestDeviation(const QString &fileName, double tolerance)
+{
+    GCodeInterpreter interpreter;
+    if (!interpreter.open(fileName))
+        return -1;
+
+    std::vector<GCodeMove> moves;
+    GCodeMove move;
+    while (interpreter.nextSegment(&move))
+        moves.push_back(move);
+
+    PathBlender blender(tolerance);
+    double deviation = 0;
+    size_t index = 0;
+    for (size_t k = 0; k <= moves.size(); k++) {
+        if (k < moves.size())
+            blender.push(moves[k]);
+        else
+            blender.flush();
+
+        GCodeMove segment;
+        while (blender.takeSegment(&segment)) {
+            while (index < moves.size() && moves[index].lineNumber != segment.lineNumber)
+                index++;
+
+            // The end and the middle of the segment, the chord is farthest from the program there
+            double middle[3];
+            for (int i = 0; i < 3; i++)
+                middle[i] = (segment.start[i] + segment.target[i]) / 2;
+
+            for (const double *point : { static_cast<const double *>(segment.target), static_cast<const double *>(middle) }) {
+                double distance = distanceToMove(point, moves[index]);
+                if (index + 1 < moves.size())
+                    distance = fmin(distance, distanceToMove(point, moves[index + 1]));
+                deviation = fmax(deviation, distance);
+            }
+        }
+    }
+
+    return deviation;
+}
+
+int main(int argc, char *argv[])
+{
+    QString fileName = QDir::temp().filePath("pick-and-place.nc");
+    if (argc > 1 && argv[1][0]) {
+        fileName = QString::fromLocal8Bit(argv[1]);
+    } else if (!writeProgram(fileName)) {
+        fprintf(stderr, "Could not write %s\n", fileName.toUtf8().constData());
+        return EXIT_FAILURE;
+    }
+
+    double maxSpeed = argc > 2 ? strtod(argv[2], nullptr) : 500;
+    double acceleration = argc > 3 ? strtod(argv[3], nullptr) : 5000;
+    double stepsPerMillimeter = argc > 4 ? strtod(argv[4], nullptr) : 100;
+
+    const double tolerances[] = { 0, 0.05, 0.1, 0.25, 0.5, 1, 2 };
+    PlanResult sharp;
+    printf("%-14s %8s %10s %14s %8s %12s %12s\n", "tolerance [mm]", "corners", "blocks", "duration [s]", "gain", "deviation", "planned in");
+    for (double tolerance : tolerances) {
+        PlanResult result;
+        if (!planProgram(fileName, tolerance, maxSpeed, acceleration, stepsPerMillimeter, &result))
+            return EXIT_FAILURE;
+
+        if (tolerance == 0)
+            sharp = result;
+
+        printf("%-14.2f %8lld %10lld %14.3f %7.1f%% %9.4f mm %9.1f ms\n", tolerance, static_cast<long long>(result.corners),
+               static_cast<long long>(result.blocks), result.duration, 100.0 * (sharp.duration - result.duration) / sharp.duration,
+               largestDeviation(fileName, tolerance), result.elapsed);
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,75 @@
+// Estimates how long a program runs on the robot, without the robot.
+//
+// Plans the program like the streaming does, on all cores, and prints the total time, the time of each section
+// (the parts starting at comment lines) and the lines losing the most time against their nominal speed.
+//
+// Build:  cmake -S .. -B ../build && cmake --build ../build --target cycle-time
+// Usage:  ./cycle-time <program> [max speed mm/s] [acceleration mm/s^2] [steps per mm] [path tolerance mm] [corner tolerance mm]
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <QElapsedTimer>
+
+#include "cycletimeestimator.h"
+
+static void printDuration(double seconds)
+{
+    long total = static_cast<long>(seconds);
+    printf("%ld:%02ld:%06.3f", total / 3600, total / 60 % 60, seconds - (total - total % 60));
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <program> [max speed mm/s] [acceleration mm/s^2] [steps per mm] [path tolerance mm] [corner tolerance mm]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    double maxSpeed = argc > 2 ? strtod(argv[2], nullptr) : 100;
+    double acceleration = argc > 3 ? strtod(argv[3], nullptr) : 1000;
+    double stepsPerMillimeter = argc > 4 ? strtod(argv[4], nullptr) : 100;
+    double pathTolerance = argc > 5 ? strtod(argv[5], nullptr) : 0;
+    double cornerTolerance = argc > 6 ? strtod(argv[6], nullptr) : 0;
+
+    MotionPlanner planner;
+    CycleTimeEstimator estimator;
+    for (int axis = 0; axis < 3; axis++) {
+        planner.setMaxSpeed(axis, maxSpeed * stepsPerMillimeter);
+        planner.setAcceleration(axis, acceleration * stepsPerMillimeter);
+        estimator.setStepsPerMillimeter(axis, stepsPerMillimeter);
+    }
+    estimator.setPlanner(planner);
+    estimator.setPathTolerance(pathTolerance);
+    estimator.setCornerTolerance(cornerTolerance);
+
+    QElapsedTimer timer;
+    timer.start();
+    if (!estimator.estimate(argv[1])) {
+        fprintf(stderr, "%s\n", estimator.errorString().toUtf8().constData());
+        return EXIT_FAILURE;
+    }
+    double elapsed = timer.nsecsElapsed() / 1000000.0;
+
+    printf("Cycle time ");
+    printDuration(estimator.duration());
+    printf(" (%lld lines, %lld blocks, estimated in %.1f ms)\n", static_cast<long long>(estimator.lineCount()),
+           static_cast<long long>(estimator.blockCount()), elapsed);
+
+    printf("\n%10s %14s %7s  %s\n", "line", "time", "share", "section");
+    for (const CycleTimeSection &section : estimator.sections()) {
+        printf("%10lld ", static_cast<long long>(section.lineNumber));
+        printDuration(section.duration);
+        printf(" %6.1f%%  %s\n", estimator.duration() > 0 ? 100.0 * section.duration / estimator.duration() : 0.0,
+               section.name.isEmpty() ? "-" : section.name.toUtf8().constData());
+    }
+
+    printf("\n%10s %8s %12s %12s %12s\n", "line", "blocks", "time [s]", "lost [s]", "peak speed");
+    for (const CycleTimeBottleneck &bottleneck : estimator.bottlenecks()) {
+        printf("%10lld %8lld %12.4f %12.4f %11.1f%%\n", static_cast<long long>(bottleneck.lineNumber),
+               static_cast<long long>(bottleneck.blockCount), bottleneck.duration, bottleneck.lostTime,
+               100.0 * bottleneck.peakSpeedRatio);
+    }
+
+    return EXIT_SUCCESS;
+}
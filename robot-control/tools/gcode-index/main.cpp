@@ -0,0 +1,67 @@
+// Builds the index of a G-code program and seeks to lines with it.
+//
+// The index gets written next to the program (<program>.index) and reused as long as the program does not
+// change. For every line given the interpreter seeks there and prints the modal state before that line.
+//
+// Build:  cmake -S .. -B ../build && cmake --build ../build --target gcode-index
+// Usage:  ./gcode-index <program> [line ...]
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <QElapsedTimer>
+
+#include "gcodeindex.h"
+#include "gcodeinterpreter.h"
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <program> [line ...]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    QString fileName(argv[1]);
+    QString indexFileName = GCodeIndex::defaultIndexFileName(fileName);
+
+    QElapsedTimer timer;
+    timer.start();
+
+    GCodeIndex index;
+    if (index.load(indexFileName, fileName)) {
+        printf("Loaded %s in %.3f ms\n", indexFileName.toUtf8().constData(), timer.nsecsElapsed() / 1000000.0);
+    } else {
+        if (!index.build(fileName)) {
+            fprintf(stderr, "Indexing failed: %s\n", index.errorString().toUtf8().constData());
+            return EXIT_FAILURE;
+        }
+        printf("Indexed %lld lines in %.3f ms\n", static_cast<long long>(index.lineCount()), timer.nsecsElapsed() / 1000000.0);
+
+        if (!index.save(indexFileName))
+            fprintf(stderr, "Could not write %s\n", indexFileName.toUtf8().constData());
+    }
+    printf("%d checkpoints, every %d lines\n", static_cast<int>(index.checkpoints().count()), index.checkpointInterval());
+
+    GCodeInterpreter interpreter;
+    if (!interpreter.open(fileName)) {
+        fprintf(stderr, "%s\n", interpreter.errorString().toUtf8().constData());
+        return EXIT_FAILURE;
+    }
+
+    for (int i = 2; i < argc; i++) {
+        qint64 lineNumber = strtoll(argv[i], nullptr, 10);
+        timer.restart();
+        if (!interpreter.seek(index, lineNumber)) {
+            fprintf(stderr, "Seek failed: %s\n", interpreter.errorString().toUtf8().constData());
+            return EXIT_FAILURE;
+        }
+
+        const GCodeState &state = interpreter.state();
+        printf("Line %lld after %.3f ms: G%d G%d G%d G%d F%.1f X%.4f Y%.4f Z%.4f\n", static_cast<long long>(lineNumber),
+               timer.nsecsElapsed() / 1000000.0, state.motion == GCodeState::MotionNone ? 80 : static_cast<int>(state.motion),
+               17 + static_cast<int>(state.plane), state.inches ? 20 : 21, state.absolute ? 90 : 91,
+               state.feedRate, state.position[0], state.position[1], state.position[2]);
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,229 @@
+// Compares the time optimal path parameterization with the planner trapezoids on the joint path of a program.
+//
+// The moves get resampled for the arm, converted to joint steps and timed twice: queued into the MotionPlanner like
+// the interpreter does (junction deviation, trapezoids) and parameterized by TOPP-RA. Both get the feed rate of each
+// move as speed limit along the path. Prints both cycle times, the segments for the firmware and the highest joint
+// speed and acceleration of the TOPP-RA profile relative to the limits, from finite differences. The planner lets the
+// joint speeds jump at junctions within the junction deviation, TOPP-RA does not, so on tight curves it can take longer.
+// The segments for the firmware get replayed with its ramp and have to take as long as the profile.
+//
+// Build:  cmake -S .. -B ../build && cmake --build ../build --target path-parameterizer
+// Usage:  ./path-parameterizer <arm.ini> <program> [joint speed deg/s] [joint acceleration deg/s^2]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <vector>
+#include <algorithm>
+
+#include <QElapsedTimer>
+
+#include "gcodeinterpreter.h"
+#include "pathparameterizer.h"
+
+// Largest difference between the duration of the segments and the profile
+static const double replayTolerance = 0.02;
+
+// Runs the segments like the firmware: the dominant axis ramps by one ramp index n = v^2 / (2 * a) per step, from the
+// entry index up to the max speed and down to the exit index just in time. A segment which can not reach its exit
+// index passes on what it reached, as fraction of the exit index, to the entry of the next one.
+static double replayDuration(const QList<MotionPlannerSegment> &segments, const qint32 start[3])
+{
+    double duration = 0;
+    double entryScale = 0;
+    qint32 position[3] = { start[0], start[1], start[2] };
+    for (int k = 0; k < segments.count(); k++) {
+        const MotionPlannerSegment &segment = segments.at(k);
+        double steps = 0;
+        for (int i = 0; i < 3; i++) {
+            steps = fmax(steps, fabs(static_cast<double>(segment.target[i]) - position[i]));
+            position[i] = segment.target[i];
+        }
+
+        double acceleration = segment.acceleration;
+        double entryIndex = segment.entryIndex * entryScale;
+        double exitIndex = k + 1 < segments.count() ? segment.exitIndex : 0;
+        double maxIndex = fmax(entryIndex, static_cast<double>(segment.maxSpeed) * segment.maxSpeed / (2 * acceleration));
+        double peakIndex = fmin(maxIndex, (steps + entryIndex + exitIndex) / 2);
+        double reachedIndex = exitIndex;
+        if (peakIndex < exitIndex) {
+            peakIndex = entryIndex + steps;
+            reachedIndex = peakIndex;
+        } else if (peakIndex < entryIndex) {
+            // Entering too fast for the segment, the index can not get below what the steps allow
+            peakIndex = entryIndex;
+            reachedIndex = fmax(exitIndex, entryIndex - steps);
+        }
+
+        double cruise = steps - (peakIndex - entryIndex) - (peakIndex - reachedIndex);
+        double peakSpeed = sqrt(2 * acceleration * peakIndex);
+        duration += (peakSpeed - sqrt(2 * acceleration * entryIndex)) / acceleration;
+        duration += (peakSpeed - sqrt(2 * acceleration * reachedIndex)) / acceleration;
+        if (cruise > 0)
+            duration += cruise / peakSpeed;
+
+        entryScale = segment.exitIndex > 0 ? fmin(reachedIndex, segment.exitIndex) / segment.exitIndex : 0;
+    }
+
+    return duration;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s <arm.ini> <program> [joint speed deg/s] [joint acceleration deg/s^2]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    ArmKinematics kinematics;
+    if (!kinematics.loadConfiguration(argv[1])) {
+        fprintf(stderr, "%s\n", kinematics.errorString().toUtf8().constData());
+        return EXIT_FAILURE;
+    }
+
+    double jointSpeed = argc > 3 ? strtod(argv[3], nullptr) : 90;
+    double jointAcceleration = argc > 4 ? strtod(argv[4], nullptr) : 360;
+
+    const ArmConfiguration &arm = kinematics.configuration();
+    MotionPlanner planner;
+    for (int joint = 0; joint < 3; joint++) {
+        planner.setMaxSpeed(joint, jointSpeed * fabs(arm.stepsPerDegree[joint]));
+        planner.setAcceleration(joint, jointAcceleration * fabs(arm.stepsPerDegree[joint]));
+    }
+
+    // The targets of all moves form the path, like in the collision check
+    GCodeInterpreter interpreter;
+    if (!interpreter.open(argv[2])) {
+        fprintf(stderr, "%s\n", interpreter.errorString().toUtf8().constData());
+        return EXIT_FAILURE;
+    }
+
+    std::vector<double> points[3];
+    std::vector<double> feedRates;
+    GCodeMove segment;
+    while (interpreter.nextSegment(&segment)) {
+        if (segment.type != GCodeMove::TypeSeek && segment.type != GCodeMove::TypeLinear)
+            continue;
+
+        for (int axis = 0; axis < 3; axis++)
+            points[axis].push_back(segment.target[axis]);
+        feedRates.push_back(segment.type == GCodeMove::TypeLinear ? segment.feedRate / 60.0 : INFINITY);
+    }
+
+    if (interpreter.hasError()) {
+        fprintf(stderr, "%s\n", interpreter.errorString().toUtf8().constData());
+        return EXIT_FAILURE;
+    }
+
+    int pointCount = static_cast<int>(points[0].size());
+    PathResampler resampler(&kinematics, arm.lineTolerance);
+    double start[3] = { points[0][0], points[1][0], points[2][0] };
+    double startAngles[3];
+    if (pointCount < 2 || !kinematics.inverse(start, startAngles)
+            || !resampler.resample(points[0].data(), points[1].data(), points[2].data(), pointCount)) {
+        fprintf(stderr, "Resampling failed: %s\n", resampler.errorString().toUtf8().constData());
+        return EXIT_FAILURE;
+    }
+
+    // Joint steps of the poses and the feed rate converted to steps along the joint path
+    int poseCount = resampler.pointCount() + 1;
+    std::vector<double> steps[3];
+    std::vector<double> speedLimits(poseCount, INFINITY);
+    for (int joint = 0; joint < 3; joint++) {
+        steps[joint].resize(poseCount);
+        steps[joint][0] = (startAngles[joint] - arm.zeroAngle[joint]) * arm.stepsPerDegree[joint];
+        for (int k = 1; k < poseCount; k++)
+            steps[joint][k] = (resampler.angles(joint)[k - 1] - arm.zeroAngle[joint]) * arm.stepsPerDegree[joint];
+    }
+
+    int line = 0;
+    double previous[3] = { start[0], start[1], start[2] };
+    for (int k = 1; k < poseCount; k++) {
+        while (resampler.lineEnds().at(line) < k - 1)
+            line++;
+
+        double lengthSqr = 0;
+        double stepsSqr = 0;
+        for (int axis = 0; axis < 3; axis++) {
+            double point = resampler.points(axis)[k - 1];
+            lengthSqr += (point - previous[axis]) * (point - previous[axis]);
+            stepsSqr += (steps[axis][k] - steps[axis][k - 1]) * (steps[axis][k] - steps[axis][k - 1]);
+            previous[axis] = point;
+        }
+
+        if (lengthSqr > 0)
+            speedLimits[k] = feedRates[line + 1] * sqrt(stepsSqr / lengthSqr);
+    }
+    speedLimits[0] = speedLimits[poseCount > 1 ? 1 : 0];
+    printf("%d moves resampled into %d poses\n", pointCount, poseCount);
+
+    QElapsedTimer timer;
+    timer.start();
+    qint32 position[3];
+    for (int joint = 0; joint < 3; joint++)
+        position[joint] = static_cast<qint32>(lround(steps[joint][0]));
+    planner.reset(position);
+    for (int k = 1; k < poseCount; k++) {
+        for (int joint = 0; joint < 3; joint++)
+            position[joint] = static_cast<qint32>(lround(steps[joint][k]));
+        planner.bufferLine(position, speedLimits[k]);
+    }
+
+    double plannerDuration = 0;
+    for (int i = 0; i < planner.blockCount(); i++)
+        plannerDuration += planner.trapezoid(i).duration;
+    double plannerTime = timer.nsecsElapsed() / 1000000.0;
+
+    PathParameterizer parameterizer;
+    parameterizer.setLimits(planner);
+    const double *const samples[3] = { steps[0].data(), steps[1].data(), steps[2].data() };
+    timer.restart();
+    if (!parameterizer.parameterize(samples, poseCount, speedLimits.data())) {
+        fprintf(stderr, "%s\n", parameterizer.errorString().toUtf8().constData());
+        return EXIT_FAILURE;
+    }
+    double parameterizeTime = timer.nsecsElapsed() / 1000000.0;
+    QList<MotionPlannerSegment> segments = parameterizer.segments();
+    int segmentCount = static_cast<int>(segments.count());
+
+    // The queue for the firmware has to take as long as the profile
+    qint32 first[3];
+    for (int joint = 0; joint < 3; joint++)
+        first[joint] = static_cast<qint32>(lround(parameterizer.positions(joint)[0]));
+    double replay = replayDuration(segments, first);
+
+    // Joint speeds and accelerations of the profile, with the same finite differences
+    int count = parameterizer.sampleCount();
+    const double *s = parameterizer.pathPositions();
+    const double *x = parameterizer.speedsSqr();
+    double speedRatio = 0;
+    double accelerationRatio = 0;
+    for (int k = 0; k < count - 1; k++) {
+        int before = std::max(0, k - 1);
+        double u = (x[k + 1] - x[k]) / (2 * (s[k + 1] - s[k]));
+        for (int joint = 0; joint < 3; joint++) {
+            const double *q = parameterizer.positions(joint);
+            double first = (q[k + 1] - q[before]) / (s[k + 1] - s[before]);
+            double second = 0;
+            if (k > 0)
+                second = 2 * ((q[k + 1] - q[k]) / (s[k + 1] - s[k]) - (q[k] - q[k - 1]) / (s[k] - s[k - 1])) / (s[k + 1] - s[k - 1]);
+
+            speedRatio = fmax(speedRatio, fabs(first) * sqrt(x[k]) / planner.maxSpeed(joint));
+            accelerationRatio = fmax(accelerationRatio, fabs(first * u + second * x[k]) / planner.acceleration(joint));
+        }
+    }
+
+    printf("%-12s %12s %10s %12s\n", "", "cycle [s]", "blocks", "planned [ms]");
+    printf("%-12s %12.3f %10d %12.1f\n", "trapezoids", plannerDuration, planner.blockCount(), plannerTime);
+    printf("%-12s %12.3f %10d %12.1f  (%+.1f%%)\n", "TOPP-RA", parameterizer.duration(), segmentCount, parameterizeTime,
+           100.0 * (parameterizer.duration() - plannerDuration) / plannerDuration);
+    printf("Highest joint speed %.1f%%, acceleration %.1f%% of the limits\n", 100 * speedRatio, 100 * accelerationRatio);
+    printf("Segments replayed like the firmware: %.3f s (%+.2f%%)\n", replay, 100.0 * (replay - parameterizer.duration()) / parameterizer.duration());
+    if (fabs(replay - parameterizer.duration()) > replayTolerance * parameterizer.duration()) {
+        fprintf(stderr, "The segments do not reproduce the profile\n");
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
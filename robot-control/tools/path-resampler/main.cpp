@@ -0,0 +1,226 @@
+// Benchmarks the adaptive resampling of lines for the arm.
+//
+// Builds a random polyline within the reach of the arm and resamples it line by line (like the interpreter does) and
+// as a whole (in parallel chunks) for a few tolerances. For each tolerance it prints the pieces per line, the points per
+// millisecond and the largest deviation of the tool from the lines, sampled within the pieces with the forward
+// kinematics. Splitting the lines at their ends only and into pieces of 1 mm are printed for comparison.
+//
+// Build:  cmake -S .. -B ../build && cmake --build ../build --target path-resampler
+// Usage:  ./path-resampler [arm.ini] [lines]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <vector>
+#include <random>
+
+#include <QElapsedTimer>
+
+#include "pathresampler.h"
+
+// Samples within each piece
+static const int deviationSamples = 8;
+
+static double distanceToLine(const double point[3], const double start[3], const double end[3])
+{
+    double direction[3];
+    double offset[3];
+    double lengthSqr = 0;
+    double projection = 0;
+    for (int i = 0; i < 3; i++) {
+        direction[i] = end[i] - start[i];
+        offset[i] = point[i] - start[i];
+        lengthSqr += direction[i] * direction[i];
+        projection += direction[i] * offset[i];
+    }
+
+    double t = lengthSqr > 0 ? fmin(1, fmax(0, projection / lengthSqr)) : 0;
+    double distanceSqr = 0;
+    for (int i = 0; i < 3; i++) {
+        double distance = offset[i] - t * direction[i];
+        distanceSqr += distance * distance;
+    }
+    return sqrt(distanceSqr);
+}
+
+// Largest deviation of the tool from the line while the joints move linear from angles0 to angles1
+static double pieceDeviation(const ArmKinematics &kinematics, const double angles0[3], const double angles1[3], const double start[3], const double end[3])
+{
+    double deviation = 0;
+    for (int s = 1; s < deviationSamples; s++) {
+        double t = static_cast<double>(s) / deviationSamples;
+        double angles[3];
+        double position[3];
+        for (int i = 0; i < 3; i++)
+            angles[i] = angles0[i] + t * (angles1[i] - angles0[i]);
+
+        kinematics.forward(angles, position);
+        deviation = fmax(deviation, distanceToLine(position, start, end));
+    }
+    return deviation;
+}
+
+// Splits every line into pieces of the length, 0 keeps the lines whole
+static bool splitEvenly(const ArmKinematics &kinematics, const std::vector<double> points[3], double length, long *pieceCount, double *deviation)
+{
+    *pieceCount = 0;
+    *deviation = 0;
+    for (size_t line = 0; line + 1 < points[0].size(); line++) {
+        double start[3];
+        double end[3];
+        double lineLength = 0;
+        for (int i = 0; i < 3; i++) {
+            start[i] = points[i][line];
+            end[i] = points[i][line + 1];
+            lineLength += (end[i] - start[i]) * (end[i] - start[i]);
+        }
+        lineLength = sqrt(lineLength);
+
+        int count = length > 0 ? static_cast<int>(fmax(1, ceil(lineLength / length))) : 1;
+        double previous[3];
+        if (!kinematics.inverse(start, previous))
+            return false;
+
+        for (int k = 1; k <= count; k++) {
+            double position[3];
+            double angles[3];
+            for (int i = 0; i < 3; i++)
+                position[i] = start[i] + (end[i] - start[i]) * k / count;
+
+            if (!kinematics.inverse(position, angles))
+                return false;
+
+            *deviation = fmax(*deviation, pieceDeviation(kinematics, previous, angles, start, end));
+            for (int i = 0; i < 3; i++)
+                previous[i] = angles[i];
+        }
+        *pieceCount += count;
+    }
+    return true;
+}
+
+static double resampledDeviation(const ArmKinematics &kinematics, const std::vector<double> points[3], const PathResampler &resampler)
+{
+    double deviation = 0;
+    int first = 0;
+    for (int line = 0; line < resampler.lineEnds().count(); line++) {
+        double start[3];
+        double end[3];
+        double previous[3];
+        for (int i = 0; i < 3; i++) {
+            start[i] = points[i][line];
+            end[i] = points[i][line + 1];
+        }
+        kinematics.inverse(start, previous);
+
+        int last = resampler.lineEnds().at(line);
+        for (int k = first; k <= last; k++) {
+            double angles[3] = { resampler.angles(0)[k], resampler.angles(1)[k], resampler.angles(2)[k] };
+            deviation = fmax(deviation, pieceDeviation(kinematics, previous, angles, start, end));
+            for (int i = 0; i < 3; i++)
+                previous[i] = angles[i];
+        }
+        first = last + 1;
+    }
+    return deviation;
+}
+
+int main(int argc, char *argv[])
+{
+    ArmKinematics kinematics;
+    if (argc > 1 && !kinematics.loadConfiguration(argv[1])) {
+        fprintf(stderr, "%s\n", kinematics.errorString().toUtf8().constData());
+        return EXIT_FAILURE;
+    }
+    int lineCount = argc > 2 ? atoi(argv[2]) : 100000;
+
+    // A random walk of the joints well within the limits, the lines between the points stay within reach
+    const ArmConfiguration &arm = kinematics.configuration();
+    std::mt19937 random(42);
+    std::uniform_real_distribution<double> step(-5, 5);
+    std::vector<double> points[3];
+    double angles[3];
+    for (int joint = 0; joint < 3; joint++)
+        angles[joint] = 0.5 * (arm.minAngle[joint] + arm.maxAngle[joint]);
+    angles[2] = arm.elbowUp ? -45 : 45;
+
+    while (static_cast<int>(points[0].size()) <= lineCount) {
+        double next[3];
+        for (int joint = 0; joint < 3; joint++) {
+            double margin = 0.1 * (arm.maxAngle[joint] - arm.minAngle[joint]);
+            next[joint] = fmin(arm.maxAngle[joint] - margin, fmax(arm.minAngle[joint] + margin, angles[joint] + step(random)));
+        }
+
+        // Stay on the side of the elbow configuration, away from the stretched arm
+        if (arm.elbowUp ? next[2] > -5 : next[2] < 5)
+            continue;
+
+        // The base turns around quickly close to its axis, no tolerance holds there
+        double position[3];
+        double check[3];
+        kinematics.forward(next, position);
+        if (hypot(position[0], position[1]) < 0.25 * (arm.upperArmLength + arm.forearmLength) || !kinematics.inverse(position, check))
+            continue;
+
+        for (int axis = 0; axis < 3; axis++) {
+            points[axis].push_back(position[axis]);
+            angles[axis] = next[axis];
+        }
+    }
+
+    printf("%d lines\n\n", lineCount);
+    printf("%-12s %12s %14s %14s %14s\n", "tolerance", "pieces/line", "lines [pt/ms]", "path [pt/ms]", "deviation");
+
+    long pieceCount;
+    double deviation;
+    if (!splitEvenly(kinematics, points, 0, &pieceCount, &deviation)) {
+        fprintf(stderr, "Line out of reach\n");
+        return EXIT_FAILURE;
+    }
+    printf("%-12s %12.2f %14s %14s %11.4f mm\n", "line ends", static_cast<double>(pieceCount) / lineCount, "-", "-", deviation);
+
+    if (!splitEvenly(kinematics, points, 1, &pieceCount, &deviation)) {
+        fprintf(stderr, "Line out of reach\n");
+        return EXIT_FAILURE;
+    }
+    printf("%-12s %12.2f %14s %14s %11.4f mm\n", "1 mm pieces", static_cast<double>(pieceCount) / lineCount, "-", "-", deviation);
+
+    const double tolerances[] = { 0.1, 0.01, 0.001 };
+    for (double tolerance : tolerances) {
+        PathResampler resampler(&kinematics, tolerance);
+
+        QElapsedTimer timer;
+        timer.start();
+        long linePoints = 0;
+        for (int line = 0; line < lineCount; line++) {
+            double start[3] = { points[0][line], points[1][line], points[2][line] };
+            double end[3] = { points[0][line + 1], points[1][line + 1], points[2][line + 1] };
+            if (!resampler.resample(start, end)) {
+                fprintf(stderr, "%s\n", resampler.errorString().toUtf8().constData());
+                return EXIT_FAILURE;
+            }
+            linePoints += resampler.pointCount();
+        }
+        double lineTime = timer.nsecsElapsed() / 1000000.0;
+
+        timer.restart();
+        if (!resampler.resample(points[0].data(), points[1].data(), points[2].data(), lineCount + 1)) {
+            fprintf(stderr, "%s\n", resampler.errorString().toUtf8().constData());
+            return EXIT_FAILURE;
+        }
+        double pathTime = timer.nsecsElapsed() / 1000000.0;
+
+        if (resampler.pointCount() != linePoints) {
+            fprintf(stderr, "Resampling the path gives %d points, the lines %ld\n", resampler.pointCount(), linePoints);
+            return EXIT_FAILURE;
+        }
+
+        char name[32];
+        snprintf(name, sizeof(name), "%g mm", tolerance);
+        printf("%-12s %12.2f %14.0f %14.0f %11.4f mm\n", name, static_cast<double>(linePoints) / lineCount,
+               linePoints / lineTime, linePoints / pathTime, resampledDeviation(kinematics, points, resampler));
+    }
+
+    return EXIT_SUCCESS;
+}
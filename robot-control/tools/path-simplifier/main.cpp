@@ -0,0 +1,108 @@
+// Shows what the path simplification saves on a program.
+//
+// Plans the program twice, once with every segment as it comes from the interpreter and once merged within
+// the tolerance, and prints the number of planner blocks (one serial frame each) and the planned duration.
+// The planner runs with a look-ahead of 32 blocks like the streaming to the robot does.
+//
+// Build:  cmake -S .. -B ../build && cmake --build ../build --target path-simplifier
+// Usage:  ./path-simplifier <program> [tolerance mm] [max speed mm/s] [acceleration mm/s^2] [steps per mm]
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <QElapsedTimer>
+
+#include "gcodeinterpreter.h"
+
+static const int lookAhead = 32;
+
+struct PlanResult
+{
+    qint64 segments = 0;
+    qint64 blocks = 0;
+    double duration = 0; // s
+    double elapsed = 0; // ms
+};
+
+static bool planProgram(const char *fileName, double tolerance, double maxSpeed, double acceleration, double stepsPerMillimeter, PlanResult *result)
+{
+    GCodeInterpreter interpreter;
+    interpreter.setPathTolerance(tolerance);
+
+    MotionPlanner planner;
+    for (int axis = 0; axis < 3; axis++) {
+        interpreter.setStepsPerMillimeter(axis, stepsPerMillimeter);
+        planner.setMaxSpeed(axis, maxSpeed * stepsPerMillimeter);
+        planner.setAcceleration(axis, acceleration * stepsPerMillimeter);
+    }
+
+    const qint32 origin[3] = { 0, 0, 0 };
+    planner.reset(origin);
+
+    QElapsedTimer timer;
+    timer.start();
+
+    if (!interpreter.open(fileName)) {
+        fprintf(stderr, "%s\n", interpreter.errorString().toUtf8().constData());
+        return false;
+    }
+
+    MotionPlannerSegment segment;
+    while (true) {
+        int queued = interpreter.feedPlanner(&planner, lookAhead);
+        if (queued < 0) {
+            fprintf(stderr, "%s\n", interpreter.errorString().toUtf8().constData());
+            return false;
+        }
+
+        // Drain the queue completely once the program ended
+        int keep = interpreter.finished() ? 0 : lookAhead - 1;
+        while (planner.blockCount() > keep) {
+            result->duration += planner.trapezoid(0).duration;
+            planner.takeSegment(&segment);
+            result->blocks++;
+        }
+
+        if (interpreter.finished())
+            break;
+    }
+
+    result->segments = interpreter.pathSimplifier().inputCount();
+    result->elapsed = timer.nsecsElapsed() / 1000000.0;
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <program> [tolerance mm] [max speed mm/s] [acceleration mm/s^2] [steps per mm]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    double tolerance = argc > 2 ? strtod(argv[2], nullptr) : 0.005;
+    double maxSpeed = argc > 3 ? strtod(argv[3], nullptr) : 100;
+    double acceleration = argc > 4 ? strtod(argv[4], nullptr) : 1000;
+    double stepsPerMillimeter = argc > 5 ? strtod(argv[5], nullptr) : 100;
+
+    PlanResult original;
+    PlanResult simplified;
+    if (!planProgram(argv[1], 0, maxSpeed, acceleration, stepsPerMillimeter, &original))
+        return EXIT_FAILURE;
+
+    if (!planProgram(argv[1], tolerance, maxSpeed, acceleration, stepsPerMillimeter, &simplified))
+        return EXIT_FAILURE;
+
+    printf("%-12s %12s %12s %14s %12s\n", "", "segments", "blocks", "duration [s]", "planned in");
+    printf("%-12s %12lld %12lld %14.3f %9.1f ms\n", "original", static_cast<long long>(original.segments),
+           static_cast<long long>(original.blocks), original.duration, original.elapsed);
+    printf("%-12s %12lld %12lld %14.3f %9.1f ms\n", "simplified", static_cast<long long>(simplified.segments),
+           static_cast<long long>(simplified.blocks), simplified.duration, simplified.elapsed);
+
+    if (original.blocks > 0 && original.duration > 0) {
+        printf("\n%.1f %% fewer blocks, %.1f %% shorter cycle time with %.4f mm tolerance\n",
+               100.0 * (original.blocks - simplified.blocks) / original.blocks,
+               100.0 * (original.duration - simplified.duration) / original.duration, tolerance);
+    }
+
+    return EXIT_SUCCESS;
+}
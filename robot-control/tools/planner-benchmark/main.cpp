@@ -0,0 +1,182 @@
+// Benchmark for the incremental MotionPlanner recalculation.
+//
+// Queues a long path without ever taking segments, so the planner queue keeps growing, and prints
+// the average cost of bufferLine() for every window of blocks. With the planned index the cost per
+// line has to stay flat while the queue grows into the hundred thousands.
+//
+// Then checks the incremental replanning against the full recalculation: random paths with dwells and feed rate
+// changes, segments taken in between, and after every line the entry speeds of all queued blocks get compared with a
+// reverse and forward pass over the whole queue (GRBL without the planned block). Both have to match exactly.
+//
+// Build:  cmake -S .. -B ../build && cmake --build ../build --target planner-benchmark
+// Usage:  ./planner-benchmark [blocks] [window] [compare paths] [compare lines]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <vector>
+#include <random>
+#include <algorithm>
+
+#include <QElapsedTimer>
+
+#include "motionplanner.h"
+
+typedef void (*PathFunction)(int index, qint32 target[3]);
+
+// Polygon of a circle with short segments, every junction limits the speed
+static void circlePath(int index, qint32 target[3])
+{
+    double angle = index * 2.0 * M_PI / 720.0;
+    target[0] = static_cast<qint32>(lround(20000 * cos(angle)));
+    target[1] = static_cast<qint32>(lround(20000 * sin(angle)));
+    target[2] = index / 720;
+}
+
+// Zig zag with sharp corners and varying segment length
+static void zigZagPath(int index, qint32 target[3])
+{
+    target[0] = index * 37;
+    target[1] = (index % 2) ? 400 + (index % 7) * 50 : 0;
+    target[2] = 0;
+}
+
+// Straight line in tiny pieces, the decelerate ramp spans many blocks
+static void linePath(int index, qint32 target[3])
+{
+    target[0] = index * 3;
+    target[1] = index * 2;
+    target[2] = 0;
+}
+
+static void runPath(const char *name, PathFunction path, int blocks, int window)
+{
+    MotionPlanner planner;
+    planner.setJunctionDeviation(5);
+    const qint32 origin[3] = { 0, 0, 0 };
+    planner.reset(origin);
+
+    printf("%s\n", name);
+    printf("%10s %14s %14s\n", "queued", "ns per line", "planned index");
+
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 1; i <= blocks; i++) {
+        qint32 target[3];
+        path(i, target);
+        planner.bufferLine(target, 1500);
+
+        if (i % window == 0) {
+            qint64 elapsed = timer.nsecsElapsed();
+            printf("%10d %14.1f %14d\n", planner.blockCount(), static_cast<double>(elapsed) / window, planner.plannedIndex());
+            timer.restart();
+        }
+    }
+    printf("\n");
+}
+
+// Reference: entry speeds of the whole queue planned from scratch. Only the entry speed of the first block
+// is taken from the planner, it is fixed once the block before it was taken.
+static void fullRecalculation(const MotionPlanner &planner, std::vector<double> *entrySpeedsSqr)
+{
+    int count = planner.blockCount();
+    entrySpeedsSqr->assign(count, 0);
+    if (count == 0)
+        return;
+
+    // Reverse pass: the last block has to be able to stop
+    double nextSpeedSqr = 0;
+    for (int index = count - 1; index > 0; index--) {
+        const MotionPlannerBlock &block = planner.block(index);
+        nextSpeedSqr = std::min(block.maxEntrySpeedSqr, nextSpeedSqr + 2.0 * block.acceleration * block.length);
+        (*entrySpeedsSqr)[index] = nextSpeedSqr;
+    }
+    (*entrySpeedsSqr)[0] = planner.block(0).entrySpeedSqr;
+
+    // Forward pass: no block can be entered faster than the one before accelerates to
+    for (int index = 0; index < count - 1; index++) {
+        const MotionPlannerBlock &block = planner.block(index);
+        double reachableSpeedSqr = (*entrySpeedsSqr)[index] + 2.0 * block.acceleration * block.length;
+        (*entrySpeedsSqr)[index + 1] = std::min((*entrySpeedsSqr)[index + 1], reachableSpeedSqr);
+    }
+}
+
+// Returns the number of entry speeds which differ from the full recalculation
+static int comparePaths(int paths, int lines)
+{
+    qint64 compared = 0;
+    int different = 0;
+    double largestDifference = 0;
+    std::vector<double> entrySpeedsSqr;
+
+    QElapsedTimer timer;
+    timer.start();
+    for (int path = 0; path < paths; path++) {
+        std::mt19937 random(path);
+        std::uniform_int_distribution<int> step(-2000, 2000);
+        std::uniform_int_distribution<int> shortStep(-20, 20);
+        std::uniform_real_distribution<double> feedRate(100, 1500);
+        std::uniform_int_distribution<int> percent(0, 99);
+
+        MotionPlanner planner;
+        planner.setJunctionDeviation(5);
+        const qint32 origin[3] = { 0, 0, 0 };
+        planner.reset(origin);
+
+        for (int line = 0; line < lines; line++) {
+            if (percent(random) < 2) {
+                planner.bufferDwell(0.1);
+            } else {
+                // Mix long moves with runs of short ones, the decelerate ramp then spans many blocks
+                bool shortMove = percent(random) < 60;
+                qint32 target[3];
+                for (int axis = 0; axis < 3; axis++)
+                    target[axis] = planner.position()[axis] + (shortMove ? shortStep(random) : step(random));
+                planner.bufferLine(target, feedRate(random));
+            }
+
+            fullRecalculation(planner, &entrySpeedsSqr);
+            for (int index = 0; index < planner.blockCount(); index++) {
+                double difference = std::fabs(planner.block(index).entrySpeedSqr - entrySpeedsSqr[index]);
+                largestDifference = std::max(largestDifference, difference);
+                if (difference != 0)
+                    different++;
+            }
+            compared += planner.blockCount();
+
+            // The streamer takes segments now and then, fixing the entry speed of the next block
+            if (percent(random) < 30) {
+                int segments = percent(random) % 4;
+                MotionPlannerSegment segment;
+                for (int i = 0; i < segments && planner.takeSegment(&segment); i++) { }
+            }
+        }
+    }
+
+    printf("compare with the full recalculation\n");
+    printf("%d paths of %d lines in %lld ms, %lld entry speeds compared\n", paths, lines, timer.elapsed(), compared);
+    printf("%d differ, largest difference %g steps^2/s^2\n", different, largestDifference);
+    return different;
+}
+
+int main(int argc, char *argv[])
+{
+    int blocks = argc > 1 ? atoi(argv[1]) : 200000;
+    int window = argc > 2 ? atoi(argv[2]) : 20000;
+    int paths = argc > 3 ? atoi(argv[3]) : 50;
+    int lines = argc > 4 ? atoi(argv[4]) : 2000;
+    if (blocks <= 0 || window <= 0 || paths <= 0 || lines <= 0) {
+        fprintf(stderr, "Usage: %s [blocks] [window] [compare paths] [compare lines]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    runPath("circle", circlePath, blocks, window);
+    runPath("zig zag", zigZagPath, blocks, window);
+    runPath("line", linePath, blocks, window);
+
+    if (comparePaths(paths, lines) != 0)
+        return EXIT_FAILURE;
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,117 @@
+// Compiles a path into a step table for CommandStepTable.
+//
+// The path file contains one absolute target per line: "x y z feed" in steps and steps/s, lines starting
+// with # are comments. The path gets planned with the MotionPlanner and sampled with the given period.
+// Writes the table in the wire format and, as CSV, the position the planner trapezoids reach at the end
+// of every entry, without the rounding to steps of the compiler. The firmware motion simulator plays
+// the table and checks that every entry ends within half a step of it:
+//
+//     ../../../firmware/tools/motion-simulator/motion-simulator table table.bin samples.csv
+//
+// Build:  cmake -S .. -B ../build && cmake --build ../build --target step-table-compiler
+// Usage:  ./step-table-compiler <path> <table.bin> <samples.csv> [period us] [max speed] [acceleration]
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+
+#include "motionplanner.h"
+#include "steptablecompiler.h"
+
+int main(int argc, char *argv[])
+{
+    if (argc < 4 || argc > 7) {
+        fprintf(stderr, "Usage: %s <path> <table.bin> <samples.csv> [period us] [max speed] [acceleration]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    quint32 period = argc > 4 ? strtoul(argv[4], nullptr, 10) : 5000;
+    double maxSpeed = argc > 5 ? strtod(argv[5], nullptr) : 2000;
+    double acceleration = argc > 6 ? strtod(argv[6], nullptr) : 4000;
+
+    FILE *pathFile = fopen(argv[1], "r");
+    if (!pathFile) {
+        fprintf(stderr, "Could not open %s\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    MotionPlanner planner;
+    for (int axis = 0; axis < 3; axis++) {
+        planner.setMaxSpeed(axis, maxSpeed);
+        planner.setAcceleration(axis, acceleration);
+    }
+
+    const qint32 start[3] = { 0, 0, 0 };
+    planner.reset(start);
+
+    char line[256];
+    int lineNumber = 0;
+    while (fgets(line, sizeof(line), pathFile)) {
+        lineNumber++;
+        if (line[0] == '#' || line[0] == '\n')
+            continue;
+
+        long x, y, z;
+        double feed;
+        if (sscanf(line, "%ld %ld %ld %lf", &x, &y, &z, &feed) != 4) {
+            fprintf(stderr, "Invalid line %d: %s", lineNumber, line);
+            fclose(pathFile);
+            return EXIT_FAILURE;
+        }
+
+        const qint32 target[3] = { static_cast<qint32>(x), static_cast<qint32>(y), static_cast<qint32>(z) };
+        planner.bufferLine(target, feed);
+    }
+    fclose(pathFile);
+
+    StepTableCompiler compiler(period);
+    if (!compiler.compile(planner, start)) {
+        fprintf(stderr, "Compiling failed: %s\n", compiler.errorString().toUtf8().constData());
+        return EXIT_FAILURE;
+    }
+
+    QByteArray table = compiler.toByteArray();
+    FILE *tableFile = fopen(argv[2], "wb");
+    if (!tableFile || fwrite(table.constData(), 1, table.size(), tableFile) != static_cast<size_t>(table.size())) {
+        fprintf(stderr, "Could not write %s\n", argv[2]);
+        return EXIT_FAILURE;
+    }
+    fclose(tableFile);
+
+    FILE *samplesFile = fopen(argv[3], "w");
+    if (!samplesFile) {
+        fprintf(stderr, "Could not write %s\n", argv[3]);
+        return EXIT_FAILURE;
+    }
+
+    // Walk the trapezoids along with the entry ends, the blocks are in time order like the samples
+    fprintf(samplesFile, "time,x,y,z\n");
+    int index = 0;
+    double blockStartTime = 0;
+    for (const StepTableSample &sample : compiler.samples()) {
+        double position[3] = { static_cast<double>(start[0]), static_cast<double>(start[1]), static_cast<double>(start[2]) };
+        while (index + 1 < planner.blockCount() && sample.time > blockStartTime + planner.trapezoid(index).duration * 1000000.0) {
+            blockStartTime += planner.trapezoid(index).duration * 1000000.0;
+            index++;
+        }
+
+        if (index < planner.blockCount()) {
+            const MotionPlannerBlock &block = planner.block(index);
+            MotionPlannerTrapezoid trapezoid = planner.trapezoid(index);
+            double fraction = 1.0;
+            if (block.stepEventCount > 0)
+                fraction = std::min(1.0, MotionPlanner::distanceAt(trapezoid, block.acceleration, (sample.time - blockStartTime) / 1000000.0) / block.length);
+
+            for (int i = 0; i < 3; i++)
+                position[i] = block.target[i] - block.steps[i] * (1.0 - fraction);
+        }
+
+        fprintf(samplesFile, "%llu,%.3f,%.3f,%.3f\n", static_cast<unsigned long long>(sample.time), position[0], position[1], position[2]);
+    }
+    fclose(samplesFile);
+
+    fprintf(stderr, "%d blocks, %d entries (%d bytes), %.3f s\n", planner.blockCount(), static_cast<int>(compiler.entries().size()),
+            static_cast<int>(table.size()), compiler.duration() / 1000000.0);
+    return EXIT_SUCCESS;
+}
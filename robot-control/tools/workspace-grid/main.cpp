@@ -0,0 +1,148 @@
+// Builds the workspace grid of the arm and checks a program against it.
+//
+// The grid gets cached next to the arm configuration (<arm.ini>.grid) and memory mapped as long as the arm, the cell
+// size and the joint speed stay the same. The lines of the program get sampled every half cell and every point is
+// checked once with a grid lookup and once with the inverse kinematics. Prints the time of both, the points the grid
+// rejects, the points it accepts although they are out of reach (should be none with a margin of the cell diagonal)
+// and the lines with a feed rate above the max speed of the arm along them.
+//
+// Build:  cmake -S .. -B ../build && cmake --build ../build --target workspace-grid
+// Usage:  ./workspace-grid <arm.ini> <program> [cell size mm] [joint speed deg/s] [margin mm]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <vector>
+
+#include <QElapsedTimer>
+
+#include "gcodeinterpreter.h"
+#include "workspacegrid.h"
+
+int main(int argc, char *argv[])
+{
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s <arm.ini> <program> [cell size mm] [joint speed deg/s] [margin mm]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    ArmKinematics kinematics;
+    if (!kinematics.loadConfiguration(argv[1])) {
+        fprintf(stderr, "%s\n", kinematics.errorString().toUtf8().constData());
+        return EXIT_FAILURE;
+    }
+
+    double cellSize = argc > 3 ? strtod(argv[3], nullptr) : 10;
+    double jointSpeed = argc > 4 ? strtod(argv[4], nullptr) : 90;
+    double margin = argc > 5 ? strtod(argv[5], nullptr) : cellSize * sqrt(3.0);
+
+    const ArmConfiguration &arm = kinematics.configuration();
+    MotionPlanner planner;
+    for (int joint = 0; joint < 3; joint++)
+        planner.setMaxSpeed(joint, jointSpeed * fabs(arm.stepsPerDegree[joint]));
+
+    QString cacheFileName = QString(argv[1]) + ".grid";
+    WorkspaceGrid grid;
+    grid.setCellSize(cellSize);
+
+    QElapsedTimer timer;
+    timer.start();
+    if (grid.load(cacheFileName, kinematics, planner)) {
+        printf("Mapped %s in %.3f ms\n", cacheFileName.toUtf8().constData(), timer.nsecsElapsed() / 1000000.0);
+    } else {
+        if (!grid.build(kinematics, planner)) {
+            fprintf(stderr, "%s\n", grid.errorString().toUtf8().constData());
+            return EXIT_FAILURE;
+        }
+        printf("Built %lld cells in %.3f ms\n", static_cast<long long>(grid.cellCount()), timer.nsecsElapsed() / 1000000.0);
+
+        if (!grid.save(cacheFileName))
+            fprintf(stderr, "Could not write %s\n", cacheFileName.toUtf8().constData());
+    }
+    printf("%d x %d x %d cells of %g mm, margin %.3f mm\n", grid.size()[0], grid.size()[1], grid.size()[2], cellSize, margin);
+
+    GCodeInterpreter interpreter;
+    if (!interpreter.open(argv[2])) {
+        fprintf(stderr, "%s\n", interpreter.errorString().toUtf8().constData());
+        return EXIT_FAILURE;
+    }
+
+    std::vector<double> points[3];
+    std::vector<qint64> lineNumbers;
+    long fastLines = 0;
+    qint64 fastLine = 0;
+    GCodeMove segment;
+    while (interpreter.nextSegment(&segment)) {
+        if (segment.type != GCodeMove::TypeSeek && segment.type != GCodeMove::TypeLinear)
+            continue;
+
+        double length = sqrt(pow(segment.target[0] - segment.start[0], 2) + pow(segment.target[1] - segment.start[1], 2)
+                             + pow(segment.target[2] - segment.start[2], 2));
+        int count = qMax(1, static_cast<int>(ceil(length / (0.5 * cellSize))));
+        double maxSpeed = INFINITY;
+        for (int k = 1; k <= count; k++) {
+            double position[3];
+            for (int axis = 0; axis < 3; axis++) {
+                position[axis] = segment.start[axis] + (segment.target[axis] - segment.start[axis]) * k / count;
+                points[axis].push_back(position[axis]);
+            }
+            lineNumbers.push_back(segment.lineNumber);
+
+            const WorkspaceCell *cell = grid.cell(position);
+            maxSpeed = fmin(maxSpeed, cell ? cell->maxSpeed : 0);
+        }
+
+        if (segment.type == GCodeMove::TypeLinear && segment.feedRate / 60.0 > maxSpeed && segment.lineNumber != fastLine) {
+            fastLines++;
+            fastLine = segment.lineNumber;
+        }
+    }
+
+    if (interpreter.hasError()) {
+        fprintf(stderr, "%s\n", interpreter.errorString().toUtf8().constData());
+        return EXIT_FAILURE;
+    }
+
+    int count = static_cast<int>(points[0].size());
+    timer.restart();
+    long rejected = 0;
+    qint64 firstRejected = 0;
+    int done = 0;
+    while (done < count) {
+        done += grid.validate(points[0].data() + done, points[1].data() + done, points[2].data() + done, count - done, margin);
+        if (done < count) {
+            if (rejected == 0)
+                firstRejected = lineNumbers[done];
+            rejected++;
+            done++;
+        }
+    }
+    double gridTime = timer.nsecsElapsed() / 1000000.0;
+
+    timer.restart();
+    std::vector<char> reachable(count);
+    for (int k = 0; k < count; k++) {
+        double position[3] = { points[0][k], points[1][k], points[2][k] };
+        double angles[3];
+        reachable[k] = kinematics.inverse(position, angles);
+    }
+    double inverseTime = timer.nsecsElapsed() / 1000000.0;
+
+    long missed = 0;
+    for (int k = 0; k < count; k++) {
+        double position[3] = { points[0][k], points[1][k], points[2][k] };
+        if (!reachable[k] && grid.isSafe(position, margin))
+            missed++;
+    }
+
+    printf("%d points\n", count);
+    printf("grid lookups        %10.3f ms %12.0f points/ms\n", gridTime, count / gridTime);
+    printf("inverse kinematics  %10.3f ms %12.0f points/ms\n", inverseTime, count / inverseTime);
+    printf("%ld points rejected", rejected);
+    if (rejected > 0)
+        printf(", the first on line %lld", static_cast<long long>(firstRejected));
+    printf("\n%ld points accepted out of reach\n", missed);
+    printf("%ld lines faster than the arm\n", fastLines);
+    return EXIT_SUCCESS;
+}